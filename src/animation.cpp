@@ -0,0 +1,110 @@
+// Deskman robot.
+// Animation module.
+// Thomas Jacobs
+
+#include "animation.h"
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+using namespace std;
+
+static const double NEVER = numeric_limits<double>::infinity();
+
+float ease(Ease curve, float t) {
+    t = min(max(t, 0.0f), 1.0f);
+    switch (curve) {
+        case Ease::Linear:    return t;
+        case Ease::InSine:    return 1 - cosf(t * (float)M_PI_2);
+        case Ease::OutSine:   return sinf(t * (float)M_PI_2);
+        case Ease::InOutSine: return 0.5f - 0.5f * cosf(t * (float)M_PI);
+    }
+    return t;
+}
+
+// -----------------------------------------------------------
+// Track
+// -----------------------------------------------------------
+
+float Track::peek(double time) const {
+    float from = held;
+    double fromTime = heldTime;
+    for (const Key& key : keys) {
+        if (key.time > time) return from + (key.value - from) * ease(key.curve, (float)((time - fromTime) / (key.time - fromTime)));
+        from = key.value;
+        fromTime = key.time;
+    }
+    return from;
+}
+
+float Track::at(double time) {
+    // Keys passed become the held value, so a track at rest costs nothing
+    while (!keys.empty() && keys.front().time <= time) {
+        held = keys.front().value;
+        heldTime = keys.front().time;
+        keys.pop_front();
+    }
+    if (keys.empty()) return held;
+    const Key& key = keys.front();
+    return held + (key.value - held) * ease(key.curve, (float)((time - heldTime) / (key.time - heldTime)));
+}
+
+Track& Track::to(double start, float value, double duration, Ease curve) {
+    float from = peek(start);
+    while (!keys.empty() && keys.back().time > start) keys.pop_back();
+    if (start > end()) keys.push_back({ start, from, Ease::Linear });
+    keys.push_back({ start + max(duration, 0.0), value, curve });
+    return *this;
+}
+
+Track& Track::then(float value, double duration, Ease curve) {
+    keys.push_back({ end() + max(duration, 0.0), value, curve });
+    return *this;
+}
+
+void Track::set(float value) {
+    keys.clear();
+    held = value;
+}
+
+double Track::next(double time) const {
+    // Flat up to the next key if that's where it already is, so holds don't need frames
+    float from = held;
+    for (const Key& key : keys) {
+        if (key.time <= time) {
+            from = key.value;
+            continue;
+        }
+        return key.value != from ? time : key.time;
+    }
+    return NEVER;
+}
+
+// -----------------------------------------------------------
+// Animation
+// -----------------------------------------------------------
+
+void Animation::cue(double time, Action action) {
+    cues.push_back({ time, move(action) });
+}
+
+bool Animation::update(double time) {
+    // Earliest first, taken out before it runs since it may cue more
+    bool ran = false;
+    while (true) {
+        auto due = min_element(cues.begin(), cues.end(), [](const Cue& a, const Cue& b) { return a.time < b.time; });
+        if (due == cues.end() || due->time > time) break;
+        Cue cue = move(*due);
+        cues.erase(due);
+        cue.action(cue.time);
+        ran = true;
+    }
+    return ran;
+}
+
+double Animation::next(double time) const {
+    double next = NEVER;
+    for (const Cue& cue : cues) next = min(next, cue.time);
+    for (const Track* track : tracks) next = min(next, track->next(time));
+    return max(next, time);
+}
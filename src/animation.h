@@ -0,0 +1,92 @@
+// Deskman robot.
+// Animation module.
+// Thomas Jacobs
+
+#pragma once
+
+#include <deque>
+#include <chrono>
+#include <vector>
+#include <functional>
+
+// Easing curves, from 0 to 1 over t from 0 to 1
+enum class Ease {
+    Linear,
+    InSine,     // Starts slow
+    OutSine,    // Ends slow
+    InOutSine,  // Both
+};
+
+float ease(Ease curve, float t);
+
+// A value moving through keyframes in seconds. Only evaluated while keys are left, otherwise it
+// holds the last one. Times asked for must not go backwards.
+class Track {
+public:
+    explicit Track(float value = 0) : held(value) {}
+
+    // Value at time
+    float at(double time);
+
+    // Ramp from the value at start to value over duration, replacing whatever was queued after start.
+    // Zero duration jumps.
+    Track& to(double start, float value, double duration, Ease curve = Ease::InOutSine);
+
+    // Then on to value after the last key, or hold it for duration if it's the same
+    Track& then(float value, double duration, Ease curve = Ease::InOutSine);
+
+    // Jump to value, nothing queued
+    void set(float value);
+
+    // When it next changes after time, time itself if it's moving, infinity if nothing's queued
+    double next(double time) const;
+
+    // Time of the last key, when it comes to rest
+    double end() const { return keys.empty() ? heldTime : keys.back().time; }
+
+private:
+    struct Key {
+        double time;
+        float value;
+        Ease curve;  // Into this key from the one before
+    };
+
+    // Value at time without dropping keys
+    float peek(double time) const;
+
+    std::deque<Key> keys;
+    float held;  // Value of the last key passed
+    double heldTime = 0;
+};
+
+// Clock, tracks and cues of the face. Runs on a monotonic clock in seconds, the same on every thread,
+// so it goes at the same speed however often the loop gets round, tracks made on one thread can be
+// evaluated on another, and it can say how long it's safe to sleep.
+class Animation {
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<void(double time)> Action;  // Time it was cued for
+
+    static double now() { return std::chrono::duration<double>(Clock::now().time_since_epoch()).count(); }
+
+    // Track to look at for deadlines, it must outlive the animation
+    void add(Track& track) { tracks.push_back(&track); }
+
+    // Run action once time comes, from update. Actions may cue more.
+    void cue(double time, Action action);
+
+    // Run cues that are due, in order. True if any ran.
+    bool update(double time);
+
+    // When anything next changes, time itself while a track is moving, infinity if nothing's queued
+    double next(double time) const;
+
+private:
+    struct Cue {
+        double time;
+        Action action;
+    };
+
+    std::vector<Track*> tracks;
+    std::vector<Cue> cues;
+};
@@ -0,0 +1,123 @@
+// Deskman robot.
+// Multi-rate audio bus.
+// Thomas Jacobs
+
+#include "audio_bus.h"
+#include <iostream>
+
+using namespace std;
+
+// The native ring is made for this and resized to the rate the device grants when it starts
+static const int NATIVE_RATE = 48000;
+static const int NATIVE_RETENTION_MS = 1000;
+
+AudioBus::AudioBus(int retentionMs) :
+    retention(retentionMs), nativeRing(NATIVE_RATE, NATIVE_RETENTION_MS), capture(nativeRing) {
+    capture.setBlockCallback([this](const AudioSpan<int16_t>& block, int64_t timestampNs) {
+        fanOut(block, timestampNs);
+    });
+}
+
+AudioBus::~AudioBus() {
+    stop();
+}
+
+AudioBus::Stream& AudioBus::stream(int rate) {
+    for (auto& s : streams) {
+        if (s->rate == rate) return *s;
+    }
+    if (capture.isRunning()) {
+        cerr << "Audio bus stream " << rate << " Hz added while capturing." << endl;
+    }
+    streams.push_back(make_unique<Stream>());
+    Stream& s = *streams.back();
+    s.rate = rate;
+    s.pcm = make_unique<AudioRing<int16_t>>(rate, retention);
+    return s;
+}
+
+AudioRing<int16_t>& AudioBus::int16Stream(int rate) {
+    return *stream(rate).pcm;
+}
+
+AudioRing<float>& AudioBus::floatStream(int rate) {
+    Stream& s = stream(rate);
+    if (!s.pcmFloat) s.pcmFloat = make_unique<AudioRing<float>>(rate, retention);
+    return *s.pcmFloat;
+}
+
+bool AudioBus::start(int nativeRate, int periodMs) {
+    // Check already running
+    if (capture.isRunning()) return true;
+
+    // Open the device, it may not give us the rate we asked for. Without one readers are let go
+    // rather than waiting on audio that will never come.
+    if (!capture.start(nativeRate, nativeRate * periodMs / 1000)) {
+        closeStreams();
+        return false;
+    }
+    int rate = capture.deviceRate();
+
+    // One converter per rate, with scratch big enough for a period
+    size_t period = capture.periodSize();
+    for (auto& s : streams) {
+        s->resampler.configure(rate, s->rate);
+        s->converted.resize(s->resampler.maxOutput(period * 2));
+        s->samples.resize(s->converted.size());
+        s->pcm->reopen();
+        if (s->pcmFloat) s->pcmFloat->reopen();
+    }
+    return true;
+}
+
+void AudioBus::stop() {
+    capture.stop();
+    closeStreams();
+}
+
+void AudioBus::closeStreams() {
+    for (auto& s : streams) {
+        s->pcm->close();
+        if (s->pcmFloat) s->pcmFloat->close();
+    }
+}
+
+// Runs on the capture thread for every period
+void AudioBus::fanOut(const AudioSpan<int16_t>& block, int64_t timestampNs) {
+    for (auto& s : streams) {
+        fanOut(*s, block.first, block.firstSize, timestampNs);
+        if (block.secondSize) {
+            int64_t secondNs = timestampNs + (int64_t)block.firstSize * 1000000000LL / capture.deviceRate();
+            fanOut(*s, block.second, block.secondSize, secondNs);
+        }
+    }
+    if (onBlock) onBlock(block, timestampNs);
+}
+
+void AudioBus::fanOut(Stream& s, const int16_t* samples, size_t n, int64_t timestampNs) {
+    // Same rate as the device, straight copy
+    uint64_t start = s.pcm->position();
+    if (s.resampler.passthrough() && !s.pcmFloat) {
+        s.pcm->write(samples, n);
+        s.pcm->stamp(start, timestampNs);
+        return;
+    }
+
+    // Convert once, then publish in each format
+    if (s.converted.size() < s.resampler.maxOutput(n)) {
+        s.converted.resize(s.resampler.maxOutput(n));
+        s.samples.resize(s.converted.size());
+    }
+    size_t count = s.resampler.process(samples, n, s.converted.data());
+    if (s.resampler.passthrough()) {
+        s.pcm->write(samples, n);
+    } else {
+        floatToInt16(s.converted.data(), s.samples.data(), count);
+        s.pcm->write(s.samples.data(), count);
+    }
+    if (s.pcmFloat) s.pcmFloat->write(s.converted.data(), count);
+
+    // Date the output, allowing for the filter delay
+    int64_t delayNs = (int64_t)s.resampler.delay() * 1000000000LL / s.rate;
+    s.pcm->stamp(start, timestampNs - delayNs);
+}
@@ -0,0 +1,56 @@
+// Deskman robot.
+// Multi-rate audio bus.
+// Thomas Jacobs
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "audio_ring.h"
+#include "audio_capture.h"
+#include "resampler.h"
+
+// One capture stream at the device's native rate, fanned out to every rate a consumer asked for.
+// Each rate is resampled once on the capture thread into its own ring, as int16 and, if anyone
+// wants it, as float. Consumers then read those rings like any other capture ring.
+class AudioBus {
+public:
+    AudioBus(int retentionMs);
+    ~AudioBus();
+
+    // Ask for a stream at a rate, call before start()
+    AudioRing<int16_t>& int16Stream(int rate);
+    AudioRing<float>& floatStream(int rate);
+
+    // Open the device near the native rate and start fanning out
+    bool start(int nativeRate, int periodMs = 20);
+    void stop();
+    bool isRunning() const { return capture.isRunning(); }
+
+    int deviceRate() const { return capture.deviceRate(); }
+    uint64_t overruns() const { return capture.overruns(); }
+
+    // Called on the capture thread after every block has been fanned out
+    void setBlockCallback(AudioCapture::BlockCallback callback) { onBlock = callback; }
+
+private:
+    struct Stream {
+        int rate;
+        Resampler resampler;
+        std::unique_ptr<AudioRing<int16_t>> pcm;
+        std::unique_ptr<AudioRing<float>> pcmFloat;
+        std::vector<float> converted;
+        std::vector<int16_t> samples;
+    };
+
+    Stream& stream(int rate);
+    void closeStreams();
+    void fanOut(const AudioSpan<int16_t>& block, int64_t timestampNs);
+    void fanOut(Stream& s, const int16_t* samples, size_t n, int64_t timestampNs);
+
+    int retention;
+    AudioRing<int16_t> nativeRing;
+    AudioCapture capture;
+    std::vector<std::unique_ptr<Stream>> streams;
+    AudioCapture::BlockCallback onBlock;
+};
@@ -0,0 +1,317 @@
+// Deskman robot.
+// Audio capture engine.
+// Thomas Jacobs
+
+#include "audio_capture.h"
+#include <vector>
+#include <iostream>
+#include <cerrno>
+#include <pthread.h>
+#ifdef ALSA
+#include <poll.h>
+#endif
+
+// Logging
+#define DEBUG 0
+
+// A failed read waits this long before trying again
+static const int ERROR_BACKOFF_MS = 100;
+
+using namespace std;
+
+AudioCapture::AudioCapture(AudioRing<int16_t>& ring_) : ring(ring_) { }
+
+AudioCapture::~AudioCapture() {
+    stop();
+}
+
+bool AudioCapture::start(int sampleRate, int periodFrames, bool realtime) {
+    // Check already running
+    if (running) return true;
+
+    // Open
+    rate = sampleRate;
+    period = periodFrames;
+    realtimeRequested = realtime;
+    if (!openDevice()) {
+        closeDevice();
+        return false;
+    }
+
+    // The ring runs at whatever rate the device gave
+    if (ring.sampleRate() != rate) ring.resize(rate);
+
+    // Start thread
+    ring.reopen();
+    running = true;
+    captureThread = thread(&AudioCapture::captureLoop, this);
+    return true;
+}
+
+void AudioCapture::stop() {
+    running = false;
+    if (captureThread.joinable()) {
+        captureThread.join();
+    }
+    closeDevice();
+
+    // Wake up anyone waiting for samples
+    ring.close();
+}
+
+void AudioCapture::publish(const int16_t* samples, size_t frames, int64_t timestampNs) {
+    uint64_t start = ring.position();
+
+    // Mono goes straight in, anything else is downmixed on the way
+    if (channels == 1) {
+        ring.write(samples, frames);
+    } else {
+        size_t done = 0;
+        while (done < frames) {
+            size_t granted;
+            int16_t* dst = ring.writeRegion(frames - done, granted);
+            for (size_t i = 0; i < granted; i++) {
+                int sum = 0;
+                for (int c = 0; c < channels; c++) sum += samples[(done + i) * channels + c];
+                dst[i] = (int16_t)(sum / channels);
+            }
+            ring.commit(granted);
+            done += granted;
+        }
+    }
+    ring.stamp(start, timestampNs);
+
+    // Let observers see the block in place
+    if (onBlock) {
+        AudioRing<int16_t>::Reader reader = ring.readerAt(start);
+        onBlock(reader.read(frames), timestampNs);
+    }
+}
+
+// Raise the calling thread to SCHED_FIFO, falling back quietly to normal scheduling
+static void raisePriority() {
+    #ifdef __linux__
+    sched_param param;
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 10;
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0) {
+        cerr << "Capture thread running without realtime priority (" << strerror(err) << ")." << endl;
+    }
+    #endif
+}
+
+#ifdef ALSA
+
+// -----------------------------------------------------------
+// ALSA, mmap and poll
+// -----------------------------------------------------------
+
+bool AudioCapture::openDevice() {
+    if (snd_pcm_open(&pcm, "default", SND_PCM_STREAM_CAPTURE, SND_PCM_NONBLOCK) < 0) {
+        cerr << "Failed to open ALSA capture device." << endl;
+        pcm = nullptr;
+        return false;
+    }
+
+    // Hardware params, mmap access with a four period buffer
+    snd_pcm_hw_params_t *hw_params;
+    snd_pcm_hw_params_alloca(&hw_params);
+    unsigned int actualRate = rate;
+    snd_pcm_uframes_t periodFrames = period;
+    snd_pcm_uframes_t bufferFrames = period * 4;
+    channels = 1;
+    if (snd_pcm_hw_params_any(pcm, hw_params) < 0 ||
+        snd_pcm_hw_params_set_access(pcm, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED) < 0 ||
+        snd_pcm_hw_params_set_format(pcm, hw_params, SND_PCM_FORMAT_S16_LE) < 0 ||
+        snd_pcm_hw_params_set_rate_near(pcm, hw_params, &actualRate, 0) < 0) {
+        cerr << "Failed to configure ALSA capture device." << endl;
+        return false;
+    }
+    if (snd_pcm_hw_params_set_channels(pcm, hw_params, 1) < 0) {
+        // Some mics only do stereo, downmix those
+        channels = 2;
+        if (snd_pcm_hw_params_set_channels(pcm, hw_params, 2) < 0) {
+            cerr << "Failed to set ALSA capture channels." << endl;
+            return false;
+        }
+    }
+    snd_pcm_hw_params_set_period_size_near(pcm, hw_params, &periodFrames, 0);
+    snd_pcm_hw_params_set_buffer_size_near(pcm, hw_params, &bufferFrames);
+    if (snd_pcm_hw_params(pcm, hw_params) < 0) {
+        cerr << "Failed to apply ALSA capture params." << endl;
+        return false;
+    }
+    snd_pcm_hw_params_get_period_size(hw_params, &periodFrames, 0);
+    rate = actualRate;
+    period = periodFrames;
+
+    // Software params, wake once per period and timestamp against the monotonic clock
+    snd_pcm_sw_params_t *sw_params;
+    snd_pcm_sw_params_alloca(&sw_params);
+    snd_pcm_sw_params_current(pcm, sw_params);
+    snd_pcm_sw_params_set_avail_min(pcm, sw_params, periodFrames);
+    snd_pcm_sw_params_set_tstamp_mode(pcm, sw_params, SND_PCM_TSTAMP_ENABLE);
+    snd_pcm_sw_params_set_tstamp_type(pcm, sw_params, SND_PCM_TSTAMP_TYPE_MONOTONIC);
+    if (snd_pcm_sw_params(pcm, sw_params) < 0) {
+        cerr << "Failed to apply ALSA capture sw params." << endl;
+        return false;
+    }
+    if (DEBUG) cout << "Capture: " << rate << " Hz, period " << period << ", channels " << channels << endl;
+    return true;
+}
+
+void AudioCapture::closeDevice() {
+    if (pcm) {
+        snd_pcm_drop(pcm);
+        snd_pcm_close(pcm);
+        pcm = nullptr;
+    }
+}
+
+// Recover from an overrun or suspend and restart the stream
+void AudioCapture::recover(int err) {
+    if (err == -EPIPE) overrunCount++;
+    if (snd_pcm_recover(pcm, err, 1) == 0) {
+        snd_pcm_start(pcm);
+    }
+}
+
+void AudioCapture::captureLoop() {
+    if (realtimeRequested) raisePriority();
+
+    // Poll descriptors
+    int count = snd_pcm_poll_descriptors_count(pcm);
+    vector<pollfd> fds(count > 0 ? count : 1);
+    snd_pcm_poll_descriptors(pcm, fds.data(), count);
+
+    // Capture has to be started by hand with mmap access
+    snd_pcm_start(pcm);
+    while (running) {
+        // Sleep until a period is ready
+        if (poll(fds.data(), count, 100) <= 0) continue;
+        unsigned short revents = 0;
+        snd_pcm_poll_descriptors_revents(pcm, fds.data(), count, &revents);
+        if (revents & POLLERR) {
+            recover(-EPIPE);
+            continue;
+        }
+        if (!(revents & POLLIN)) continue;
+
+        // How much is waiting
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm);
+        if (avail < 0) {
+            recover((int)avail);
+            continue;
+        }
+
+        // Timestamp of the hardware pointer, used to date each block
+        snd_pcm_uframes_t availAtStamp = avail;
+        snd_htimestamp_t ts;
+        int64_t stampNs = 0;
+        if (snd_pcm_htimestamp(pcm, &availAtStamp, &ts) == 0 && (ts.tv_sec || ts.tv_nsec)) {
+            stampNs = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+        } else {
+            stampNs = monotonicNs();
+            availAtStamp = avail;
+        }
+
+        // Copy whole periods out of the mmap area
+        snd_pcm_uframes_t consumed = 0;
+        while (avail >= period) {
+            const snd_pcm_channel_area_t *areas;
+            snd_pcm_uframes_t offset;
+            snd_pcm_uframes_t frames = period;
+            int err = snd_pcm_mmap_begin(pcm, &areas, &offset, &frames);
+            if (err < 0) {
+                recover(err);
+                break;
+            }
+
+            // The first sample of this block was captured availAtStamp - consumed frames before the stamp
+            int64_t blockNs = stampNs - ((int64_t)availAtStamp - (int64_t)consumed) * 1000000000LL / rate;
+            const int16_t *src = (const int16_t *)((const uint8_t *)areas[0].addr + (areas[0].first + offset * areas[0].step) / 8);
+            publish(src, frames, blockNs);
+
+            snd_pcm_sframes_t committed = snd_pcm_mmap_commit(pcm, offset, frames);
+            if (committed < 0 || (snd_pcm_uframes_t)committed != frames) {
+                recover(committed < 0 ? (int)committed : -EPIPE);
+                break;
+            }
+            avail -= frames;
+            consumed += frames;
+        }
+    }
+}
+
+#else
+
+// -----------------------------------------------------------
+// PortAudio, blocking reads on the capture thread
+// -----------------------------------------------------------
+
+bool AudioCapture::openDevice() {
+    PaError err = Pa_Initialize();
+    if (err != paNoError) {
+        cerr << "Pa_Initialize failed: " << Pa_GetErrorText(err) << endl;
+        return false;
+    }
+    paInitialized = true;
+
+    // Params
+    PaStreamParameters inputParameters;
+    memset(&inputParameters, 0, sizeof(inputParameters));
+    inputParameters.device = Pa_GetDefaultInputDevice();
+    inputParameters.channelCount = 1;
+    inputParameters.sampleFormat = paInt16;
+    inputParameters.suggestedLatency = Pa_GetDeviceInfo(inputParameters.device)->defaultLowInputLatency;
+    inputParameters.hostApiSpecificStreamInfo = nullptr;
+    channels = 1;
+
+    // Open stream
+    err = Pa_OpenStream(&stream, &inputParameters, nullptr, rate, period, paClipOff, nullptr, nullptr);
+    if (err != paNoError) {
+        cerr << "Pa_OpenStream input failed: " << Pa_GetErrorText(err) << endl;
+        stream = nullptr;
+        return false;
+    }
+
+    // Start stream
+    err = Pa_StartStream(stream);
+    if (err != paNoError) {
+        cerr << "Pa_StartStream input failed: " << Pa_GetErrorText(err) << endl;
+        return false;
+    }
+    return true;
+}
+
+void AudioCapture::closeDevice() {
+    if (stream) {
+        Pa_StopStream(stream);
+        Pa_CloseStream(stream);
+        stream = nullptr;
+    }
+    if (paInitialized) {
+        Pa_Terminate();
+        paInitialized = false;
+    }
+}
+
+void AudioCapture::captureLoop() {
+    if (realtimeRequested) raisePriority();
+
+    // One period of staging, allocated once
+    vector<int16_t> block(period);
+    while (running) {
+        PaError err = Pa_ReadStream(stream, block.data(), period);
+        if (err == paInputOverflowed) overrunCount++;
+        else if (err != paNoError) {
+            // The device went away or broke, don't spin on it
+            this_thread::sleep_for(chrono::milliseconds(ERROR_BACKOFF_MS));
+            continue;
+        }
+        int64_t blockNs = monotonicNs() - (int64_t)period * 1000000000LL / rate;
+        publish(block.data(), period, blockNs);
+    }
+}
+
+#endif
@@ -0,0 +1,70 @@
+// Deskman robot.
+// Audio capture engine.
+// Thomas Jacobs
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <functional>
+#include "audio_ring.h"
+
+// On linux, use ALSA
+#ifdef __linux__
+#define ALSA
+#endif
+#ifdef ALSA
+#include <alsa/asoundlib.h>
+#else
+#include "portaudio.h"
+#endif
+
+// Owns the capture device on its own thread and publishes period-sized blocks into a ring.
+// On Linux the device is opened for mmap access and the thread sleeps in poll() until a period
+// is ready, so nothing ever blocks in a read and a slow consumer cannot cause an overrun.
+class AudioCapture {
+public:
+    // Called on the capture thread for every block, with the capture time of its first sample
+    typedef std::function<void(const AudioSpan<int16_t>& block, int64_t timestampNs)> BlockCallback;
+
+    AudioCapture(AudioRing<int16_t>& ring);
+    ~AudioCapture();
+
+    // Open the device and start the capture thread, realtime asks for SCHED_FIFO if allowed
+    bool start(int sampleRate, int periodFrames, bool realtime = true);
+    void stop();
+    bool isRunning() const { return running; }
+
+    void setBlockCallback(BlockCallback callback) { onBlock = callback; }
+
+    // Stats
+    uint64_t overruns() const { return overrunCount; }
+    int deviceRate() const { return rate; }
+    int periodSize() const { return period; }
+
+private:
+    bool openDevice();
+    void closeDevice();
+    void captureLoop();
+    void publish(const int16_t* samples, size_t frames, int64_t timestampNs);
+
+    AudioRing<int16_t>& ring;
+    std::thread captureThread;
+    std::atomic<bool> running{false};
+    BlockCallback onBlock;
+
+    // Device params
+    int rate = 0;
+    int period = 0;
+    int channels = 1;
+    bool realtimeRequested = false;
+    std::atomic<uint64_t> overrunCount{0};
+
+    #ifdef ALSA
+    snd_pcm_t *pcm = nullptr;
+    void recover(int err);
+    #else
+    PaStream *stream = nullptr;
+    bool paInitialized = false;  // Each open's Pa_Initialize is matched by a Pa_Terminate on close
+    #endif
+};
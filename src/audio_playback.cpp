@@ -0,0 +1,303 @@
+// Deskman robot.
+// Audio playback engine.
+// Thomas Jacobs
+
+#include "audio_playback.h"
+#include <cmath>
+#include <cerrno>
+#include <iostream>
+
+// Logging
+#define DEBUG 0
+
+using namespace std;
+
+// Jitter buffer limits
+static const int MIN_TARGET_MS = 40;
+static const int MAX_TARGET_MS = 600;
+
+AudioPlayback::AudioPlayback(int sampleRate, int maxQueuedMs) :
+    fifo((size_t)sampleRate * maxQueuedMs / 1000), rate(sampleRate) { }
+
+AudioPlayback::~AudioPlayback() {
+    stop();
+}
+
+bool AudioPlayback::start(int periodFrames) {
+    // Check already running
+    if (running) return true;
+
+    // Open
+    period = periodFrames;
+    if (!sink && !openDevice()) {
+        closeDevice();
+        return false;
+    }
+
+    // Start thread
+    running = true;
+    playThread = thread(&AudioPlayback::playLoop, this);
+    return true;
+}
+
+void AudioPlayback::stop() {
+    running = false;
+    fifo.wake();
+    if (playThread.joinable()) {
+        playThread.join();
+    }
+    closeDevice();
+}
+
+bool AudioPlayback::push(const int16_t* samples, size_t frames) {
+    trackArrival(frames);
+    size_t taken = fifo.push(samples, frames);
+    if (taken < frames) {
+        overrunCount += frames - taken;
+        return false;
+    }
+    return true;
+}
+
+void AudioPlayback::endStream() {
+    ended = true;
+    fifo.wake();
+}
+
+// Keep a running mean and mean deviation of the gap between deliveries, the same
+// estimator TCP uses for round trip time, and size the jitter buffer to cover mean + 4 deviations
+void AudioPlayback::trackArrival(size_t frames) {
+    int64_t now = monotonicNs();
+    int64_t gapNs = now - lastArrivalNs;
+    lastArrivalNs = now;
+
+    // A long silence starts a new stream rather than counting as a gap
+    if (gapNs > 1000000000LL) return;
+    float gap = gapNs / 1e6f;
+    float mean = gapMean.load(memory_order_relaxed);
+    float deviation = gapDeviation.load(memory_order_relaxed);
+    deviation += (fabsf(gap - mean) - deviation) / 8;
+    mean += (gap - mean) / 8;
+    gapMean.store(mean, memory_order_relaxed);
+    gapDeviation.store(deviation, memory_order_relaxed);
+    jitterFrames.store((int)((mean + 4 * deviation) * rate / 1000), memory_order_relaxed);
+}
+
+size_t AudioPlayback::targetFrames() const {
+    int target = jitterFrames.load(memory_order_relaxed) + boostFrames.load(memory_order_relaxed);
+    target = max(target, rate * MIN_TARGET_MS / 1000);
+    target = min(target, rate * MAX_TARGET_MS / 1000);
+    return target;
+}
+
+AudioPlayback::Stats AudioPlayback::stats() const {
+    Stats s;
+    s.underruns = underrunCount;
+    s.overruns = overrunCount;
+    s.streams = streamCount;
+    s.targetMs = (int)(targetFrames() * 1000 / rate);
+    s.gapMs = gapMean.load(memory_order_relaxed);
+    s.gapDeviationMs = gapDeviation.load(memory_order_relaxed);
+    return s;
+}
+
+void AudioPlayback::playLoop() {
+    bool buffering = true;
+    bool resumed = false;
+    while (running) {
+        // Hold back until the jitter buffer is full, the stream has ended, or we have waited as long as it would take to fill
+        if (buffering) {
+            size_t target = targetFrames();
+            int64_t waitStart = 0;
+            while (running && fifo.size() < target && !ended) {
+                if (fifo.size() > 0) {
+                    if (!waitStart) waitStart = monotonicNs();
+                    else if (monotonicNs() - waitStart > (int64_t)target * 1000000000LL / rate) break;
+                }
+                fifo.wait(target);
+            }
+            if (!running) break;
+            if (DEBUG) cout << "Playback starting with " << fifo.size() << " frames queued, target " << target << endl;
+            buffering = false;
+            resumed = true;
+        }
+
+        // Play a period straight out of the queue
+        AudioSpan<int16_t> block = fifo.peek(period);
+        if (tap) tap(block, monotonicNs() + delayNs());
+        if (block.empty()) {
+            if (ended.exchange(false)) {
+                // Clean finish, ease the extra depth back off
+                streamCount++;
+                boostFrames.store(boostFrames.load() / 2);
+            } else {
+                // Ran dry mid-stream, buffer deeper next time
+                underrunCount++;
+                boostFrames.store(min(boostFrames.load() * 2 + rate / 50, rate * MAX_TARGET_MS / 1000));
+            }
+            buffering = true;
+            continue;
+        }
+        write(block.first, block.firstSize, resumed);
+        if (block.secondSize) write(block.second, block.secondSize, false);
+        fifo.consume(block.size());
+        resumed = false;
+    }
+}
+
+// To the device, or to the sink at the rate a device would take it
+void AudioPlayback::write(const int16_t* samples, size_t frames, bool resumed) {
+    if (!sink) {
+        writeDevice(samples, frames, resumed);
+        return;
+    }
+    int64_t now = monotonicNs();
+    if (resumed || sinkClockNs < now) sinkClockNs = now;
+    sink(samples, frames);
+    sinkClockNs += (int64_t)frames * 1000000000LL / rate;
+    this_thread::sleep_for(chrono::nanoseconds(sinkClockNs - monotonicNs()));
+}
+
+// Until a sample written now is heard
+int64_t AudioPlayback::delayNs() {
+    if (sink) return max<int64_t>(0, sinkClockNs - monotonicNs());
+    return delayDevice();
+}
+
+#ifdef ALSA
+
+// -----------------------------------------------------------
+// ALSA
+// -----------------------------------------------------------
+
+bool AudioPlayback::openDevice() {
+    if (snd_pcm_open(&pcm, "default", SND_PCM_STREAM_PLAYBACK, 0) < 0) {
+        cerr << "Failed to open ALSA playback device." << endl;
+        pcm = nullptr;
+        return false;
+    }
+
+    // Hardware params, four periods of device buffer
+    snd_pcm_hw_params_t *hw_params;
+    snd_pcm_hw_params_alloca(&hw_params);
+    unsigned int actualRate = rate;
+    snd_pcm_uframes_t periodFrames = period;
+    snd_pcm_uframes_t bufferFrames = period * 4;
+    if (snd_pcm_hw_params_any(pcm, hw_params) < 0 ||
+        snd_pcm_hw_params_set_access(pcm, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED) < 0 ||
+        snd_pcm_hw_params_set_format(pcm, hw_params, SND_PCM_FORMAT_S16_LE) < 0 ||
+        snd_pcm_hw_params_set_rate_near(pcm, hw_params, &actualRate, 0) < 0 ||
+        snd_pcm_hw_params_set_channels(pcm, hw_params, 1) < 0) {
+        cerr << "Failed to configure ALSA playback device." << endl;
+        return false;
+    }
+    snd_pcm_hw_params_set_period_size_near(pcm, hw_params, &periodFrames, 0);
+    snd_pcm_hw_params_set_buffer_size_near(pcm, hw_params, &bufferFrames);
+    if (snd_pcm_hw_params(pcm, hw_params) < 0) {
+        cerr << "Failed to apply ALSA playback params." << endl;
+        return false;
+    }
+    snd_pcm_hw_params_get_period_size(hw_params, &periodFrames, 0);
+    period = periodFrames;
+
+    // Software params, start the device once two periods are written
+    snd_pcm_sw_params_t *sw_params;
+    snd_pcm_sw_params_alloca(&sw_params);
+    snd_pcm_sw_params_current(pcm, sw_params);
+    snd_pcm_sw_params_set_start_threshold(pcm, sw_params, periodFrames * 2);
+    snd_pcm_sw_params(pcm, sw_params);
+    return true;
+}
+
+void AudioPlayback::closeDevice() {
+    if (pcm) {
+        snd_pcm_drop(pcm);
+        snd_pcm_close(pcm);
+        pcm = nullptr;
+    }
+}
+
+int64_t AudioPlayback::delayDevice() {
+    snd_pcm_sframes_t delay = 0;
+    if (snd_pcm_delay(pcm, &delay) < 0 || delay < 0) return 0;
+    return (int64_t)delay * 1000000000LL / rate;
+}
+
+// Blocking write on the playback thread, a device underrun right after resuming is expected
+void AudioPlayback::writeDevice(const int16_t* samples, size_t frames, bool resumed) {
+    while (frames > 0 && running) {
+        snd_pcm_sframes_t written = snd_pcm_writei(pcm, samples, frames);
+        if (written < 0) {
+            if (written == -EPIPE && !resumed) underrunCount++;
+            if (snd_pcm_recover(pcm, (int)written, 1) < 0) return;
+            continue;
+        }
+        samples += written;
+        frames -= written;
+    }
+}
+
+#else
+
+// -----------------------------------------------------------
+// PortAudio
+// -----------------------------------------------------------
+
+bool AudioPlayback::openDevice() {
+    PaError err = Pa_Initialize();
+    if (err != paNoError) {
+        cerr << "Pa_Initialize failed: " << Pa_GetErrorText(err) << endl;
+        return false;
+    }
+    paInitialized = true;
+
+    // Params
+    PaStreamParameters outputParameters;
+    memset(&outputParameters, 0, sizeof(outputParameters));
+    outputParameters.device = Pa_GetDefaultOutputDevice();
+    outputParameters.channelCount = 1;
+    outputParameters.sampleFormat = paInt16;
+    outputParameters.suggestedLatency = Pa_GetDeviceInfo(outputParameters.device)->defaultLowOutputLatency;
+    outputParameters.hostApiSpecificStreamInfo = nullptr;
+
+    // Open stream
+    err = Pa_OpenStream(&stream, nullptr, &outputParameters, rate, period, paClipOff, nullptr, nullptr);
+    if (err != paNoError) {
+        cerr << "Pa_OpenStream output failed: " << Pa_GetErrorText(err) << endl;
+        stream = nullptr;
+        return false;
+    }
+
+    // Start stream
+    err = Pa_StartStream(stream);
+    if (err != paNoError) {
+        cerr << "Pa_StartStream output failed: " << Pa_GetErrorText(err) << endl;
+        return false;
+    }
+    return true;
+}
+
+void AudioPlayback::closeDevice() {
+    if (stream) {
+        Pa_StopStream(stream);
+        Pa_CloseStream(stream);
+        stream = nullptr;
+    }
+    if (paInitialized) {
+        Pa_Terminate();
+        paInitialized = false;
+    }
+}
+
+// Blocking writes return once the block fits, so it's heard after the stream's latency
+int64_t AudioPlayback::delayDevice() {
+    const PaStreamInfo* info = Pa_GetStreamInfo(stream);
+    return info ? (int64_t)(info->outputLatency * 1e9) : 0;
+}
+
+void AudioPlayback::writeDevice(const int16_t* samples, size_t frames, bool resumed) {
+    PaError err = Pa_WriteStream(stream, samples, frames);
+    if (err == paOutputUnderflowed && !resumed) underrunCount++;
+}
+
+#endif
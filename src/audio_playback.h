@@ -0,0 +1,110 @@
+// Deskman robot.
+// Audio playback engine.
+// Thomas Jacobs
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <functional>
+#include "audio_ring.h"
+
+// On linux, use ALSA
+#ifdef __linux__
+#define ALSA
+#endif
+#ifdef ALSA
+#include <alsa/asoundlib.h>
+#else
+#include "portaudio.h"
+#endif
+
+// Plays queued PCM on its own thread so the network thread never waits on the sound card.
+// Incoming audio goes into a bounded lock-free FIFO. A jitter buffer holds playback back at the
+// start of each stream until enough audio is queued to ride out the gaps seen between deliveries.
+class AudioPlayback {
+public:
+    struct Stats {
+        uint64_t underruns;     // Queue ran dry in the middle of a stream
+        uint64_t overruns;      // Samples dropped because the queue was full
+        uint64_t streams;       // Streams played out to the end
+        int targetMs;           // Current jitter buffer depth
+        float gapMs;            // Mean gap between deliveries
+        float gapDeviationMs;   // Mean deviation of that gap
+    };
+
+    typedef std::function<void(const int16_t* samples, size_t frames)> Sink;
+    typedef std::function<void(const AudioSpan<int16_t>& block, int64_t heardNs)> Tap;
+
+    AudioPlayback(int sampleRate, int maxQueuedMs);
+    ~AudioPlayback();
+
+    // Play into a callback instead of the sound card, paced in real time like a device, set before start
+    void setSink(Sink callback) { sink = callback; }
+
+    // See each block before it's played with when its first sample will be heard, and an empty one when
+    // playback stops, set before start
+    void setTap(Tap callback) { tap = callback; }
+
+    // Open the device and start the playback thread
+    bool start(int periodFrames);
+    void stop();
+    bool isRunning() const { return running; }
+
+    // Queue samples, never blocks, returns false if the queue was full and some were dropped
+    bool push(const int16_t* samples, size_t frames);
+
+    // No more audio is coming for this stream, play out what is queued without waiting to fill up
+    void endStream();
+
+    size_t queuedFrames() const { return fifo.size(); }
+    Stats stats() const;
+
+private:
+    bool openDevice();
+    void closeDevice();
+    void playLoop();
+    void write(const int16_t* samples, size_t frames, bool resumed);
+    void writeDevice(const int16_t* samples, size_t frames, bool resumed);
+    int64_t delayNs();
+    int64_t delayDevice();
+    void trackArrival(size_t frames);
+    size_t targetFrames() const;
+
+    AudioFifo<int16_t> fifo;
+    std::thread playThread;
+    std::atomic<bool> running{false};
+    std::atomic<bool> ended{false};
+
+    // Device params
+    int rate;
+    int period = 0;
+
+    // Stands in for the device
+    Sink sink;
+    int64_t sinkClockNs = 0;
+
+    // Sees what's played
+    Tap tap;
+
+    // Jitter estimate, written by the producer
+    int64_t lastArrivalNs = 0;
+    std::atomic<float> gapMean{0};
+    std::atomic<float> gapDeviation{0};
+    std::atomic<int> jitterFrames{0};
+
+    // Extra depth added after underruns, written by the playback thread
+    std::atomic<int> boostFrames{0};
+
+    // Counters
+    std::atomic<uint64_t> underrunCount{0};
+    std::atomic<uint64_t> overrunCount{0};
+    std::atomic<uint64_t> streamCount{0};
+
+    #ifdef ALSA
+    snd_pcm_t *pcm = nullptr;
+    #else
+    PaStream *stream = nullptr;
+    bool paInitialized = false;  // Each open's Pa_Initialize is matched by a Pa_Terminate on close
+    #endif
+};
@@ -0,0 +1,375 @@
+// Deskman robot.
+// Lock-free audio ring buffer.
+// Thomas Jacobs
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <time.h>
+
+// Monotonic clock in nanoseconds, the same clock ALSA timestamps use
+inline int64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Zero-copy view of samples in the ring, split in two when it wraps around the end
+template <typename T>
+struct AudioSpan {
+    const T* first = nullptr;
+    size_t firstSize = 0;
+    const T* second = nullptr;
+    size_t secondSize = 0;
+    uint64_t position = 0;  // Absolute index of the first sample since the ring was created
+
+    size_t size() const { return firstSize + secondSize; }
+    bool empty() const { return size() == 0; }
+    bool contiguous() const { return secondSize == 0; }
+
+    // Copy out up to n samples, returns how many were copied
+    size_t copyTo(T* dst, size_t n) const {
+        size_t a = std::min<size_t>(n, firstSize);
+        memcpy(dst, first, a * sizeof(T));
+        size_t b = std::min<size_t>(n - a, secondSize);
+        if (b) memcpy(dst + a, second, b * sizeof(T));
+        return a + b;
+    }
+
+    // Pointer to all samples in one piece, only copies into scratch when the span wraps
+    const T* data(T* scratch) const {
+        if (contiguous()) return first;
+        copyTo(scratch, size());
+        return scratch;
+    }
+};
+
+// Single producer, multiple consumer ring of PCM samples.
+// Storage is allocated once up front. The producer writes and then publishes a monotonically
+// increasing write position; each consumer keeps its own read position and reads spans in place.
+// Samples stay readable for the retention window; a consumer that falls further behind skips forward.
+template <typename T>
+class AudioRing {
+public:
+    AudioRing(int sampleRate, int retentionMs) : retentionMs(retentionMs) {
+        allocate(sampleRate);
+    }
+
+    AudioRing(const AudioRing&) = delete;
+    AudioRing& operator=(const AudioRing&) = delete;
+
+    // -----------------------------------------------------------
+    // Producer
+    // -----------------------------------------------------------
+
+    // Contiguous writable region at the write position, at most n samples, so a device can fill it directly
+    T* writeRegion(size_t n, size_t& granted) {
+        size_t offset = head & mask;
+        granted = std::min<size_t>(n, capacity - offset);
+        return buffer.data() + offset;
+    }
+
+    // Publish n samples written into the region
+    void commit(size_t n) {
+        head += n;
+        writePos.store(head, std::memory_order_release);
+        epoch.fetch_add(1, std::memory_order_release);
+        epoch.notify_all();
+    }
+
+    // Copy samples in and publish them
+    void write(const T* data, size_t n) {
+        while (n > 0) {
+            size_t granted;
+            T* dst = writeRegion(n, granted);
+            memcpy(dst, data, granted * sizeof(T));
+            commit(granted);
+            data += granted;
+            n -= granted;
+        }
+    }
+
+    // Record the monotonic time at which the sample at an absolute position was captured
+    void stamp(uint64_t position, int64_t ns) {
+        uint32_t seq = stampSeq.load(std::memory_order_relaxed);
+        stampSeq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        stampPos.store(position, std::memory_order_relaxed);
+        stampNs.store(ns, std::memory_order_relaxed);
+        stampSeq.store(seq + 2, std::memory_order_release);
+    }
+
+    // Wake all waiting consumers for good
+    void close() {
+        closed.store(true, std::memory_order_release);
+        epoch.fetch_add(1, std::memory_order_release);
+        epoch.notify_all();
+    }
+
+    void reopen() {
+        closed.store(false, std::memory_order_release);
+    }
+
+    // Change the rate, sized for the same retention, and start again from empty. Only while nothing
+    // writes or reads, for a device that didn't give the rate asked for.
+    void resize(int sampleRate) {
+        allocate(sampleRate);
+        head = 0;
+        writePos.store(0, std::memory_order_release);
+        stampPos.store(0, std::memory_order_relaxed);
+        stampNs.store(0, std::memory_order_relaxed);
+    }
+
+    // -----------------------------------------------------------
+    // Consumers
+    // -----------------------------------------------------------
+
+    class Reader {
+    public:
+        Reader() : ring(nullptr), pos(0), dropped(0) {}
+        Reader(const AudioRing* ring_, uint64_t from) : ring(ring_), pos(from), dropped(0) {}
+
+        // Samples ready to read
+        size_t available() {
+            if (!ring) return 0;
+            clampToRetention();
+            uint64_t head = ring->position();
+            return head > pos ? (size_t)(head - pos) : 0;
+        }
+
+        // Look at up to n samples without consuming them
+        AudioSpan<T> peek(size_t n) {
+            size_t count = std::min<size_t>(n, available());
+            return ring ? ring->span(pos, count) : AudioSpan<T>();
+        }
+
+        // Consume samples already looked at
+        void consume(size_t n) { pos += n; }
+
+        // Peek and consume in one
+        AudioSpan<T> read(size_t n) {
+            AudioSpan<T> s = peek(n);
+            consume(s.size());
+            return s;
+        }
+
+        // Block until at least n samples are ready, returns false if the ring was closed first
+        bool wait(size_t n) {
+            while (ring) {
+                uint32_t seen = ring->epoch.load(std::memory_order_acquire);
+                if (available() >= n) return true;
+                if (ring->closed.load(std::memory_order_acquire)) return false;
+                ring->epoch.wait(seen, std::memory_order_acquire);
+            }
+            return false;
+        }
+
+        // True if a span read earlier has not been overwritten since
+        bool valid(const AudioSpan<T>& s) const {
+            return ring && ring->position() - s.position <= ring->capacity;
+        }
+
+        void seek(uint64_t position) { pos = position; }
+        uint64_t position() const { return pos; }
+        uint64_t droppedSamples() const { return dropped; }
+
+    private:
+        // A reader that fell behind the retention window skips to its oldest edge
+        void clampToRetention() {
+            uint64_t head = ring->position();
+            if (head <= ring->retention) return;
+            uint64_t oldest = head - ring->retention;
+            if (pos < oldest) {
+                dropped += oldest - pos;
+                pos = oldest;
+            }
+        }
+
+        const AudioRing* ring;
+        uint64_t pos;
+        uint64_t dropped;
+    };
+
+    // New reader starting at the live edge, or back in time by up to the retention window
+    Reader reader(int backMs = 0) const {
+        uint64_t head = position();
+        uint64_t back = std::min<size_t>((size_t)rate * backMs / 1000, retention);
+        return Reader(this, head > back ? head - back : 0);
+    }
+
+    // New reader starting at an absolute position
+    Reader readerAt(uint64_t from) const {
+        return Reader(this, from);
+    }
+
+    // Absolute write position, i.e. total samples published
+    uint64_t position() const { return writePos.load(std::memory_order_acquire); }
+
+    // Capture time of any sample, extrapolated from the latest stamp, or 0 if nothing was stamped yet
+    int64_t timeOf(uint64_t position) const {
+        uint64_t pos;
+        int64_t ns;
+        latestStamp(pos, ns);
+        if (ns == 0) return 0;
+        return ns + ((int64_t)position - (int64_t)pos) * 1000000000LL / rate;
+    }
+
+    // Position of the sample captured at a time, the inverse of timeOf, so a time found on one ring
+    // can be looked up in another. Clamped to what has been written, the live edge if nothing was stamped.
+    uint64_t positionAt(int64_t time) const {
+        uint64_t pos;
+        int64_t ns;
+        latestStamp(pos, ns);
+        uint64_t head = position();
+        if (ns == 0) return head;
+        int64_t at = (int64_t)pos + (time - ns) * rate / 1000000000LL;
+        return (uint64_t)std::max<int64_t>(0, std::min<int64_t>(at, head));
+    }
+
+    int sampleRate() const { return rate; }
+    size_t retentionSamples() const { return retention; }
+
+private:
+    void allocate(int sampleRate) {
+        // Keep retention plus one second of slack so spans being read are not overwritten under the reader
+        rate = sampleRate;
+        retention = (size_t)sampleRate * retentionMs / 1000;
+        size_t needed = retention + sampleRate;
+        capacity = 1;
+        while (capacity < needed) capacity <<= 1;
+        mask = capacity - 1;
+        buffer.assign(capacity, 0);
+    }
+
+    // Consistent copy of the latest stamp
+    void latestStamp(uint64_t& pos, int64_t& ns) const {
+        while (true) {
+            uint32_t seq = stampSeq.load(std::memory_order_acquire);
+            if (seq & 1) continue;
+            pos = stampPos.load(std::memory_order_relaxed);
+            ns = stampNs.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (stampSeq.load(std::memory_order_relaxed) == seq) break;
+        }
+    }
+
+    AudioSpan<T> span(uint64_t from, size_t n) const {
+        AudioSpan<T> s;
+        s.position = from;
+        size_t offset = from & mask;
+        s.first = buffer.data() + offset;
+        s.firstSize = std::min<size_t>(n, capacity - offset);
+        if (s.firstSize < n) {
+            s.second = buffer.data();
+            s.secondSize = n - s.firstSize;
+        }
+        return s;
+    }
+
+    // Storage
+    std::vector<T> buffer;
+    size_t capacity;
+    size_t mask;
+    size_t retention;
+    int retentionMs;
+    int rate;
+
+    // Producer state
+    uint64_t head = 0;
+    std::atomic<uint64_t> writePos{0};
+    mutable std::atomic<uint32_t> epoch{0};
+    std::atomic<bool> closed{false};
+
+    // Latest capture timestamp
+    std::atomic<uint32_t> stampSeq{0};
+    std::atomic<uint64_t> stampPos{0};
+    std::atomic<int64_t> stampNs{0};
+};
+
+// Bounded single producer, single consumer FIFO of PCM samples.
+// Unlike the ring above the producer never overwrites unread samples; a full FIFO refuses the write.
+template <typename T>
+class AudioFifo {
+public:
+    AudioFifo(size_t minCapacity) {
+        capacity = 1;
+        while (capacity < minCapacity) capacity <<= 1;
+        mask = capacity - 1;
+        buffer.assign(capacity, 0);
+    }
+
+    AudioFifo(const AudioFifo&) = delete;
+    AudioFifo& operator=(const AudioFifo&) = delete;
+
+    // Producer: copy in as many samples as fit, returns how many were taken
+    size_t push(const T* data, size_t n) {
+        uint64_t w = tail.load(std::memory_order_relaxed);
+        uint64_t r = head.load(std::memory_order_acquire);
+        n = std::min<size_t>(n, capacity - (size_t)(w - r));
+        size_t offset = w & mask;
+        size_t first = std::min<size_t>(n, capacity - offset);
+        memcpy(buffer.data() + offset, data, first * sizeof(T));
+        memcpy(buffer.data(), data + first, (n - first) * sizeof(T));
+        tail.store(w + n, std::memory_order_release);
+        wake();
+        return n;
+    }
+
+    // Consumer: look at up to n samples in place
+    AudioSpan<T> peek(size_t n) const {
+        uint64_t r = head.load(std::memory_order_relaxed);
+        n = std::min<size_t>(n, (size_t)(tail.load(std::memory_order_acquire) - r));
+        AudioSpan<T> s;
+        s.position = r;
+        size_t offset = r & mask;
+        s.first = buffer.data() + offset;
+        s.firstSize = std::min<size_t>(n, capacity - offset);
+        if (s.firstSize < n) {
+            s.second = buffer.data();
+            s.secondSize = n - s.firstSize;
+        }
+        return s;
+    }
+
+    // Consumer: release samples looked at
+    void consume(size_t n) {
+        head.store(head.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    // Consumer: drop everything queued, returns how many samples went. Pushes landing meanwhile stay.
+    size_t clear() {
+        uint64_t w = tail.load(std::memory_order_acquire);
+        return (size_t)(w - head.exchange(w, std::memory_order_acq_rel));
+    }
+
+    size_t size() const {
+        return (size_t)(tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire));
+    }
+
+    size_t space() const { return capacity - size(); }
+
+    // Block until the FIFO holds at least n samples or someone calls wake()
+    void wait(size_t n) const {
+        uint32_t seen = epoch.load(std::memory_order_acquire);
+        if (size() >= n) return;
+        epoch.wait(seen, std::memory_order_acquire);
+    }
+
+    // Release a waiting consumer
+    void wake() {
+        epoch.fetch_add(1, std::memory_order_release);
+        epoch.notify_all();
+    }
+
+private:
+    std::vector<T> buffer;
+    size_t capacity;
+    size_t mask;
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    mutable std::atomic<uint32_t> epoch{0};
+};
@@ -0,0 +1,302 @@
+// Deskman robot.
+// Vectorised base64 module.
+// Thomas Jacobs
+
+#include "base64_simd.h"
+
+#if defined(__aarch64__)
+#define BASE64_NEON
+#include <arm_neon.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#define BASE64_X86
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Alphabet, and its inverse with 0xFF for anything that isn't in it
+static constexpr char ENCODE[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+struct DecodeTable {
+    uint8_t values[256];
+    constexpr DecodeTable() : values() {
+        for (int i = 0; i < 256; i++) values[i] = 0xFF;
+        for (int i = 0; i < 64; i++) values[(uint8_t)ENCODE[i]] = i;
+    }
+};
+static constexpr DecodeTable DECODE;
+
+// -----------------------------------------------------------
+// Scalar
+// -----------------------------------------------------------
+
+static size_t encodeScalar(const uint8_t* in, size_t n, char* out) {
+    char* start = out;
+    size_t i = 0;
+    for (; i + 3 <= n; i += 3) {
+        uint32_t v = in[i] << 16 | in[i + 1] << 8 | in[i + 2];
+        *out++ = ENCODE[v >> 18];
+        *out++ = ENCODE[(v >> 12) & 0x3F];
+        *out++ = ENCODE[(v >> 6) & 0x3F];
+        *out++ = ENCODE[v & 0x3F];
+    }
+
+    // One or two bytes left, padded
+    if (i < n) {
+        uint32_t v = in[i] << 16 | (i + 1 < n ? in[i + 1] << 8 : 0);
+        *out++ = ENCODE[v >> 18];
+        *out++ = ENCODE[(v >> 12) & 0x3F];
+        *out++ = i + 1 < n ? ENCODE[(v >> 6) & 0x3F] : '=';
+        *out++ = '=';
+    }
+    return out - start;
+}
+
+// Input has had its padding removed
+static size_t decodeScalar(const char* in, size_t n, uint8_t* out) {
+    uint8_t* start = out;
+    const uint8_t* s = reinterpret_cast<const uint8_t*>(in);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint32_t a = DECODE.values[s[i]], b = DECODE.values[s[i + 1]], c = DECODE.values[s[i + 2]], d = DECODE.values[s[i + 3]];
+        if ((a | b | c | d) & 0x80) return SIZE_MAX;
+        uint32_t v = a << 18 | b << 12 | c << 6 | d;
+        *out++ = v >> 16;
+        *out++ = v >> 8;
+        *out++ = v;
+    }
+
+    // Two or three characters left make one or two bytes
+    size_t left = n - i;
+    if (left == 1) return SIZE_MAX;
+    if (left > 1) {
+        uint32_t a = DECODE.values[s[i]], b = DECODE.values[s[i + 1]], c = left > 2 ? DECODE.values[s[i + 2]] : 0;
+        if ((a | b | c) & 0x80) return SIZE_MAX;
+        uint32_t v = a << 18 | b << 12 | c << 6;
+        *out++ = v >> 16;
+        if (left > 2) *out++ = v >> 8;
+    }
+    return out - start;
+}
+
+// -----------------------------------------------------------
+// NEON, 48 bytes to 64 characters at a time
+// -----------------------------------------------------------
+
+#ifdef BASE64_NEON
+
+static size_t encodeNeon(const uint8_t* in, size_t n, char* out) {
+    const uint8_t* t = reinterpret_cast<const uint8_t*>(ENCODE);
+    uint8x16x4_t table = { vld1q_u8(t), vld1q_u8(t + 16), vld1q_u8(t + 32), vld1q_u8(t + 48) };
+    uint8x16_t mask = vdupq_n_u8(0x3F);
+    size_t i = 0;
+    for (; i + 48 <= n; i += 48) {
+        // Deinterleave into first, second and third bytes of each group, then cut into 6 bit indices
+        uint8x16x3_t src = vld3q_u8(in + i);
+        uint8x16x4_t chars;
+        chars.val[0] = vshrq_n_u8(src.val[0], 2);
+        chars.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(src.val[0], 4), vshrq_n_u8(src.val[1], 4)), mask);
+        chars.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(src.val[1], 2), vshrq_n_u8(src.val[2], 6)), mask);
+        chars.val[3] = vandq_u8(src.val[2], mask);
+        for (int k = 0; k < 4; k++) chars.val[k] = vqtbl4q_u8(table, chars.val[k]);
+        vst4q_u8(reinterpret_cast<uint8_t*>(out) + i / 3 * 4, chars);
+    }
+    return i;
+}
+
+static size_t decodeNeon(const char* in, size_t n, uint8_t* out) {
+    uint8x16x4_t low = { vld1q_u8(DECODE.values), vld1q_u8(DECODE.values + 16), vld1q_u8(DECODE.values + 32), vld1q_u8(DECODE.values + 48) };
+    uint8x16x4_t high = { vld1q_u8(DECODE.values + 64), vld1q_u8(DECODE.values + 80), vld1q_u8(DECODE.values + 96), vld1q_u8(DECODE.values + 112) };
+    uint8x16_t offset = vdupq_n_u8(64);
+    size_t i = 0;
+    for (; i + 64 <= n; i += 64) {
+        // Look characters below 64 up in one table and 64 to 127 in the other, anything invalid gets its top bit set
+        uint8x16x4_t str = vld4q_u8(reinterpret_cast<const uint8_t*>(in) + i);
+        uint8x16_t bad = vdupq_n_u8(0);
+        for (int k = 0; k < 4; k++) {
+            uint8x16_t c = str.val[k];
+            str.val[k] = vqtbx4q_u8(vqtbl4q_u8(low, c), high, vsubq_u8(c, offset));
+            bad = vorrq_u8(bad, vorrq_u8(str.val[k], c));
+        }
+        if (vmaxvq_u8(bad) & 0x80) break;
+
+        // Pack four 6 bit values into three bytes
+        uint8x16x3_t bytes;
+        bytes.val[0] = vorrq_u8(vshlq_n_u8(str.val[0], 2), vshrq_n_u8(str.val[1], 4));
+        bytes.val[1] = vorrq_u8(vshlq_n_u8(str.val[1], 4), vshrq_n_u8(str.val[2], 2));
+        bytes.val[2] = vorrq_u8(vshlq_n_u8(str.val[2], 6), str.val[3]);
+        vst3q_u8(out + i / 4 * 3, bytes);
+    }
+    return i;
+}
+
+#endif
+
+// -----------------------------------------------------------
+// SSSE3 and AVX2, 12 bytes to 16 characters per 128 bit lane.
+// Muła and Lemire's shuffle and multiply method, the AVX2 versions just run two lanes at once.
+// -----------------------------------------------------------
+
+#ifdef BASE64_X86
+
+#define SSSE3 __attribute__((target("ssse3")))
+#define AVX2 __attribute__((target("avx2")))
+
+// Spread 12 bytes over 16 lanes of 6 bits
+SSSE3 static inline __m128i encodeSplit(__m128i in) {
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t0, t1);
+}
+
+// 6 bit values to characters, by adding an offset picked per range
+SSSE3 static inline __m128i encodeTranslate(__m128i in) {
+    __m128i range = _mm_subs_epu8(in, _mm_set1_epi8(51));
+    __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), in);
+    range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+    __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                  '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    return _mm_add_epi8(in, _mm_shuffle_epi8(shift, range));
+}
+
+SSSE3 static size_t encodeSsse3(const uint8_t* in, size_t n, char* out) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 12) {
+        __m128i chars = encodeTranslate(encodeSplit(_mm_loadu_si128((const __m128i*)(in + i))));
+        _mm_storeu_si128((__m128i*)(out + i / 3 * 4), chars);
+    }
+    return i;
+}
+
+// Characters to 6 bit values, false if any aren't base64
+SSSE3 static inline bool decodeTranslate(__m128i& str) {
+    __m128i lutLow = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    __m128i lutHigh = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m128i mask = _mm_set1_epi8(0x2F);
+    __m128i highNibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask);
+    __m128i lowNibbles = _mm_and_si128(str, mask);
+    __m128i invalid = _mm_and_si128(_mm_shuffle_epi8(lutLow, lowNibbles), _mm_shuffle_epi8(lutHigh, highNibbles));
+    if (_mm_movemask_epi8(_mm_cmpgt_epi8(invalid, _mm_setzero_si128()))) return false;
+    __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(_mm_cmpeq_epi8(str, mask), highNibbles));
+    str = _mm_add_epi8(str, roll);
+    return true;
+}
+
+// 16 lanes of 6 bits to 12 bytes at the bottom of the register
+SSSE3 static inline __m128i decodePack(__m128i values) {
+    __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    __m128i words = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(words, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+// Stores 16 bytes for every 12, so stays far enough from the end of a buffer sized for the input
+SSSE3 static size_t decodeSsse3(const char* in, size_t n, uint8_t* out) {
+    size_t i = 0;
+    for (; i + 24 <= n; i += 16) {
+        __m128i str = _mm_loadu_si128((const __m128i*)(in + i));
+        if (!decodeTranslate(str)) break;
+        _mm_storeu_si128((__m128i*)(out + i / 4 * 3), decodePack(str));
+    }
+    return i;
+}
+
+AVX2 static size_t encodeAvx2(const uint8_t* in, size_t n, char* out) {
+    __m256i shuffle = _mm256_broadcastsi128_si256(_mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    __m256i shift = _mm256_broadcastsi128_si256(_mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                              '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0));
+    size_t i = 0;
+    for (; i + 28 <= n; i += 24) {
+        // 12 bytes into each lane
+        __m256i src = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(in + i))),
+                                              _mm_loadu_si128((const __m128i*)(in + i + 12)), 1);
+        src = _mm256_shuffle_epi8(src, shuffle);
+        __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(src, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+        __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(src, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+        __m256i values = _mm256_or_si256(t0, t1);
+
+        // Translate
+        __m256i range = _mm256_subs_epu8(values, _mm256_set1_epi8(51));
+        __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), values);
+        range = _mm256_or_si256(range, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+        __m256i chars = _mm256_add_epi8(values, _mm256_shuffle_epi8(shift, range));
+        _mm256_storeu_si256((__m256i*)(out + i / 3 * 4), chars);
+    }
+    return i;
+}
+
+AVX2 static size_t decodeAvx2(const char* in, size_t n, uint8_t* out) {
+    __m256i lutLow = _mm256_broadcastsi128_si256(_mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A));
+    __m256i lutHigh = _mm256_broadcastsi128_si256(_mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10));
+    __m256i lutRoll = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0));
+    __m256i pack = _mm256_broadcastsi128_si256(_mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    __m256i mask = _mm256_set1_epi8(0x2F);
+    size_t i = 0;
+    for (; i + 40 <= n; i += 32) {
+        // Translate
+        __m256i str = _mm256_loadu_si256((const __m256i*)(in + i));
+        __m256i highNibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask);
+        __m256i lowNibbles = _mm256_and_si256(str, mask);
+        __m256i invalid = _mm256_and_si256(_mm256_shuffle_epi8(lutLow, lowNibbles), _mm256_shuffle_epi8(lutHigh, highNibbles));
+        if (_mm256_movemask_epi8(_mm256_cmpgt_epi8(invalid, _mm256_setzero_si256()))) break;
+        __m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(_mm256_cmpeq_epi8(str, mask), highNibbles));
+        str = _mm256_add_epi8(str, roll);
+
+        // Pack, each lane leaves 12 bytes at its bottom
+        __m256i pairs = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+        __m256i words = _mm256_shuffle_epi8(_mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000)), pack);
+        uint8_t* o = out + i / 4 * 3;
+        _mm_storeu_si128((__m128i*)o, _mm256_castsi256_si128(words));
+        _mm_storeu_si128((__m128i*)(o + 12), _mm256_extracti128_si256(words, 1));
+    }
+    return i;
+}
+
+#endif
+
+// -----------------------------------------------------------
+// Dispatch
+// -----------------------------------------------------------
+
+// Vector kernels do whole blocks and return how much input they used, scalar does the rest
+struct Kernels {
+    size_t (*encode)(const uint8_t*, size_t, char*);
+    size_t (*decode)(const char*, size_t, uint8_t*);
+    const char* name;
+};
+
+static size_t encodeNone(const uint8_t*, size_t, char*) { return 0; }
+static size_t decodeNone(const char*, size_t, uint8_t*) { return 0; }
+
+static Kernels pickKernels() {
+    #if defined(BASE64_NEON)
+    return { encodeNeon, decodeNeon, "neon" };
+    #elif defined(BASE64_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return { encodeAvx2, decodeAvx2, "avx2" };
+    if (__builtin_cpu_supports("ssse3")) return { encodeSsse3, decodeSsse3, "ssse3" };
+    #endif
+    return { encodeNone, decodeNone, "scalar" };
+}
+
+static const Kernels kernels = pickKernels();
+
+size_t base64EncodeTo(const uint8_t* in, size_t n, char* out) {
+    size_t done = kernels.encode(in, n, out);
+    return done / 3 * 4 + encodeScalar(in + done, n - done, out + done / 3 * 4);
+}
+
+size_t base64DecodeTo(const char* in, size_t n, uint8_t* out) {
+    // Drop padding
+    if (n % 4 == 0 && n > 0 && in[n - 1] == '=') n -= in[n - 2] == '=' ? 2 : 1;
+
+    // Whole blocks, then whatever is left or the block that had a bad character in it
+    size_t done = kernels.decode(in, n, out);
+    size_t rest = decodeScalar(in + done, n - done, out + done / 4 * 3);
+    return rest == SIZE_MAX ? SIZE_MAX : done / 4 * 3 + rest;
+}
+
+const char* base64Implementation() {
+    return kernels.name;
+}
@@ -0,0 +1,42 @@
+// Deskman robot.
+// Vectorised base64 module.
+// Thomas Jacobs
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Base64 straight between caller owned buffers, nothing allocated.
+// Uses NEON on 64 bit ARM, and on x86 picks AVX2 or SSSE3 at startup if the CPU has them,
+// with a table driven scalar path for tails and everything else.
+
+// Characters needed to encode n bytes, with padding
+inline size_t base64EncodedSize(size_t n) { return (n + 2) / 3 * 4; }
+
+// Most bytes that n characters can decode to
+inline size_t base64DecodedSize(size_t n) { return n / 4 * 3 + (n % 4 ? 3 : 0); }
+
+// Encode n bytes into out, which has room for base64EncodedSize(n), returns characters written
+size_t base64EncodeTo(const uint8_t* in, size_t n, char* out);
+
+// Decode n characters into out, which has room for base64DecodedSize(n), padding is optional.
+// Returns bytes written, or SIZE_MAX if the input isn't base64.
+size_t base64DecodeTo(const char* in, size_t n, uint8_t* out);
+
+// Encode 16 bit PCM into a reused string
+inline void base64EncodePcm(const int16_t* samples, size_t count, std::string& out) {
+    out.resize(base64EncodedSize(count * sizeof(int16_t)));
+    base64EncodeTo(reinterpret_cast<const uint8_t*>(samples), count * sizeof(int16_t), &out[0]);
+}
+
+// Decode base64 straight into 16 bit PCM, out has room for base64DecodedSize(n) / 2 + 1 samples.
+// Returns samples written, or SIZE_MAX if the input isn't base64.
+inline size_t base64DecodePcm(const char* in, size_t n, int16_t* out) {
+    size_t bytes = base64DecodeTo(in, n, reinterpret_cast<uint8_t*>(out));
+    return bytes == SIZE_MAX ? SIZE_MAX : bytes / sizeof(int16_t);
+}
+
+// Name of the vector path in use, for benchmarks and logs
+const char* base64Implementation();
@@ -0,0 +1,76 @@
+// Deskman robot.
+// Base64 microbenchmark.
+// Thomas Jacobs
+
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <iostream>
+#include "base64.hpp"
+#include "../base64_simd.h"
+
+using namespace std;
+
+// Time a function over enough repeats to take about a quarter of a second, returns MB/s of input
+template <typename F>
+static double throughput(size_t bytes, F f) {
+    int repeats = 1;
+    while (true) {
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < repeats; i++) f();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (seconds > 0.25) return bytes * (double)repeats / seconds / 1e6;
+        repeats *= 2;
+    }
+}
+
+int main() {
+    cout << "Vector path: " << base64Implementation() << endl;
+
+    // Chunk sizes seen on the socket, 20 ms and 200 ms of 24 kHz mono PCM, and a large response delta
+    mt19937 random(1);
+    for (size_t samples : {480, 4800, 48000}) {
+        vector<int16_t> pcm(samples);
+        for (auto& s : pcm) s = (int16_t)random();
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(pcm.data());
+        size_t size = samples * sizeof(int16_t);
+
+        // Check both agree before timing
+        string reference = base64Encode(bytes, size);
+        string encoded;
+        base64EncodePcm(pcm.data(), samples, encoded);
+        vector<int16_t> decoded(base64DecodedSize(encoded.size()) / 2 + 1);
+        size_t count = base64DecodePcm(encoded.data(), encoded.size(), decoded.data());
+        if (encoded != reference || count != samples || memcmp(decoded.data(), pcm.data(), size) != 0) {
+            cerr << "Mismatch at " << samples << " samples." << endl;
+            return 1;
+        }
+
+        // Old: string built with push_back, decode to a byte vector then copy to samples
+        double oldEncode = throughput(size, [&] {
+            string s = base64Encode(bytes, size);
+            asm volatile("" : : "r"(s.data()) : "memory");
+        });
+        double oldDecode = throughput(reference.size(), [&] {
+            vector<uint8_t> audioBytes = base64Decode(reference);
+            vector<int16_t> out(audioBytes.size() / 2);
+            memcpy(out.data(), audioBytes.data(), audioBytes.size());
+            asm volatile("" : : "r"(out.data()) : "memory");
+        });
+
+        // New: straight into reused buffers
+        double newEncode = throughput(size, [&] {
+            base64EncodePcm(pcm.data(), samples, encoded);
+            asm volatile("" : : "r"(encoded.data()) : "memory");
+        });
+        double newDecode = throughput(reference.size(), [&] {
+            base64DecodePcm(reference.data(), reference.size(), decoded.data());
+            asm volatile("" : : "r"(decoded.data()) : "memory");
+        });
+
+        cout << samples << " samples: encode " << (int)oldEncode << " -> " << (int)newEncode << " MB/s ("
+             << newEncode / oldEncode << "x), decode " << (int)oldDecode << " -> " << (int)newDecode << " MB/s ("
+             << newDecode / oldDecode << "x)" << endl;
+    }
+    return 0;
+}
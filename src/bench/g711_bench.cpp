@@ -0,0 +1,121 @@
+// Deskman robot.
+// G.711 benchmark.
+// Thomas Jacobs
+
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <iostream>
+#include "../g711.h"
+#include "../resampler.h"
+#include "../base64_simd.h"
+
+using namespace std;
+
+static const int API_RATE = 24000;
+static const int G711_RATE = 8000;
+
+// Uplink and downlink work in 20 ms blocks, as the robot does
+static const int BLOCK_MS = 20;
+
+// Time a function over enough repeats to take about a quarter of a second, returns seconds per call
+template <typename F>
+static double timePerCall(F f) {
+    int repeats = 1;
+    while (true) {
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < repeats; i++) f();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (seconds > 0.25) return seconds / repeats;
+        repeats *= 2;
+    }
+}
+
+// Textbook mu-law encoder with a segment search, for comparison
+static uint8_t referenceUlaw(int x) {
+    static const int SEGMENT_END[8] = { 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF, 0x3FFF, 0x7FFF };
+    int sign = x < 0 ? 0x80 : 0;
+    int m = min(x < 0 ? -x - 1 : x, 32635) + 132;
+    int seg = 0;
+    while (m > SEGMENT_END[seg]) seg++;
+    return ~(sign | seg << 4 | ((m >> (seg + 3)) & 0x0F));
+}
+
+int main() {
+    // Speech-like test signal, a few harmonics and some noise
+    mt19937 random(1);
+    normal_distribution<float> noise(0, 300);
+    vector<int16_t> pcm(API_RATE);
+    for (size_t i = 0; i < pcm.size(); i++) {
+        double t = (double)i / API_RATE;
+        pcm[i] = (int16_t)(6000 * sin(2 * M_PI * 180 * t) + 3000 * sin(2 * M_PI * 720 * t) + noise(random));
+    }
+
+    // Codec alone, at 8 kHz
+    vector<int16_t> narrow(G711_RATE), expanded(G711_RATE);
+    for (int i = 0; i < G711_RATE; i++) narrow[i] = pcm[i * 3];
+    vector<uint8_t> codes(G711_RATE);
+    double reference = timePerCall([&] {
+        for (int i = 0; i < G711_RATE; i++) codes[i] = referenceUlaw(narrow[i]);
+        asm volatile("" : : "r"(codes.data()) : "memory");
+    });
+    double ulawEncode = timePerCall([&] {
+        g711EncodeUlaw(narrow.data(), narrow.size(), codes.data());
+        asm volatile("" : : "r"(codes.data()) : "memory");
+    });
+    double alawEncode = timePerCall([&] {
+        g711EncodeAlaw(narrow.data(), narrow.size(), codes.data());
+        asm volatile("" : : "r"(codes.data()) : "memory");
+    });
+    double ulawDecode = timePerCall([&] {
+        g711DecodeUlaw(codes.data(), codes.size(), expanded.data());
+        asm volatile("" : : "r"(expanded.data()) : "memory");
+    });
+    cout << "Per second of 8 kHz audio: mu-law encode " << ulawEncode * 1e6 << " us (textbook " << reference * 1e6
+         << " us), A-law encode " << alawEncode * 1e6 << " us, decode " << ulawDecode * 1e6 << " us" << endl;
+
+    // Whole path per second of audio, in 20 ms blocks, pcm16 is base64 alone
+    size_t block = API_RATE * BLOCK_MS / 1000;
+    string text;
+    vector<uint8_t> bytes(base64DecodedSize(base64EncodedSize(block * 2)));
+    vector<int16_t> samples(block + 1);
+    double pcmUp = timePerCall([&] {
+        for (size_t at = 0; at + block <= pcm.size(); at += block) base64EncodePcm(pcm.data() + at, block, text);
+    });
+    size_t pcmChars = text.size() * (1000 / BLOCK_MS);
+    double pcmDown = timePerCall([&] {
+        for (size_t at = 0; at + block <= pcm.size(); at += block) base64DecodePcm(text.data(), text.size(), samples.data());
+    });
+
+    // G.711 resamples and encodes on the way up, expands and resamples on the way down
+    Resampler down(API_RATE, G711_RATE), up(G711_RATE, API_RATE);
+    vector<float> floats(down.maxOutput(block) + up.maxOutput(block));
+    vector<int16_t> narrowBlock(block);
+    double g711Up = timePerCall([&] {
+        for (size_t at = 0; at + block <= pcm.size(); at += block) {
+            size_t n = down.process(pcm.data() + at, block, floats.data());
+            floatToInt16(floats.data(), narrowBlock.data(), n);
+            g711EncodeUlaw(narrowBlock.data(), n, bytes.data());
+            text.resize(base64EncodedSize(n));
+            base64EncodeTo(bytes.data(), n, &text[0]);
+        }
+    });
+    size_t g711Chars = text.size() * (1000 / BLOCK_MS);
+    double g711Down = timePerCall([&] {
+        for (size_t at = 0; at + block <= pcm.size(); at += block) {
+            size_t n = base64DecodeTo(text.data(), text.size(), bytes.data());
+            g711DecodeUlaw(bytes.data(), n, narrowBlock.data());
+            size_t m = up.process(narrowBlock.data(), n, floats.data());
+            floatToInt16(floats.data(), samples.data(), m);
+        }
+    });
+
+    cout << fixed << setprecision(4);
+    cout << "pcm16:     " << pcmChars / 1000.0 << " KB/s each way, up " << pcmUp * 100 << "% of a core, down " << pcmDown * 100 << "%" << endl;
+    cout << "g711_ulaw: " << g711Chars / 1000.0 << " KB/s each way, up " << g711Up * 100 << "% of a core, down " << g711Down * 100 << "%" << endl;
+    cout << "Bandwidth " << (double)pcmChars / g711Chars << "x lower" << endl;
+    return 0;
+}
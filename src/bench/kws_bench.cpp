@@ -0,0 +1,165 @@
+// Deskman robot.
+// Wake word benchmark.
+// Thomas Jacobs
+
+#include <cmath>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include "../kws.h"
+#include "../resampler.h"
+#include "pv_porcupine.h"
+
+using namespace std;
+
+static const int RATE = KeywordSpotter::SAMPLE_RATE;
+
+// A detection counts for a label from a little before the keyword ends to this long after
+static const double EARLY_S = 0.5;
+static const double LATE_S = 1.5;
+
+// 16 bit PCM WAV, first channel only, resampled to 16 kHz
+static bool loadWav(const string& path, vector<int16_t>& audio) {
+    ifstream file(path, ios::binary);
+    vector<char> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    if (bytes.size() < 12 || memcmp(bytes.data(), "RIFF", 4) != 0 || memcmp(bytes.data() + 8, "WAVE", 4) != 0) {
+        cerr << "Not a WAV file: " << path << endl;
+        return false;
+    }
+    int channels = 0, rate = 0, bits = 0;
+    for (size_t at = 12; at + 8 <= bytes.size(); ) {
+        uint32_t size;
+        memcpy(&size, &bytes[at + 4], 4);
+        const char* body = &bytes[at + 8];
+        if (memcmp(&bytes[at], "fmt ", 4) == 0 && size >= 16) {
+            uint16_t format, channelCount, bitsPerSample;
+            uint32_t sampleRate;
+            memcpy(&format, body, 2);
+            memcpy(&channelCount, body + 2, 2);
+            memcpy(&sampleRate, body + 4, 4);
+            memcpy(&bitsPerSample, body + 14, 2);
+            channels = channelCount;
+            rate = sampleRate;
+            bits = format == 1 ? bitsPerSample : 0;
+        }
+        else if (memcmp(&bytes[at], "data", 4) == 0 && bits == 16 && channels > 0) {
+            size = min<size_t>(size, bytes.size() - at - 8);
+            size_t frames = size / (2 * channels);
+            vector<int16_t> samples(frames);
+            for (size_t i = 0; i < frames; i++) memcpy(&samples[i], body + i * 2 * channels, 2);
+            if (rate == RATE) {
+                audio = move(samples);
+                return true;
+            }
+            Resampler resampler(rate, RATE);
+            vector<float> out(resampler.maxOutput(frames));
+            size_t n = resampler.process(samples.data(), frames, out.data());
+            audio.resize(n);
+            floatToInt16(out.data(), audio.data(), n);
+            return true;
+        }
+        at += 8 + size + (size & 1);
+    }
+    cerr << "Need 16 bit PCM audio: " << path << endl;
+    return false;
+}
+
+// Keyword end times in seconds, one per line
+static vector<double> loadLabels(const string& path) {
+    vector<double> labels;
+    ifstream file(path);
+    double t;
+    while (file >> t) labels.push_back(t);
+    sort(labels.begin(), labels.end());
+    return labels;
+}
+
+// Feed the whole recording a frame at a time, returns detection times and CPU seconds
+template <typename F>
+static vector<double> run(const vector<int16_t>& audio, int frameLength, F process, double& cpuSeconds) {
+    vector<double> detections;
+    clock_t start = clock();
+    for (size_t at = 0; at + frameLength <= audio.size(); at += frameLength) {
+        if (process(&audio[at])) detections.push_back((double)(at + frameLength) / RATE);
+    }
+    cpuSeconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    return detections;
+}
+
+// Match detections to labels and print CPU, latency, misses and false alarms
+static void report(const string& name, const vector<double>& detections, const vector<double>& labels, double cpuSeconds, double audioSeconds) {
+    vector<double> latencies;
+    vector<bool> used(detections.size(), false);
+    for (double label : labels) {
+        for (size_t i = 0; i < detections.size(); i++) {
+            if (used[i] || detections[i] < label - EARLY_S || detections[i] > label + LATE_S) continue;
+            used[i] = true;
+            latencies.push_back((detections[i] - label) * 1000);
+            break;
+        }
+    }
+    size_t falseAlarms = count(used.begin(), used.end(), false);
+    sort(latencies.begin(), latencies.end());
+    auto at = [&](double p) { return latencies.empty() ? 0.0 : latencies[min(latencies.size() - 1, (size_t)ceil(p * latencies.size()) - 1)]; };
+
+    cout << left << setw(11) << name << right << fixed << setprecision(2)
+         << "CPU " << setw(6) << cpuSeconds / audioSeconds * 100 << "% of a core"
+         << "   hits " << latencies.size() << "/" << labels.size()
+         << "   latency p50 " << setw(7) << at(0.50) << " p95 " << setw(7) << at(0.95) << " ms"
+         << "   false alarms " << falseAlarms << " (" << falseAlarms * 3600 / audioSeconds << "/h)" << endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        cerr << "Usage: kws_bench recording.wav keyword_ends.txt [kws.gguf] [keyword.ppn]" << endl;
+        cerr << "Porcupine runs too when PICOVOICE_KEY is set." << endl;
+        return 1;
+    }
+    vector<int16_t> audio;
+    if (!loadWav(argv[1], audio)) return 1;
+    vector<double> labels = loadLabels(argv[2]);
+    double audioSeconds = (double)audio.size() / RATE;
+    cout << audioSeconds << " s of audio, " << labels.size() << " keywords" << endl;
+
+    // Built-in spotter, at each network stride
+    string model = argc > 3 ? argv[3] : "../wakeword/kws.gguf";
+    for (int stride : { 1, 2, 4 }) {
+        KeywordSpotter spotter;
+        if (!spotter.load(model)) return 1;
+        spotter.setStride(stride);
+        double cpu;
+        vector<double> detections = run(audio, spotter.frameLength(), [&](const int16_t* frame) { return spotter.process(frame); }, cpu);
+        report("kws/" + to_string(stride * 20) + "ms", detections, labels, cpu, audioSeconds);
+    }
+
+    // Porcupine on the same audio
+    const char* key = getenv("PICOVOICE_KEY");
+    if (!key) return 0;
+    #ifdef __linux__
+        string keyword = argc > 4 ? argv[4] : "../wakeword/hey_robot_pi.ppn";
+    #else
+        string keyword = argc > 4 ? argv[4] : "../wakeword/computer_mac.ppn";
+    #endif
+    const char* keywordPaths[] = { keyword.c_str() };
+    float sensitivities[] = { 0.5f };
+    pv_porcupine_t* porcupine = nullptr;
+    pv_status_t status = pv_porcupine_init(key, "../wakeword/porcupine_params.pv", 1, keywordPaths, sensitivities, &porcupine);
+    if (status != PV_STATUS_SUCCESS) {
+        cerr << "Failed to init Porcupine: " << pv_status_to_string(status) << endl;
+        return 1;
+    }
+    double cpu;
+    vector<double> detections = run(audio, pv_porcupine_frame_length(), [&](const int16_t* frame) {
+        int32_t index = -1;
+        return pv_porcupine_process(porcupine, frame, &index) == PV_STATUS_SUCCESS && index >= 0;
+    }, cpu);
+    report("porcupine", detections, labels, cpu, audioSeconds);
+    pv_porcupine_delete(porcupine);
+    return 0;
+}
@@ -0,0 +1,42 @@
+// Deskman robot.
+// Mock realtime server.
+// Thomas Jacobs
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <cstdlib>
+#include <iostream>
+#include "mock_realtime_server.h"
+
+using namespace std;
+
+// Run the mock on its own, then point the robot at it with REALTIME_URL=ws://127.0.0.1:<port>
+int main(int argc, char** argv) {
+    int port = 8765;
+    double pace = 1.0;
+    string trace;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string arg = argv[i];
+        if (arg == "--port") port = atoi(argv[i + 1]);
+        else if (arg == "--pace") pace = atof(argv[i + 1]);
+        else if (arg == "--trace") trace = argv[i + 1];
+        else {
+            cerr << "Usage: mock_realtime [--port n] [--pace x] [--trace file.jsonl]" << endl;
+            return 1;
+        }
+    }
+
+    // Recorded responses, or a tone if there are none
+    MockRealtimeServer server(port, pace);
+    if (!trace.empty()) {
+        if (!server.loadTrace(trace)) return 1;
+    } else {
+        server.synthesize(300, 2000, 100, 50);
+    }
+    if (!server.start()) return 1;
+    cout << "Mock realtime server on ws://127.0.0.1:" << port << " with " << server.responseCount() << " responses, pace " << pace << endl;
+
+    // Until killed
+    while (true) this_thread::sleep_for(chrono::seconds(1));
+}
@@ -0,0 +1,227 @@
+// Deskman robot.
+// Mock realtime server module.
+// Thomas Jacobs
+
+#include "mock_realtime_server.h"
+#include <new>
+#include <cmath>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include "../base64_simd.h"
+#include "../event_scanner.h"
+
+// Logging
+#define DEBUG 0
+
+using namespace std;
+using namespace nlohmann;
+
+static const int SAMPLE_RATE = 24000;
+
+static int64_t nowUs() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+MockRealtimeServer::MockRealtimeServer(int port_, double pace_) : port(port_), pace(pace_) { }
+
+MockRealtimeServer::~MockRealtimeServer() {
+    stop();
+}
+
+bool MockRealtimeServer::loadTrace(const string& path) {
+    ifstream file(path);
+    if (!file) {
+        cerr << "Cannot open trace " << path << "." << endl;
+        return false;
+    }
+
+    // One event per line, the session handshake is ours to answer so it isn't replayed
+    responses.clear();
+    string line;
+    while (getline(file, line)) {
+        auto j = json::parse(line, nullptr, false);
+        if (j.is_discarded() || !j.contains("event")) continue;
+        string type = j["event"].value("type", "");
+        if (type.rfind("session.", 0) == 0) continue;
+        if (type == "response.created") responses.emplace_back();
+        if (responses.empty()) continue;
+        responses.back().push_back({ (int64_t)(j.value("t", 0.0) * 1000), j["event"].dump() });
+    }
+    if (responses.empty()) {
+        cerr << "No responses in trace " << path << "." << endl;
+        return false;
+    }
+    return true;
+}
+
+void MockRealtimeServer::synthesize(int thinkMs, int audioMs, int deltaMs, int intervalMs) {
+    responses.assign(1, Response());
+    Response& response = responses[0];
+    response.push_back({ 0, R"({"type":"response.created","response":{"id":"resp_mock","status":"in_progress"}})" });
+
+    // A tone in deltas, each with a word of transcript
+    vector<int16_t> samples(SAMPLE_RATE * deltaMs / 1000);
+    string audio;
+    int64_t offset = thinkMs * 1000LL;
+    int64_t phase = 0;
+    for (int sent = 0; sent < audioMs; sent += deltaMs) {
+        for (auto& s : samples) s = (int16_t)(8000 * sin(2 * M_PI * 440 * phase++ / SAMPLE_RATE));
+        base64EncodePcm(samples.data(), samples.size(), audio);
+        response.push_back({ offset, R"({"type":"response.audio.delta","response_id":"resp_mock","delta":")" + audio + "\"}" });
+        response.push_back({ offset, R"({"type":"response.audio_transcript.delta","response_id":"resp_mock","delta":"la "})" });
+        offset += intervalMs * 1000LL;
+    }
+
+    // A tool call, then done
+    response.push_back({ offset, R"({"type":"response.audio.done","response_id":"resp_mock"})" });
+    response.push_back({ offset, R"({"type":"response.function_call_arguments.done","response_id":"resp_mock","name":"move_head","arguments":"{\"direction\":\"Left\"}"})" });
+    response.push_back({ offset, R"({"type":"response.done","response":{"id":"resp_mock","status":"completed"}})" });
+}
+
+bool MockRealtimeServer::start() {
+    // Context
+    struct lws_context_creation_info info;
+    memset(&info, 0, sizeof info);
+    lws_set_log_level(LLL_ERR | LLL_WARN, NULL);
+    info.port = port;
+    info.iface = "127.0.0.1";
+    info.protocols = protocols;
+    info.user = this;
+    info.gid = -1;
+    info.uid = -1;
+    context = lws_create_context(&info);
+    if (!context) {
+        cerr << "Failed to create mock server on port " << port << "." << endl;
+        return false;
+    }
+
+    // Serve
+    stopRequested = false;
+    serviceThread = thread([this] {
+        while (!stopRequested) lws_service(context, 50);
+    });
+    return true;
+}
+
+void MockRealtimeServer::stop() {
+    if (!context) return;
+    stopRequested = true;
+    lws_cancel_service(context);
+    if (serviceThread.joinable()) serviceThread.join();
+    lws_context_destroy(context);
+    context = nullptr;
+}
+
+// Answer what the client sends, only the types that need answering
+void MockRealtimeServer::onMessage(Session& session, const char* data, size_t size) {
+    EventScanner scanner;
+    if (!scanner.scan(data, size)) {
+        send(session, R"({"type":"error","error":{"type":"invalid_request_error","message":"Bad JSON"}})");
+        return;
+    }
+    string_view type = scanner.string("type");
+    if (type == "session.update") {
+        const EventScanner::Field* config = scanner.find("session");
+        send(session, "{\"type\":\"session.updated\",\"session\":" + string(config ? config->value : "{}") + "}");
+    }
+    else if (type == "input_audio_buffer.commit") {
+        send(session, R"({"type":"input_audio_buffer.committed"})");
+    }
+    else if (type == "response.create") {
+        if (responses.empty()) {
+            send(session, R"({"type":"error","error":{"type":"server_error","message":"No responses loaded"}})");
+            return;
+        }
+        lws_sul_cancel(&session.sul);
+        session.replaying = &responses[nextResponse++ % responses.size()];
+        session.nextEvent = 0;
+        session.replayStartUs = nowUs();
+        scheduleNext(session);
+    }
+    else if (type == "response.cancel") {
+        lws_sul_cancel(&session.sul);
+        session.replaying = nullptr;
+    }
+    else if (DEBUG && type != "input_audio_buffer.append") {
+        cout << "Mock got: " << type << endl;
+    }
+}
+
+void MockRealtimeServer::send(Session& session, const string& json) {
+    session.queue.push_back(string(LWS_PRE, '\0') + json);
+    lws_callback_on_writable(session.wsi);
+}
+
+// Queue every event that is due and come back for the next
+void MockRealtimeServer::scheduleNext(Session& session) {
+    const Response& response = *session.replaying;
+    int64_t elapsed = nowUs() - session.replayStartUs;
+    while (session.nextEvent < response.size()) {
+        const Event& event = response[session.nextEvent];
+        int64_t due = (int64_t)(event.offsetUs * pace);
+        if (due > elapsed) {
+            lws_sul_schedule(context, 0, &session.sul, onReplayTimer, due - elapsed);
+            return;
+        }
+        send(session, event.text);
+        session.nextEvent++;
+    }
+    session.replaying = nullptr;
+}
+
+void MockRealtimeServer::onReplayTimer(lws_sorted_usec_list_t* sul) {
+    Session* session = reinterpret_cast<Session*>(sul);
+    if (session->replaying) session->server->scheduleNext(*session);
+}
+
+int MockRealtimeServer::callback(struct lws* wsi, enum lws_callback_reasons reason, void* user, void* in, size_t len) {
+    auto* session = reinterpret_cast<Session*>(user);
+    auto* server = reinterpret_cast<MockRealtimeServer*>(lws_context_user(lws_get_context(wsi)));
+    switch (reason) {
+        case LWS_CALLBACK_ESTABLISHED:
+            // lws zeroes the per session data, build the session in it
+            new (session) Session();
+            session->server = server;
+            session->wsi = wsi;
+            server->send(*session, "{\"type\":\"session.created\",\"session\":{\"id\":\"sess_mock_" + to_string(++server->sessionCount) + "\",\"model\":\"mock\"}}");
+            break;
+        case LWS_CALLBACK_RECEIVE:
+            if (in && len > 0) session->rxMessage.append((char*)in, len);
+            if (lws_is_final_fragment(wsi) && lws_remaining_packet_payload(wsi) == 0) {
+                server->onMessage(*session, session->rxMessage.data(), session->rxMessage.size());
+                session->rxMessage.clear();
+            }
+            break;
+        case LWS_CALLBACK_SERVER_WRITEABLE:
+            // One message per callback
+            if (!session->queue.empty()) {
+                string& message = session->queue.front();
+                size_t length = message.size() - LWS_PRE;
+                if (lws_write(wsi, (unsigned char*)message.data() + LWS_PRE, length, LWS_WRITE_TEXT) < (int)length) return -1;
+                session->queue.pop_front();
+                if (!session->queue.empty()) lws_callback_on_writable(wsi);
+            }
+            break;
+        case LWS_CALLBACK_CLOSED:
+            lws_sul_cancel(&session->sul);
+            session->~Session();
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
+
+// Any upgrade without a subprotocol lands on the first one
+struct lws_protocols MockRealtimeServer::protocols[] = {
+    {
+        "realtime-protocol",
+        callback,
+        sizeof(Session),  // Per-session data size
+        100*1024,         // Receive buffer size
+    },
+    { nullptr, nullptr, 0, 0 }
+};
@@ -0,0 +1,72 @@
+// Deskman robot.
+// Mock realtime server module.
+// Thomas Jacobs
+
+#pragma once
+
+#include <deque>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <libwebsockets.h>
+
+// Local stand-in for the realtime API endpoint. It answers the session handshake itself, and on each
+// response.create replays the next response from a recorded trace, one event at a time at the recorded
+// offsets scaled by the pace, so the real client can be measured without going near the network.
+class MockRealtimeServer {
+public:
+    // An event and when it is due after the response.create that asked for it
+    struct Event {
+        int64_t offsetUs;
+        std::string text;
+    };
+    typedef std::vector<Event> Response;
+
+    // Pace 1 keeps the recorded timing, 0 sends everything as fast as the socket takes it
+    MockRealtimeServer(int port, double pace);
+    ~MockRealtimeServer();
+
+    // Responses from a trace written by OpenAIClient::recordTrace, each starts at a response.created
+    bool loadTrace(const std::string& path);
+
+    // A made up response instead, the first delta after thinkMs then deltas of deltaMs of audio every intervalMs
+    void synthesize(int thinkMs, int audioMs, int deltaMs, int intervalMs);
+
+    // Listen and serve on a thread of its own
+    bool start();
+    void stop();
+
+    size_t responseCount() const { return responses.size(); }
+
+private:
+    // One client connection
+    struct Session {
+        lws_sorted_usec_list_t sul;   // First, lws hands this back to the timer callback
+        MockRealtimeServer* server;
+        struct lws* wsi;
+        std::deque<std::string> queue;   // LWS_PRE bytes then the JSON
+        std::string rxMessage;
+        const Response* replaying = nullptr;
+        size_t nextEvent = 0;
+        int64_t replayStartUs = 0;
+    };
+
+    void onMessage(Session& session, const char* data, size_t size);
+    void send(Session& session, const std::string& json);
+    void scheduleNext(Session& session);
+    static void onReplayTimer(lws_sorted_usec_list_t* sul);
+    static int callback(struct lws* wsi, enum lws_callback_reasons reason, void* user, void* in, size_t len);
+
+    static struct lws_protocols protocols[];
+    struct lws_context* context = nullptr;
+    std::thread serviceThread;
+    std::atomic<bool> stopRequested{false};
+
+    int port;
+    double pace;
+    std::vector<Response> responses;
+    size_t nextResponse = 0;
+    int sessionCount = 0;
+};
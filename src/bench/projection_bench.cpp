@@ -0,0 +1,89 @@
+// Deskman robot.
+// Projection benchmark.
+// Thomas Jacobs
+
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include "../vector_renderer.h"
+
+using namespace std;
+
+// Defined by screen.cpp in the robot, the projection centres on them
+int screen_width = 800;
+int screen_height = 480;
+
+// About as many vertices as the face's frame mesh has
+static const int POINTS = 4096;
+
+// Time a function over enough repeats to take about a quarter of a second, returns seconds per call
+template <typename F>
+static double timePerCall(F f) {
+    int repeats = 1;
+    while (true) {
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < repeats; i++) f();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (seconds > 0.25) return seconds / repeats;
+        repeats *= 2;
+    }
+}
+
+int main() {
+    // Points over the face, in its plane and a little in front of and behind it
+    mt19937 random(1);
+    uniform_real_distribution<float> across(-300, 300), depth(-50, 50);
+    vector<float> x(POINTS), y(POINTS), z(POINTS);
+    for (int i = 0; i < POINTS; i++) {
+        x[i] = across(random);
+        y[i] = across(random) * 0.6f;
+        z[i] = depth(random);
+    }
+    Vec3 rotation(8, -15, 3);
+
+    // Per point, rotating about each axis in turn as shapes used to
+    vector<SDL_Point> points(POINTS);
+    vector<SDL_FPoint> fpoints(POINTS);
+    double perPoint = timePerCall([&] {
+        for (int i = 0; i < POINTS; i++) points[i] = Projection::project(Vec3(x[i], y[i], z[i]), rotation);
+        asm volatile("" : : "r"(points.data()) : "memory");
+    });
+    for (int i = 0; i < POINTS; i++) fpoints[i] = Projection::projectF(Vec3(x[i], y[i], z[i]), rotation);
+
+    // One matrix a frame, points in batches
+    vector<int> ix(POINTS), iy(POINTS);
+    vector<float> fx(POINTS), fy(POINTS);
+    double batch = timePerCall([&] {
+        Projection::Matrix matrix(rotation);
+        matrix.project(x.data(), y.data(), z.data(), POINTS, ix.data(), iy.data());
+        asm volatile("" : : "r"(ix.data()), "r"(iy.data()) : "memory");
+    });
+    double batchPlane = timePerCall([&] {
+        Projection::Matrix matrix(rotation);
+        matrix.project(x.data(), y.data(), nullptr, POINTS, fx.data(), fy.data());
+        asm volatile("" : : "r"(fx.data()), "r"(fy.data()) : "memory");
+    });
+
+    // Same answers, to float rounding, and pixels only differ where that rounding crosses a whole pixel
+    Projection::Matrix matrix(rotation);
+    matrix.project(x.data(), y.data(), z.data(), POINTS, fx.data(), fy.data());
+    matrix.project(x.data(), y.data(), z.data(), POINTS, ix.data(), iy.data());
+    float maxError = 0;
+    int pixelsOff = 0;
+    for (int i = 0; i < POINTS; i++) {
+        maxError = max({ maxError, fabsf(fx[i] - fpoints[i].x), fabsf(fy[i] - fpoints[i].y) });
+        if (ix[i] != points[i].x || iy[i] != points[i].y) pixelsOff++;
+    }
+
+    cout << fixed << setprecision(2)
+         << POINTS << " points: per point " << perPoint * 1e9 / POINTS << " ns/point"
+         << ", matrix " << batch * 1e9 / POINTS << " ns/point (" << perPoint / batch << "x)"
+         << ", in the face plane " << batchPlane * 1e9 / POINTS << " ns/point" << endl;
+    cout << setprecision(5) << "Largest difference " << maxError << " px, "
+         << pixelsOff << " of " << POINTS << " whole pixel points differ" << endl;
+    return maxError < 0.01f ? 0 : 1;
+}
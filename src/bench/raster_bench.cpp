@@ -0,0 +1,107 @@
+// Deskman robot.
+// Rasterizer benchmark.
+// Thomas Jacobs
+
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <iostream>
+#include "../rasterizer.h"
+#include "../framebuffer.h"
+#include "../vector_renderer.h"
+
+using namespace std;
+
+// Defined by screen.cpp in the robot, the projection centres on them
+int screen_width;
+int screen_height;
+
+// Time a function over enough repeats to take about a quarter of a second, returns seconds per call
+template <typename F>
+static double timePerCall(F f) {
+    int repeats = 1;
+    while (true) {
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < repeats; i++) f();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (seconds > 0.25) return seconds / repeats;
+        repeats *= 2;
+    }
+}
+
+// How much of the frame is dark, in pixels, over white
+static double darkArea(const uint32_t* pixels, int width, int height, int stride) {
+    double area = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) area += (255 - (pixels[(size_t)y * stride + x] & 0xFF)) / 255.0;
+    }
+    return area;
+}
+
+int main(int argc, char** argv) {
+    MemoryFramebuffer framebuffer(800, 480);
+    screen_width = framebuffer.width;
+    screen_height = framebuffer.height;
+    Rasterizer rasterizer;
+    bool ok = true;
+
+    // Half transparent black fan over white, pixels covered twice where triangles meet would be darker
+    Mesh fan;
+    SDL_Color grey = { 0, 0, 0, 128 };
+    int centre = fan.add({ 400.3f, 240.7f }, grey);
+    for (int i = 0; i < 37; i++) {
+        float angle = 2 * M_PI * i / 37;
+        fan.add({ 400.3f + 150.2f * cosf(angle), 240.7f + 120.9f * sinf(angle) }, grey);
+    }
+    for (int i = 0; i < 37; i++) fan.triangle(centre, centre + 1 + i, centre + 1 + (i + 1) % 37);
+    rasterizer.setTarget(framebuffer.back(), framebuffer.width, framebuffer.height, framebuffer.stride);
+    rasterizer.clear({ 255, 255, 255, 255 });
+    rasterizer.draw(fan);
+    int seams = 0;
+    for (size_t i = 0; i < (size_t)framebuffer.width * framebuffer.height; i++) {
+        uint32_t blue = framebuffer.back()[i] & 0xFF;
+        if (blue != 255 && blue != 127) seams++;
+    }
+    cout << "Seams in a fan " << seams << (seams ? ", FAILED" : "") << endl;
+    ok = ok && seams == 0;
+
+    // An eye's coverage against its exact area
+    VectorRenderer eye;
+    Ellipse* ellipse = new Ellipse(45, 120, { 0, 0, 0, 255 }, { 0, 0, 0, 255 }, 0.0f);
+    eye.addShape(ellipse);
+    eye.update();
+    rasterizer.clear({ 255, 255, 255, 255 });
+    rasterizer.draw(eye.frame());
+    double area = darkArea(framebuffer.back(), framebuffer.width, framebuffer.height, framebuffer.stride);
+    double exact = M_PI * 45 * 120;
+    cout << fixed << setprecision(1) << "Eye covers " << area << " pixels, exactly " << exact << endl;
+    ok = ok && fabs(area - exact) < exact * 0.01;
+
+    // The face as face.cpp builds it, eyes and the mouth wide open
+    VectorRenderer face;
+    Ellipse* leftEye = new Ellipse(45, 120, { 25, 25, 25, 255 }, { 255, 255, 255, 255 }, 0.0f);
+    leftEye->localPosition = Vec3(-120, -100, 0);
+    Ellipse* rightEye = new Ellipse(45, 120, { 25, 25, 25, 255 }, { 255, 255, 255, 255 }, 0.0f);
+    rightEye->localPosition = Vec3(120, -100, 0);
+    Ellipse* mouth = new Ellipse(95, 45, { 25, 25, 25, 255 }, { 255, 255, 255, 255 }, 0.0f);
+    mouth->localPosition = Vec3(0, 200, 0);
+    face.addShape(leftEye);
+    face.addShape(rightEye);
+    face.addShape(mouth);
+    face.setFaceRotation(Vec3(5, -10, 0));
+    face.update();
+    double perFrame = timePerCall([&] {
+        rasterizer.setTarget(framebuffer.back(), framebuffer.width, framebuffer.height, framebuffer.stride);
+        rasterizer.clear({ 255, 255, 255, 255 });
+        rasterizer.draw(face.frame());
+        framebuffer.flip();
+    });
+    cout << "Face at " << framebuffer.width << "x" << framebuffer.height << ", " << face.frame().indices.size() / 3 << " triangles: "
+         << setprecision(3) << perFrame * 1000 << " ms a frame" << endl;
+
+    // Look at it
+    if (argc > 1) framebuffer.save(argv[1]);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,179 @@
+// Deskman robot.
+// Realtime latency benchmark.
+// Thomas Jacobs
+
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include "mock_realtime_server.h"
+#include "../openai_client.h"
+#include "../audio_playback.h"
+
+using namespace std;
+using namespace nlohmann;
+
+// Playback the way the robot runs it
+static const int PLAYBACK_PERIOD = OpenAIClient::SAMPLE_RATE / 50;
+static const int PLAYBACK_QUEUE_MS = 60000;
+
+// Each turn sends this much audio before asking for a response
+static const int TURN_AUDIO_MS = 1000;
+static const int TURN_TIMEOUT_MS = 30000;
+
+static double msSince(int64_t startNs, int64_t endNs) {
+    return (endNs - startNs) / 1e6;
+}
+
+// Nearest rank percentiles
+static void report(const string& name, vector<double> ms) {
+    if (ms.empty()) {
+        cout << left << setw(20) << name << "no samples" << endl;
+        return;
+    }
+    sort(ms.begin(), ms.end());
+    auto at = [&](double p) { return ms[min(ms.size() - 1, (size_t)ceil(p * ms.size()) - 1)]; };
+    cout << left << setw(20) << name << right << fixed << setprecision(2)
+         << "n " << setw(4) << ms.size()
+         << "   p50 " << setw(8) << at(0.50)
+         << "   p95 " << setw(8) << at(0.95)
+         << "   p99 " << setw(8) << at(0.99) << " ms" << endl;
+}
+
+// A client pointed at the mock, with the service thread running
+struct BenchClient {
+    BenchClient(int port) : client("mock", "mock", json{ {"modalities", {"audio", "text"}} }, endpoint(port)) { }
+
+    static RealtimeEndpoint endpoint(int port) {
+        RealtimeEndpoint endpoint;
+        endpoint.parse("ws://127.0.0.1:" + to_string(port));
+        return endpoint;
+    }
+
+    bool start() {
+        if (!client.start()) return false;
+        serviceThread = thread([this] { client.serviceLoop(); });
+        return true;
+    }
+
+    ~BenchClient() {
+        client.close();
+        if (serviceThread.joinable()) serviceThread.join();
+    }
+
+    OpenAIClient client;
+    thread serviceThread;
+};
+
+int main(int argc, char** argv) {
+    int port = 8765;
+    double pace = 1.0;
+    int connects = 10;
+    int turns = 20;
+    string trace;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string arg = argv[i];
+        if (arg == "--port") port = atoi(argv[i + 1]);
+        else if (arg == "--pace") pace = atof(argv[i + 1]);
+        else if (arg == "--connects") connects = atoi(argv[i + 1]);
+        else if (arg == "--turns") turns = atoi(argv[i + 1]);
+        else if (arg == "--trace") trace = argv[i + 1];
+        else {
+            cerr << "Usage: realtime_bench [--port n] [--pace x] [--connects n] [--turns n] [--trace file.jsonl]" << endl;
+            return 1;
+        }
+    }
+
+    // Mock server
+    MockRealtimeServer server(port, pace);
+    if (!trace.empty()) {
+        if (!server.loadTrace(trace)) return 1;
+    } else {
+        server.synthesize(300, 2000, 100, 50);
+    }
+    if (!server.start()) return 1;
+
+    // Connect, from start until a configured session is ready
+    vector<double> connectMs;
+    for (int i = 0; i < connects; i++) {
+        BenchClient bench(port);
+        int64_t start = monotonicNs();
+        if (!bench.start()) return 1;
+        if (!bench.client.waitReady(5000)) {
+            cerr << "No session after 5 s." << endl;
+            continue;
+        }
+        connectMs.push_back(msSince(start, monotonicNs()));
+    }
+
+    // Turns through the real client and playback engine, with a sink in place of the sound card
+    AudioPlayback playback(OpenAIClient::SAMPLE_RATE, PLAYBACK_QUEUE_MS);
+    atomic<int64_t> requestNs{0}, firstDeltaNs{0}, firstSoundNs{0};
+    atomic<bool> done{false};
+    playback.setSink([&](const int16_t*, size_t) {
+        int64_t expected = 0;
+        if (firstDeltaNs) firstSoundNs.compare_exchange_strong(expected, monotonicNs());
+    });
+    BenchClient bench(port);
+    OpenAIClient::Handlers handlers;
+    handlers.audio = [&](const int16_t* samples, size_t count) {
+        int64_t expected = 0;
+        firstDeltaNs.compare_exchange_strong(expected, monotonicNs());
+        playback.push(samples, count);
+    };
+    handlers.audioDone = [&] { playback.endStream(); };
+    handlers.responseDone = [&] { done = true; };
+    bench.client.setHandlers(handlers);
+    if (!playback.start(PLAYBACK_PERIOD) || !bench.start() || !bench.client.waitReady(5000)) {
+        cerr << "Failed to start the client." << endl;
+        return 1;
+    }
+
+    // A tone to stand in for the user
+    vector<int16_t> speech(OpenAIClient::SAMPLE_RATE * TURN_AUDIO_MS / 1000);
+    for (size_t i = 0; i < speech.size(); i++) speech[i] = (int16_t)(4000 * sin(2 * M_PI * 200 * i / OpenAIClient::SAMPLE_RATE));
+
+    vector<double> firstDeltaMs, audioToSpeakerMs;
+    for (int turn = 0; turn < turns; turn++) {
+        firstDeltaNs = 0;
+        firstSoundNs = 0;
+        done = false;
+
+        // Speak in 20 ms chunks, then commit and ask for a response
+        for (size_t at = 0; at < speech.size(); at += PLAYBACK_PERIOD) {
+            bench.client.sendAudio(speech.data() + at, min<size_t>(PLAYBACK_PERIOD, speech.size() - at));
+        }
+        bench.client.sendEvent(json{ {"type", "input_audio_buffer.commit"} });
+        requestNs = monotonicNs();
+        bench.client.sendEvent(json{ {"type", "response.create"} });
+
+        // Until the response is done and played out
+        int64_t deadline = requestNs + TURN_TIMEOUT_MS * 1000000LL;
+        while ((!done || playback.queuedFrames() > 0) && monotonicNs() < deadline) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        if (!done) {
+            cerr << "Turn " << turn << " timed out." << endl;
+            continue;
+        }
+        if (firstDeltaNs) firstDeltaMs.push_back(msSince(requestNs, firstDeltaNs));
+        if (firstSoundNs) audioToSpeakerMs.push_back(msSince(firstDeltaNs, firstSoundNs));
+    }
+    playback.stop();
+    server.stop();
+
+    // Results
+    AudioPlayback::Stats stats = playback.stats();
+    cout << "Pace " << pace << ", " << server.responseCount() << " recorded responses" << endl;
+    report("connect", connectMs);
+    report("first delta", firstDeltaMs);
+    report("audio to speaker", audioToSpeakerMs);
+    cout << "Playback: " << stats.underruns << " underruns, jitter buffer " << stats.targetMs << " ms" << endl;
+    return 0;
+}
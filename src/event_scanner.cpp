@@ -0,0 +1,118 @@
+// Deskman robot.
+// Event scanner module.
+// Thomas Jacobs
+
+#include "event_scanner.h"
+#include <cstring>
+
+using namespace std;
+
+bool EventScanner::scan(const char* data, size_t size) {
+    fields.clear();
+    end = data + size;
+
+    // Open
+    const char* p = skipSpace(data);
+    if (p == end || *p != '{') return false;
+    p = skipSpace(p + 1);
+    if (p < end && *p == '}') return true;
+
+    // Fields
+    while (p < end) {
+        // Key
+        if (*p != '"') return false;
+        bool escaped = false;
+        const char* keyEnd = skipString(p, escaped);
+        if (!keyEnd) return false;
+        Field field;
+        field.key = string_view(p + 1, keyEnd - p - 2);
+        p = skipSpace(keyEnd);
+        if (p == end || *p != ':') return false;
+        p = skipSpace(p + 1);
+        if (p == end) return false;
+
+        // Value
+        const char* valueEnd;
+        if (*p == '"') {
+            field.isString = true;
+            field.escaped = false;
+            valueEnd = skipString(p, field.escaped);
+            if (!valueEnd) return false;
+            field.value = string_view(p + 1, valueEnd - p - 2);
+        } else {
+            field.isString = false;
+            field.escaped = false;
+            valueEnd = skipValue(p);
+            if (!valueEnd) return false;
+            field.value = string_view(p, valueEnd - p);
+        }
+        fields.push_back(field);
+
+        // Next or close
+        p = skipSpace(valueEnd);
+        if (p == end) return false;
+        if (*p == '}') return true;
+        if (*p != ',') return false;
+        p = skipSpace(p + 1);
+    }
+    return false;
+}
+
+const EventScanner::Field* EventScanner::find(string_view key) const {
+    for (const Field& field : fields) {
+        if (field.key == key) return &field;
+    }
+    return nullptr;
+}
+
+string_view EventScanner::string(string_view key) const {
+    const Field* field = find(key);
+    if (!field || !field->isString || field->escaped) return string_view();
+    return field->value;
+}
+
+const char* EventScanner::skipSpace(const char* p) const {
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) p++;
+    return p;
+}
+
+// From the opening quote to just past the closing one, memchr does the long runs
+const char* EventScanner::skipString(const char* p, bool& escaped) const {
+    p++;
+    while (p < end) {
+        const char* quote = (const char*)memchr(p, '"', end - p);
+        if (!quote) return nullptr;
+
+        // A quote after an odd number of backslashes is part of the string
+        const char* back = quote;
+        while (back > p && back[-1] == '\\') back--;
+        if (!escaped && memchr(p, '\\', quote - p)) escaped = true;
+        if ((quote - back) % 2 == 0) return quote + 1;
+        p = quote + 1;
+    }
+    return nullptr;
+}
+
+// Numbers, literals, and whole objects and arrays
+const char* EventScanner::skipValue(const char* p) const {
+    if (*p != '{' && *p != '[') {
+        while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t') p++;
+        return p;
+    }
+    int depth = 0;
+    bool escaped = false;
+    while (p < end) {
+        char c = *p;
+        if (c == '"') {
+            p = skipString(p, escaped);
+            if (!p) return nullptr;
+            continue;
+        }
+        if (c == '{' || c == '[') depth++;
+        else if (c == '}' || c == ']') {
+            if (--depth == 0) return p + 1;
+        }
+        p++;
+    }
+    return nullptr;
+}
@@ -0,0 +1,39 @@
+// Deskman robot.
+// Event scanner module.
+// Thomas Jacobs
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <string_view>
+
+// Finds the top level fields of a JSON object in place, in one pass and without building a DOM.
+// Values are views into the message, nested objects and arrays are skipped over, and string values
+// are left escaped, so a large base64 field can go straight to the decoder.
+class EventScanner {
+public:
+    struct Field {
+        std::string_view key;
+        std::string_view value;  // Strings without their quotes, anything else as written
+        bool isString;
+        bool escaped;            // String has backslash escapes in it
+    };
+
+    // Scan a message, false if it isn't a JSON object
+    bool scan(const char* data, size_t size);
+
+    // A top level field, nullptr if there isn't one
+    const Field* find(std::string_view key) const;
+
+    // A top level string field without escapes, empty if missing
+    std::string_view string(std::string_view key) const;
+
+private:
+    const char* skipSpace(const char* p) const;
+    const char* skipString(const char* p, bool& escaped) const;
+    const char* skipValue(const char* p) const;
+
+    const char* end = nullptr;
+    std::vector<Field> fields;
+};
@@ -20,14 +20,15 @@ Face create_face(int center_x, int center_y) {
     face.rightEye = new Ellipse(45, 120, {25, 25, 25, 255}, {255, 255, 255, 255}, 0.0f);
     face.rightEye->localPosition = Vec3(120, -100, 0);
     
-    // Create mouth with cutout
-    Ellipse* mouth = new Ellipse(240, 80, {255, 255, 255, 255}, {255, 255, 255, 255}, 0.0f, -40, 180);
-    mouth->localPosition = Vec3(0, 200, 0);
+    // Mouth, shaped by what's being said
+    face.mouth = new Ellipse(80, 6, {25, 25, 25, 255}, {255, 255, 255, 255}, 0.0f);
+    face.mouth->localPosition = Vec3(0, 200, 0);
+    face.mouth_shape = '_';
 
     // Add shapes to renderer
     vectorRenderer.addShape(face.leftEye);
     vectorRenderer.addShape(face.rightEye);
-    //vectorRenderer.addShape(mouth);
+    vectorRenderer.addShape(face.mouth);
 
     // Load font
     face.font = TTF_OpenFont("/System/Library/Fonts/Helvetica.ttc", 24);
@@ -113,6 +114,17 @@ void render_face(SDL_Renderer* renderer, Face* face) {
     }
 }
 
+void shape_mouth(Face* face, char mouth_shape) {
+    face->mouth_shape = mouth_shape;
+    switch (mouth_shape) {
+        case 'M': face->mouth->radiusX = 70; face->mouth->radiusY = 4; break;   // Closed
+        case 'L': face->mouth->radiusX = 60; face->mouth->radiusY = 14; break;  // Narrow opening
+        case 'F': face->mouth->radiusX = 85; face->mouth->radiusY = 22; break;  // Slight opening
+        case 'T': face->mouth->radiusX = 95; face->mouth->radiusY = 45; break;  // Wide open
+        default:  face->mouth->radiusX = 80; face->mouth->radiusY = 6; break;   // At rest
+    }
+}
+
 void update_face(Face* face, int eye_squint, int smile_curve) {
     // Update face parameters based on input
 }
@@ -122,7 +134,7 @@ void cleanup_face(Face* face) {
         TTF_CloseFont(face->font);
         face->font = NULL;
     }
-    // Note: We don't delete the eye shapes here as they're managed by the vectorRenderer
+    // Note: We don't delete the eye and mouth shapes here as they're managed by the vectorRenderer
 }
 
 void move_face(int smile) {
@@ -28,6 +28,7 @@ typedef struct {
 
     Ellipse* leftEye;
     Ellipse* rightEye;
+    Ellipse* mouth;
 
 } Face;
 
@@ -35,6 +36,7 @@ extern Face face;
 
 Face create_face(int center_x, int center_y);
 void update_face(Face* face, int eye_squint, int smile_curve);
+void shape_mouth(Face* face, char mouth_shape);
 void cleanup_face(Face* face);
 
 #endif
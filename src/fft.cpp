@@ -0,0 +1,73 @@
+// Deskman robot.
+// FFT module.
+// Thomas Jacobs
+
+#include "fft.h"
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+RealFFT::RealFFT(int size) : n(size) {
+    int half = n / 2;
+
+    // Periodic Hann window
+    window.resize(n);
+    for (int i = 0; i < n; i++) window[i] = 0.5f - 0.5f * cosf(2 * (float)M_PI * i / n);
+    frame.resize(n);
+
+    // Bit reversed order for the half size FFT
+    int bits = 0;
+    while ((1 << bits) < half) bits++;
+    reversed.resize(half);
+    for (int i = 0; i < half; i++) {
+        int r = 0;
+        for (int b = 0; b < bits; b++) if (i & (1 << b)) r |= 1 << (bits - 1 - b);
+        reversed[i] = r;
+    }
+
+    // Twiddles
+    twiddle.resize(max(half / 2, 1));
+    for (int i = 0; i < (int)twiddle.size(); i++) twiddle[i] = polar(1.0f, -2 * (float)M_PI * i / half);
+    split.resize(half + 1);
+    for (int k = 0; k <= half; k++) split[k] = polar(1.0f, -2 * (float)M_PI * k / n);
+    work.resize(half);
+}
+
+void RealFFT::power(const float* in, int count, float* out) {
+    count = min(count, n);
+    for (int i = 0; i < count; i++) frame[i] = in[i] * window[i];
+    fill(frame.begin() + count, frame.end(), 0.0f);
+    powerRaw(frame.data(), out);
+}
+
+void RealFFT::powerRaw(const float* in, float* out) {
+    // Even samples real, odd samples imaginary, in bit reversed order
+    int half = n / 2;
+    for (int i = 0; i < half; i++) work[reversed[i]] = complex<float>(in[2 * i], in[2 * i + 1]);
+    transform();
+
+    // Split the half size spectrum into the real one
+    for (int k = 0; k <= half; k++) {
+        complex<float> a = work[k % half];
+        complex<float> b = conj(work[(half - k) % half]);
+        complex<float> even = (a + b) * 0.5f;
+        complex<float> odd = (a - b) * complex<float>(0, -0.5f);
+        out[k] = norm(even + split[k] * odd);
+    }
+}
+
+// Iterative radix 2, input already in bit reversed order
+void RealFFT::transform() {
+    int half = n / 2;
+    for (int len = 2; len <= half; len <<= 1) {
+        int step = half / len;
+        for (int i = 0; i < half; i += len) {
+            for (int j = 0; j < len / 2; j++) {
+                complex<float> t = twiddle[j * step] * work[i + j + len / 2];
+                work[i + j + len / 2] = work[i + j] - t;
+                work[i + j] += t;
+            }
+        }
+    }
+}
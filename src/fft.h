@@ -0,0 +1,39 @@
+// Deskman robot.
+// FFT module.
+// Thomas Jacobs
+
+#pragma once
+
+#include <vector>
+#include <complex>
+
+// Power spectrum of real frames, size a power of two.
+// The real input is packed into a complex FFT of half the size and split afterwards,
+// twiddles and bit reversal are worked out once up front so a frame does no allocation.
+class RealFFT {
+public:
+    RealFFT(int size);
+
+    // Hann window the frame (count samples, zero padded to size) and write size / 2 + 1 power bins
+    void power(const float* in, int count, float* out);
+
+    // Same, for a frame that has already been windowed and padded
+    void powerRaw(const float* in, float* out);
+
+    int size() const { return n; }
+    int bins() const { return n / 2 + 1; }
+
+    // Centre frequency of a bin
+    float binHz(int bin, int sampleRate) const { return (float)bin * sampleRate / n; }
+
+private:
+    void transform();
+
+    int n;
+    std::vector<float> window;
+    std::vector<float> frame;
+    std::vector<int> reversed;
+    std::vector<std::complex<float>> twiddle;  // Half size FFT
+    std::vector<std::complex<float>> split;    // Full size, for unpacking the real spectrum
+    std::vector<std::complex<float>> work;
+};
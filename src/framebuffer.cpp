@@ -0,0 +1,365 @@
+// Deskman robot.
+// Framebuffer module.
+// Thomas Jacobs
+
+#include "framebuffer.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <drm/drm.h>
+#endif
+
+// Logging
+#define DEBUG 0
+
+// Offscreen size
+static const int MEMORY_WIDTH = 800;
+static const int MEMORY_HEIGHT = 480;
+
+using namespace std;
+
+Framebuffer* Framebuffer::create(const string& kind) {
+    if (kind == "memory") return new MemoryFramebuffer(MEMORY_WIDTH, MEMORY_HEIGHT);
+    #ifdef __linux__
+    if (kind == "drm") {
+        DrmFramebuffer* drm = new DrmFramebuffer();
+        if (drm->open()) return drm;
+        delete drm;
+        return nullptr;
+    }
+    if (kind == "fbdev") {
+        FbdevFramebuffer* fbdev = new FbdevFramebuffer();
+        if (fbdev->open()) return fbdev;
+        delete fbdev;
+        return nullptr;
+    }
+    #endif
+    cerr << "No framebuffer called " << kind << "." << endl;
+    return nullptr;
+}
+
+// -----------------------------------------------------------
+// Memory
+// -----------------------------------------------------------
+
+MemoryFramebuffer::MemoryFramebuffer(int width_, int height_) {
+    width = width_;
+    height = height_;
+    stride = width_;
+    for (auto& buffer : buffers) buffer.assign((size_t)width * height, 0xFF000000);
+}
+
+bool MemoryFramebuffer::flip() {
+    shown = 1 - shown;
+    return false;
+}
+
+bool MemoryFramebuffer::save(const string& path) const {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        cerr << "Could not write " << path << endl;
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    vector<uint8_t> rgb((size_t)width * 3);
+    for (int y = 0; y < height; y++) {
+        const uint32_t* row = front() + (size_t)y * stride;
+        for (int x = 0; x < width; x++) {
+            rgb[x * 3] = row[x] >> 16;
+            rgb[x * 3 + 1] = row[x] >> 8;
+            rgb[x * 3 + 2] = row[x];
+        }
+        fwrite(rgb.data(), 1, rgb.size(), file);
+    }
+    fclose(file);
+    return true;
+}
+
+#ifdef __linux__
+
+// -----------------------------------------------------------
+// DRM
+// -----------------------------------------------------------
+
+DrmFramebuffer::~DrmFramebuffer() {
+    if (fd < 0) return;
+
+    // What was showing before, the console usually
+    if (saved.crtc_id) {
+        saved.set_connectors_ptr = (uint64_t)(uintptr_t)&connector;
+        saved.count_connectors = 1;
+        ioctl(fd, DRM_IOCTL_MODE_SETCRTC, &saved);
+    }
+    for (Buffer& buffer : buffers) {
+        if (buffer.pixels) munmap(buffer.pixels, buffer.size);
+        if (buffer.fb) ioctl(fd, DRM_IOCTL_MODE_RMFB, &buffer.fb);
+        if (buffer.handle) {
+            drm_mode_destroy_dumb destroy = {};
+            destroy.handle = buffer.handle;
+            ioctl(fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+        }
+    }
+    close(fd);
+}
+
+bool DrmFramebuffer::open() {
+    // The display controller isn't always the first card, the GPU can be
+    for (int card = 0; card < 4; card++) {
+        if (openCard("/dev/dri/card" + to_string(card))) return true;
+
+        // Found a display but couldn't drive it
+        if (fd >= 0) return false;
+    }
+    cerr << "No DRM display connected, or it's in use by X." << endl;
+    return false;
+}
+
+bool DrmFramebuffer::openCard(const string& path) {
+    fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    // Resources, counts first then the lists
+    drm_mode_card_res resources = {};
+    if (ioctl(fd, DRM_IOCTL_MODE_GETRESOURCES, &resources) != 0 || resources.count_connectors == 0 || resources.count_crtcs == 0) {
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    vector<uint32_t> fbs(resources.count_fbs), crtcs(resources.count_crtcs), connectors(resources.count_connectors), encoders(resources.count_encoders);
+    resources.fb_id_ptr = (uint64_t)(uintptr_t)fbs.data();
+    resources.crtc_id_ptr = (uint64_t)(uintptr_t)crtcs.data();
+    resources.connector_id_ptr = (uint64_t)(uintptr_t)connectors.data();
+    resources.encoder_id_ptr = (uint64_t)(uintptr_t)encoders.data();
+    ioctl(fd, DRM_IOCTL_MODE_GETRESOURCES, &resources);
+
+    for (uint32_t id : connectors) {
+        drm_mode_get_connector conn = {};
+        conn.connector_id = id;
+        if (ioctl(fd, DRM_IOCTL_MODE_GETCONNECTOR, &conn) != 0 || conn.connection != DRM_MODE_CONNECTED || conn.count_modes == 0) continue;
+        vector<drm_mode_modeinfo> modes(conn.count_modes);
+        vector<uint32_t> connEncoders(conn.count_encoders), props(conn.count_props);
+        vector<uint64_t> values(conn.count_props);
+        conn.modes_ptr = (uint64_t)(uintptr_t)modes.data();
+        conn.encoders_ptr = (uint64_t)(uintptr_t)connEncoders.data();
+        conn.props_ptr = (uint64_t)(uintptr_t)props.data();
+        conn.prop_values_ptr = (uint64_t)(uintptr_t)values.data();
+        if (ioctl(fd, DRM_IOCTL_MODE_GETCONNECTOR, &conn) != 0 || conn.count_modes == 0) continue;
+
+        // Preferred mode
+        drm_mode_modeinfo mode = modes[0];
+        for (const drm_mode_modeinfo& m : modes) {
+            if (m.type & DRM_MODE_TYPE_PREFERRED) {
+                mode = m;
+                break;
+            }
+        }
+
+        // CRTC the encoder drives now, or the first it can
+        crtc = 0;
+        connEncoders.insert(connEncoders.begin(), conn.encoder_id);
+        for (uint32_t encoderId : connEncoders) {
+            if (!encoderId) continue;
+            drm_mode_get_encoder encoder = {};
+            encoder.encoder_id = encoderId;
+            if (ioctl(fd, DRM_IOCTL_MODE_GETENCODER, &encoder) != 0) continue;
+            crtc = encoder.crtc_id;
+            for (size_t i = 0; !crtc && i < crtcs.size(); i++) {
+                if (encoder.possible_crtcs & (1u << i)) crtc = crtcs[i];
+            }
+            if (crtc) break;
+        }
+        if (!crtc) continue;
+
+        connector = id;
+        width = mode.hdisplay;
+        height = mode.vdisplay;
+        if (mode.vrefresh) refreshHz = mode.vrefresh;
+        saved.crtc_id = crtc;
+        if (ioctl(fd, DRM_IOCTL_MODE_GETCRTC, &saved) != 0) saved.crtc_id = 0;
+
+        // Two buffers, the first one showing
+        if (!createBuffer(buffers[0]) || !createBuffer(buffers[1])) return false;
+        drm_mode_crtc set = {};
+        set.crtc_id = crtc;
+        set.fb_id = buffers[0].fb;
+        set.set_connectors_ptr = (uint64_t)(uintptr_t)&connector;
+        set.count_connectors = 1;
+        set.mode = mode;
+        set.mode_valid = 1;
+        if (ioctl(fd, DRM_IOCTL_MODE_SETCRTC, &set) != 0) {
+            cerr << "Could not set the display mode on " << path << ": " << strerror(errno) << endl;
+            return false;
+        }
+        if (DEBUG) cout << "DRM " << path << " " << width << "x" << height << " at " << refreshHz << " Hz" << endl;
+        return true;
+    }
+    close(fd);
+    fd = -1;
+    return false;
+}
+
+bool DrmFramebuffer::createBuffer(Buffer& buffer) {
+    drm_mode_create_dumb create = {};
+    create.width = width;
+    create.height = height;
+    create.bpp = 32;
+    if (ioctl(fd, DRM_IOCTL_MODE_CREATE_DUMB, &create) != 0) {
+        cerr << "Could not create a DRM buffer: " << strerror(errno) << endl;
+        return false;
+    }
+    buffer.handle = create.handle;
+    buffer.size = create.size;
+    stride = create.pitch / 4;
+
+    drm_mode_fb_cmd fb = {};
+    fb.width = width;
+    fb.height = height;
+    fb.pitch = create.pitch;
+    fb.bpp = 32;
+    fb.depth = 24;
+    fb.handle = create.handle;
+    drm_mode_map_dumb map = {};
+    map.handle = create.handle;
+    if (ioctl(fd, DRM_IOCTL_MODE_ADDFB, &fb) != 0 || ioctl(fd, DRM_IOCTL_MODE_MAP_DUMB, &map) != 0) {
+        cerr << "Could not set up a DRM buffer: " << strerror(errno) << endl;
+        return false;
+    }
+    buffer.fb = fb.fb_id;
+    void* pixels = mmap(nullptr, buffer.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, map.offset);
+    if (pixels == MAP_FAILED) {
+        cerr << "Could not map a DRM buffer: " << strerror(errno) << endl;
+        return false;
+    }
+    buffer.pixels = (uint32_t*)pixels;
+    return true;
+}
+
+bool DrmFramebuffer::flip() {
+    Buffer& next = buffers[1 - shown];
+    drm_mode_crtc_page_flip request = {};
+    request.crtc_id = crtc;
+    request.fb_id = next.fb;
+    request.flags = DRM_MODE_PAGE_FLIP_EVENT;
+    if (ioctl(fd, DRM_IOCTL_MODE_PAGE_FLIP, &request) != 0) {
+        // Show it straight away then, it may tear
+        drm_mode_crtc set = {};
+        set.crtc_id = crtc;
+        ioctl(fd, DRM_IOCTL_MODE_GETCRTC, &set);
+        set.fb_id = next.fb;
+        set.set_connectors_ptr = (uint64_t)(uintptr_t)&connector;
+        set.count_connectors = 1;
+        ioctl(fd, DRM_IOCTL_MODE_SETCRTC, &set);
+        shown = 1 - shown;
+        return false;
+    }
+
+    // The flip completes on vblank, until then the buffer's still on screen
+    char events[1024];
+    bool flipped = false;
+    while (!flipped) {
+        ssize_t n = read(fd, events, sizeof(events));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        for (ssize_t at = 0; at + (ssize_t)sizeof(drm_event) <= n; ) {
+            drm_event* event = (drm_event*)(events + at);
+            if (event->type == DRM_EVENT_FLIP_COMPLETE) flipped = true;
+            if (event->length == 0) break;
+            at += event->length;
+        }
+    }
+    shown = 1 - shown;
+    return flipped;
+}
+
+// -----------------------------------------------------------
+// fbdev
+// -----------------------------------------------------------
+
+FbdevFramebuffer::~FbdevFramebuffer() {
+    if (mapped) {
+        // Leave the first half showing, where the console draws
+        if (panning && shown) {
+            var.yoffset = 0;
+            ioctl(fd, FBIOPAN_DISPLAY, &var);
+        }
+        munmap(mapped, mappedSize);
+    }
+    if (fd >= 0) close(fd);
+}
+
+bool FbdevFramebuffer::open() {
+    fd = ::open("/dev/fb0", O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        cerr << "Could not open /dev/fb0: " << strerror(errno) << endl;
+        return false;
+    }
+    fb_fix_screeninfo fix = {};
+    if (ioctl(fd, FBIOGET_VSCREENINFO, &var) != 0 || ioctl(fd, FBIOGET_FSCREENINFO, &fix) != 0) {
+        cerr << "Could not read the framebuffer's format." << endl;
+        return false;
+    }
+    if (var.bits_per_pixel != 32 || var.red.offset != 16 || var.green.offset != 8 || var.blue.offset != 0) {
+        cerr << "Need a 32 bit XRGB framebuffer, /dev/fb0 is " << var.bits_per_pixel << " bit." << endl;
+        return false;
+    }
+    width = var.xres;
+    height = var.yres;
+
+    // Room for two frames, if the driver will give it
+    if (var.yres_virtual < 2 * var.yres) {
+        fb_var_screeninfo taller = var;
+        taller.yres_virtual = 2 * var.yres;
+        taller.yoffset = 0;
+        if (ioctl(fd, FBIOPUT_VSCREENINFO, &taller) == 0) {
+            ioctl(fd, FBIOGET_VSCREENINFO, &var);
+            ioctl(fd, FBIOGET_FSCREENINFO, &fix);
+        }
+    }
+    panning = var.yres_virtual >= 2 * var.yres && fix.ypanstep > 0 && fix.smem_len >= 2 * var.yres * fix.line_length;
+    stride = fix.line_length / 4;
+    if (!panning) copy.assign((size_t)stride * height, 0);
+
+    // Refresh from the mode's timings
+    uint64_t line = var.xres + var.left_margin + var.right_margin + var.hsync_len;
+    uint64_t frame = line * (var.yres + var.upper_margin + var.lower_margin + var.vsync_len);
+    if (var.pixclock && frame) refreshHz = (int)(1000000000000ULL / var.pixclock / frame);
+    if (refreshHz <= 0) refreshHz = 60;
+
+    mappedSize = fix.smem_len;
+    void* pixels = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (pixels == MAP_FAILED) {
+        cerr << "Could not map /dev/fb0: " << strerror(errno) << endl;
+        return false;
+    }
+    mapped = (uint8_t*)pixels;
+    if (DEBUG) cout << "fbdev " << width << "x" << height << " at " << refreshHz << " Hz" << (panning ? ", panning" : ", copying") << endl;
+    return true;
+}
+
+uint32_t* FbdevFramebuffer::back() {
+    if (!panning) return copy.data();
+    return (uint32_t*)(mapped + (size_t)(1 - shown) * height * stride * 4);
+}
+
+bool FbdevFramebuffer::flip() {
+    uint32_t screen = 0;
+    if (panning) {
+        var.yoffset = (1 - shown) * height;
+        ioctl(fd, FBIOPAN_DISPLAY, &var);
+        shown = 1 - shown;
+
+        // Drawing into the other half has to wait until it's off screen
+        return ioctl(fd, FBIO_WAITFORVSYNC, &screen) == 0;
+    }
+    bool waited = ioctl(fd, FBIO_WAITFORVSYNC, &screen) == 0;
+    memcpy(mapped, copy.data(), copy.size() * 4);
+    return waited;
+}
+
+#endif
@@ -0,0 +1,104 @@
+// Deskman robot.
+// Framebuffer module.
+// Thomas Jacobs
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#ifdef __linux__
+#include <linux/fb.h>
+#include <drm/drm_mode.h>
+#endif
+
+// Double buffered 32 bit XRGB pixels the rasterizer draws the face into, shown without SDL or X.
+// Draw into back(), flip() shows it and the other buffer becomes the back one.
+class Framebuffer {
+public:
+    int width = 0;
+    int height = 0;
+    int stride = 0;  // In pixels
+    int refreshHz = 60;
+
+    virtual ~Framebuffer() {}
+
+    // The display's kind of framebuffer by name, drm, fbdev or memory, nullptr if it can't be had
+    static Framebuffer* create(const std::string& kind);
+
+    virtual uint32_t* back() = 0;
+
+    // True if that waited for the display's refresh
+    virtual bool flip() = 0;
+};
+
+// Offscreen, for testing and benchmarks without a display
+class MemoryFramebuffer : public Framebuffer {
+public:
+    MemoryFramebuffer(int width, int height);
+
+    uint32_t* back() override { return buffers[1 - shown].data(); }
+    bool flip() override;
+
+    // Last frame flipped
+    const uint32_t* front() const { return buffers[shown].data(); }
+
+    // Front buffer as a binary PPM
+    bool save(const std::string& path) const;
+
+private:
+    std::vector<uint32_t> buffers[2];
+    int shown = 0;
+};
+
+#ifdef __linux__
+
+// KMS dumb buffers on the first connected display, flipped on vblank. Needs DRM master, no X or Wayland.
+class DrmFramebuffer : public Framebuffer {
+public:
+    ~DrmFramebuffer();
+    bool open();
+
+    uint32_t* back() override { return buffers[1 - shown].pixels; }
+    bool flip() override;
+
+private:
+    struct Buffer {
+        uint32_t handle = 0;
+        uint32_t fb = 0;
+        uint32_t* pixels = nullptr;
+        size_t size = 0;
+    };
+
+    bool openCard(const std::string& path);
+    bool createBuffer(Buffer& buffer);
+
+    int fd = -1;
+    uint32_t connector = 0;
+    uint32_t crtc = 0;
+    drm_mode_crtc saved = {};  // To put back what was showing
+    Buffer buffers[2];
+    int shown = 0;
+};
+
+// /dev/fb0, panning between two halves of a virtual screen twice the height if the driver allows,
+// otherwise copying each frame in
+class FbdevFramebuffer : public Framebuffer {
+public:
+    ~FbdevFramebuffer();
+    bool open();
+
+    uint32_t* back() override;
+    bool flip() override;
+
+private:
+    int fd = -1;
+    fb_var_screeninfo var = {};
+    uint8_t* mapped = nullptr;
+    size_t mappedSize = 0;
+    bool panning = false;
+    int shown = 0;
+    std::vector<uint32_t> copy;  // Back buffer without panning
+};
+
+#endif
@@ -0,0 +1,154 @@
+// Deskman robot.
+// G.711 codec module.
+// Thomas Jacobs
+
+#include "g711.h"
+#include <algorithm>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Mu-law adds a bias so every segment starts on a power of two, and clips short of overflowing with it
+static const int ULAW_BIAS = 132;
+static const int ULAW_CLIP = 32635;
+
+// Exponent field of a float once shifted down to sit above the top four fraction bits
+static const int FLOAT_BIAS = 127 << 4;
+
+// Both expansion tables, from the G.711 reference decoder
+struct DecodeTables {
+    int16_t ulaw[256];
+    int16_t alaw[256];
+    constexpr DecodeTables() : ulaw(), alaw() {
+        for (int i = 0; i < 256; i++) {
+            // Mu-law is stored inverted
+            int u = ~i & 0xFF;
+            int t = (((u & 0x0F) << 3) + ULAW_BIAS) << ((u & 0x70) >> 4);
+            ulaw[i] = (int16_t)((u & 0x80) ? ULAW_BIAS - t : t - ULAW_BIAS);
+
+            // A-law has its even bits flipped
+            int a = i ^ 0x55;
+            int seg = (a & 0x70) >> 4;
+            int v = ((a & 0x0F) << 4) + (seg == 0 ? 8 : 0x108);
+            if (seg > 1) v <<= seg - 1;
+            alaw[i] = (int16_t)((a & 0x80) ? v : -v);
+        }
+    }
+};
+static constexpr DecodeTables DECODE;
+
+// -----------------------------------------------------------
+// Scalar
+// -----------------------------------------------------------
+
+// Negative samples use the ones' complement magnitude, so -32768 doesn't overflow
+static inline uint8_t encodeUlaw(int x) {
+    int sign = x < 0 ? 0x80 : 0;
+    int m = min(x ^ (x >> 15), ULAW_CLIP) + ULAW_BIAS;
+    int seg = 31 - __builtin_clz(m) - 7;
+    return ~(sign | seg << 4 | ((m >> (seg + 3)) & 0x0F));
+}
+
+static inline uint8_t encodeAlaw(int x) {
+    int mask = x < 0 ? 0x55 : 0xD5;
+    int m = (x >> 3) ^ (x >> 15);
+    if (m < 32) return (m >> 1) ^ mask;
+    int seg = 31 - __builtin_clz(m) - 4;
+    return (seg << 4 | ((m >> seg) & 0x0F)) ^ mask;
+}
+
+// -----------------------------------------------------------
+// Vector, 8 samples to 8 codes in 16 bit lanes
+// -----------------------------------------------------------
+
+#if defined(__ARM_NEON)
+
+// Segment and mantissa of 8 positive values, straight from their float bits
+static inline int16x8_t segmentMantissa(int16x8_t m, int offset) {
+    uint32x4_t lo = vshrq_n_u32(vreinterpretq_u32_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(m)))), 19);
+    uint32x4_t hi = vshrq_n_u32(vreinterpretq_u32_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(m)))), 19);
+    int16x8_t v = vreinterpretq_s16_u16(vcombine_u16(vmovn_u32(lo), vmovn_u32(hi)));
+    return vsubq_s16(v, vdupq_n_s16(FLOAT_BIAS + (offset << 4)));
+}
+
+static inline int16x8_t ulawLanes(int16x8_t x) {
+    int16x8_t negative = vshrq_n_s16(x, 15);
+    int16x8_t m = vaddq_s16(vminq_s16(veorq_s16(x, negative), vdupq_n_s16(ULAW_CLIP)), vdupq_n_s16(ULAW_BIAS));
+    int16x8_t v = segmentMantissa(m, 7);
+    return veorq_s16(v, veorq_s16(vdupq_n_s16(0xFF), vandq_s16(negative, vdupq_n_s16(0x80))));
+}
+
+static inline int16x8_t alawLanes(int16x8_t x) {
+    int16x8_t negative = vshrq_n_s16(x, 15);
+    int16x8_t m = veorq_s16(vshrq_n_s16(x, 3), negative);
+    uint16x8_t small = vcltq_s16(m, vdupq_n_s16(32));
+    int16x8_t v = vbslq_s16(small, vshrq_n_s16(m, 1), segmentMantissa(m, 4));
+    return veorq_s16(v, veorq_s16(vdupq_n_s16(0xD5), vandq_s16(negative, vdupq_n_s16(0x80))));
+}
+
+#define G711_VECTOR
+#define ENCODE_16(lanes, in, out) \
+    vst1q_u8(out, vcombine_u8(vqmovun_s16(lanes(vld1q_s16(in))), vqmovun_s16(lanes(vld1q_s16(in + 8)))))
+
+#elif defined(__SSE2__)
+
+static inline __m128i segmentMantissa(__m128i m, int offset) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_srli_epi32(_mm_castps_si128(_mm_cvtepi32_ps(_mm_unpacklo_epi16(m, zero))), 19);
+    __m128i hi = _mm_srli_epi32(_mm_castps_si128(_mm_cvtepi32_ps(_mm_unpackhi_epi16(m, zero))), 19);
+    return _mm_sub_epi16(_mm_packs_epi32(lo, hi), _mm_set1_epi16(FLOAT_BIAS + (offset << 4)));
+}
+
+static inline __m128i ulawLanes(__m128i x) {
+    __m128i negative = _mm_srai_epi16(x, 15);
+    __m128i m = _mm_add_epi16(_mm_min_epi16(_mm_xor_si128(x, negative), _mm_set1_epi16(ULAW_CLIP)), _mm_set1_epi16(ULAW_BIAS));
+    __m128i v = segmentMantissa(m, 7);
+    return _mm_xor_si128(v, _mm_xor_si128(_mm_set1_epi16(0xFF), _mm_and_si128(negative, _mm_set1_epi16(0x80))));
+}
+
+static inline __m128i alawLanes(__m128i x) {
+    __m128i negative = _mm_srai_epi16(x, 15);
+    __m128i m = _mm_xor_si128(_mm_srai_epi16(x, 3), negative);
+    __m128i small = _mm_cmplt_epi16(m, _mm_set1_epi16(32));
+    __m128i v = _mm_or_si128(_mm_and_si128(small, _mm_srli_epi16(m, 1)), _mm_andnot_si128(small, segmentMantissa(m, 4)));
+    return _mm_xor_si128(v, _mm_xor_si128(_mm_set1_epi16(0xD5), _mm_and_si128(negative, _mm_set1_epi16(0x80))));
+}
+
+#define G711_VECTOR
+#define ENCODE_16(lanes, in, out) \
+    _mm_storeu_si128((__m128i*)(out), _mm_packus_epi16(lanes(_mm_loadu_si128((const __m128i*)(in))), lanes(_mm_loadu_si128((const __m128i*)(in + 8)))))
+
+#endif
+
+// -----------------------------------------------------------
+// Entry points
+// -----------------------------------------------------------
+
+void g711EncodeUlaw(const int16_t* in, size_t n, uint8_t* out) {
+    size_t i = 0;
+    #ifdef G711_VECTOR
+    for (; i + 16 <= n; i += 16) ENCODE_16(ulawLanes, in + i, out + i);
+    #endif
+    for (; i < n; i++) out[i] = encodeUlaw(in[i]);
+}
+
+void g711EncodeAlaw(const int16_t* in, size_t n, uint8_t* out) {
+    size_t i = 0;
+    #ifdef G711_VECTOR
+    for (; i + 16 <= n; i += 16) ENCODE_16(alawLanes, in + i, out + i);
+    #endif
+    for (; i < n; i++) out[i] = encodeAlaw(in[i]);
+}
+
+void g711DecodeUlaw(const uint8_t* in, size_t n, int16_t* out) {
+    for (size_t i = 0; i < n; i++) out[i] = DECODE.ulaw[in[i]];
+}
+
+void g711DecodeAlaw(const uint8_t* in, size_t n, int16_t* out) {
+    for (size_t i = 0; i < n; i++) out[i] = DECODE.alaw[in[i]];
+}
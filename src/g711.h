@@ -0,0 +1,18 @@
+// Deskman robot.
+// G.711 codec module.
+// Thomas Jacobs
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// G.711 mu-law and A-law, one byte per sample, between caller owned buffers.
+// Decoding is a 256 entry table lookup. Encoding works the segment and mantissa out of the
+// exponent and top fraction bits of the sample converted to float, 16 samples at a time on NEON or SSE2.
+
+void g711EncodeUlaw(const int16_t* in, size_t n, uint8_t* out);
+void g711EncodeAlaw(const int16_t* in, size_t n, uint8_t* out);
+
+void g711DecodeUlaw(const uint8_t* in, size_t n, int16_t* out);
+void g711DecodeAlaw(const uint8_t* in, size_t n, int16_t* out);
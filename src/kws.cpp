@@ -0,0 +1,325 @@
+// Deskman robot.
+// Keyword spotter module.
+// Thomas Jacobs
+
+#include "kws.h"
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+#include "ggml.h"
+#include "ggml-cpu.h"
+#include "ggml-alloc.h"
+#include "ggml-backend.h"
+
+// Logging
+#define DEBUG 0
+
+using namespace std;
+
+// Front end, the model has to be trained on the same features
+static const int WINDOW_MS = 30;
+static const int HOP_MS = 20;
+static const float MEL_LOW_HZ = 20.0f;
+static const float MEL_HIGH_HZ = 7600.0f;
+
+// Decision
+static const int SMOOTH_EVALUATIONS = 3;    // Posteriors averaged over this many runs of the network
+static const int REFRACTORY_MS = 1000;      // Quiet after a detection
+
+// Most nodes a graph can have, a handful per block
+static const int MAX_NODES = 256;
+
+static float hzToMel(float hz) { return 2595.0f * log10f(1.0f + hz / 700.0f); }
+static float melToHz(float mel) { return 700.0f * (powf(10.0f, mel / 2595.0f) - 1.0f); }
+
+static int nextPowerOfTwo(int n) {
+    int size = 1;
+    while (size < n) size <<= 1;
+    return size;
+}
+
+KeywordSpotter::KeywordSpotter() :
+    hop(SAMPLE_RATE * HOP_MS / 1000),
+    window(SAMPLE_RATE * WINDOW_MS / 1000),
+    fft(nextPowerOfTwo(SAMPLE_RATE * WINDOW_MS / 1000)) {
+    samples.assign(window, 0.0f);
+    spectrum.resize(fft.bins());
+}
+
+KeywordSpotter::~KeywordSpotter() {
+    if (allocator) ggml_gallocr_free(allocator);
+    if (compute) ggml_free(compute);
+    if (converted) ggml_free(converted);
+    if (weights) ggml_free(weights);
+}
+
+// -----------------------------------------------------------
+// Model
+// -----------------------------------------------------------
+
+bool KeywordSpotter::load(const string& path) {
+    ggml_cpu_init();
+
+    // Weights
+    gguf_init_params params = { false, &weights };
+    gguf_context* file = gguf_init_from_file(path.c_str(), params);
+    if (!file) {
+        cerr << "Cannot load keyword model " << path << "." << endl;
+        return false;
+    }
+    auto getInt = [file](const char* key, int fallback) {
+        int id = gguf_find_key(file, key);
+        return id < 0 ? fallback : (int)gguf_get_val_u32(file, id);
+    };
+    melBins = getInt("kws.n_mel", melBins);
+    historyFrames = getInt("kws.n_frames", historyFrames);
+    keywordClass = getInt("kws.keyword", keywordClass);
+    conv0Stride[0] = getInt("kws.conv0.stride_w", conv0Stride[0]);
+    conv0Stride[1] = getInt("kws.conv0.stride_h", conv0Stride[1]);
+    conv0Pad[0] = getInt("kws.conv0.pad_w", conv0Pad[0]);
+    conv0Pad[1] = getInt("kws.conv0.pad_h", conv0Pad[1]);
+    gguf_free(file);
+
+    conv0 = ggml_get_tensor(weights, "conv0.weight");
+    conv0Bias = ggml_get_tensor(weights, "conv0.bias");
+    fc = ggml_get_tensor(weights, "fc.weight");
+    fcBias = ggml_get_tensor(weights, "fc.bias");
+    for (int i = 0; ; i++) {
+        string name = "block." + to_string(i) + ".";
+        Block block;
+        block.depthwise = ggml_get_tensor(weights, (name + "dw.weight").c_str());
+        block.depthwiseBias = ggml_get_tensor(weights, (name + "dw.bias").c_str());
+        block.pointwise = ggml_get_tensor(weights, (name + "pw.weight").c_str());
+        block.pointwiseBias = ggml_get_tensor(weights, (name + "pw.bias").c_str());
+        if (!block.depthwise || !block.depthwiseBias || !block.pointwise || !block.pointwiseBias) break;
+        blocks.push_back(block);
+    }
+    if (!conv0 || !conv0Bias || !fc || !fcBias || blocks.empty() || keywordClass >= fc->ne[1]) {
+        cerr << "Keyword model " << path << " is missing layers." << endl;
+        return false;
+    }
+
+    // conv0, pointwise and fc run in int8, depthwise kernels are regrouped by tap
+    if (conv0->type != GGML_TYPE_F32 || conv0->ne[2] != 1) {
+        cerr << "Keyword model " << path << " needs a float conv0 over one input channel." << endl;
+        return false;
+    }
+    size_t convertedSize = 2 * ggml_get_mem_size(weights) + (3 * blocks.size() + 2) * ggml_tensor_overhead();
+    ggml_init_params convertedParams = { convertedSize, nullptr, false };
+    converted = ggml_init(convertedParams);
+    conv0Kernels = paddedKernels(conv0);
+    for (Block& block : blocks) {
+        if (block.depthwise->type != GGML_TYPE_F32 || block.depthwise->ne[0] != 3 || block.depthwise->ne[1] != 3) {
+            cerr << "Keyword model " << path << " needs 3x3 float depthwise kernels." << endl;
+            return false;
+        }
+        block.depthwise = byTap(block.depthwise);
+        block.pointwise = convert(block.pointwise, GGML_TYPE_Q8_0);
+        if (!block.pointwise) return false;
+    }
+    fc = convert(fc, GGML_TYPE_Q8_0);
+    if (!fc) return false;
+
+    // Graph, laid out once so evaluation allocates nothing
+    ggml_init_params computeParams = { MAX_NODES * ggml_tensor_overhead() + ggml_graph_overhead_custom(MAX_NODES, false), nullptr, true };
+    compute = ggml_init(computeParams);
+    ggml_cgraph* built = ggml_new_graph_custom(compute, MAX_NODES, false);
+    output = build(compute);
+    ggml_build_forward_expand(built, output);
+    allocator = ggml_gallocr_new(ggml_backend_cpu_buffer_type());
+    if (!ggml_gallocr_alloc_graph(allocator, built)) {
+        cerr << "Cannot allocate keyword graph." << endl;
+        return false;
+    }
+    ggml_cplan plan = ggml_graph_plan(built, 1, nullptr);
+    work.resize(plan.work_size);
+    graph = built;
+
+    // Mel filterbank, triangles evenly spaced in mel
+    melFilters.assign(melBins, {});
+    float melLow = hzToMel(MEL_LOW_HZ), melHigh = hzToMel(MEL_HIGH_HZ);
+    for (int m = 0; m < melBins; m++) {
+        float left = melToHz(melLow + (melHigh - melLow) * m / (melBins + 1));
+        float centre = melToHz(melLow + (melHigh - melLow) * (m + 1) / (melBins + 1));
+        float right = melToHz(melLow + (melHigh - melLow) * (m + 2) / (melBins + 1));
+        for (int bin = 0; bin < fft.bins(); bin++) {
+            float hz = fft.binHz(bin, SAMPLE_RATE);
+            float weight = hz <= centre ? (hz - left) / (centre - left) : (right - hz) / (right - centre);
+            if (weight > 0) melFilters[m].push_back({ bin, weight });
+        }
+    }
+    history.assign((size_t)melBins * historyFrames, 0.0f);
+    posteriors.assign(SMOOTH_EVALUATIONS, 0.0f);
+    reset();
+
+    if (DEBUG) cout << "Keyword model " << path << ": " << blocks.size() << " blocks, " << conv0->ne[3] << " channels, "
+                    << ggml_gallocr_get_buffer_size(allocator, 0) / 1024 << " KB of activations" << endl;
+    return true;
+}
+
+// Copy of a float tensor in another type, or the tensor itself if it already is one
+ggml_tensor* KeywordSpotter::convert(ggml_tensor* tensor, int type) {
+    if (tensor->type != GGML_TYPE_F32) return tensor;
+    if (tensor->ne[0] % ggml_blck_size((ggml_type)type) != 0) {
+        cerr << "Keyword layer " << ggml_get_name(tensor) << " has " << tensor->ne[0] << " inputs, which can't be quantized." << endl;
+        return nullptr;
+    }
+    ggml_tensor* copy = ggml_new_tensor(converted, (ggml_type)type, GGML_MAX_DIMS, tensor->ne);
+    ggml_set_name(copy, ggml_get_name(tensor));
+    int64_t rows = ggml_nrows(tensor);
+    if (type == GGML_TYPE_F16) {
+        ggml_fp32_to_fp16_row((const float*)tensor->data, (ggml_fp16_t*)copy->data, rows * tensor->ne[0]);
+    }
+    else {
+        ggml_quantize_chunk((ggml_type)type, (const float*)tensor->data, copy->data, 0, rows, tensor->ne[0], nullptr);
+    }
+    return copy;
+}
+
+// conv0 kernels [width, height, 1, channels] as int8 rows of taps, zero padded to a whole number of
+// blocks. ggml's matrix multiply is several times slower on rows that aren't, 40 taps costs more than 64.
+ggml_tensor* KeywordSpotter::paddedKernels(ggml_tensor* kernel) {
+    int64_t taps = kernel->ne[0] * kernel->ne[1], channels = kernel->ne[3];
+    int64_t block = ggml_blck_size(GGML_TYPE_Q8_0);
+    int64_t padded = (taps + block - 1) / block * block;
+    vector<float> rows(padded * channels, 0.0f);
+    for (int64_t c = 0; c < channels; c++) {
+        copy((const float*)kernel->data + c * taps, (const float*)kernel->data + (c + 1) * taps, &rows[c * padded]);
+    }
+    ggml_tensor* result = ggml_new_tensor_2d(converted, GGML_TYPE_Q8_0, padded, channels);
+    ggml_set_name(result, ggml_get_name(kernel));
+    ggml_quantize_chunk(GGML_TYPE_Q8_0, rows.data(), result->data, 0, channels, padded, nullptr);
+    return result;
+}
+
+// Depthwise kernel [3, 3, 1, channels] regrouped as [channels, 9] so each tap is a row across channels
+ggml_tensor* KeywordSpotter::byTap(ggml_tensor* kernel) {
+    int64_t channels = kernel->ne[3];
+    ggml_tensor* taps = ggml_new_tensor_2d(converted, GGML_TYPE_F32, channels, 9);
+    ggml_set_name(taps, ggml_get_name(kernel));
+    const float* from = (const float*)kernel->data;
+    float* to = (float*)taps->data;
+    for (int64_t c = 0; c < channels; c++) {
+        for (int tap = 0; tap < 9; tap++) to[tap * channels + c] = from[c * 9 + tap];
+    }
+    return taps;
+}
+
+// 3x3 depthwise conv with zero padding, bias and relu on [channels, width, height].
+// ggml does depthwise through im2col and a matrix multiply per channel, which for a map this small
+// costs several times the rest of the network, here the inner loop runs across channels.
+static void depthwise3x3(ggml_tensor* dst, const ggml_tensor* x, const ggml_tensor* taps, const ggml_tensor* bias, int ith, int nth, void*) {
+    const int64_t channels = x->ne[0], width = x->ne[1], height = x->ne[2];
+    const float* in = (const float*)x->data;
+    const float* kernel = (const float*)taps->data;
+    const float* offset = (const float*)bias->data;
+    float* out = (float*)dst->data;
+    for (int64_t j = ith; j < height; j += nth) {
+        for (int64_t i = 0; i < width; i++) {
+            float* o = out + (j * width + i) * channels;
+            copy(offset, offset + channels, o);
+            for (int dy = -1; dy <= 1; dy++) {
+                if (j + dy < 0 || j + dy >= height) continue;
+                for (int dx = -1; dx <= 1; dx++) {
+                    if (i + dx < 0 || i + dx >= width) continue;
+                    const float* s = in + ((j + dy) * width + i + dx) * channels;
+                    const float* k = kernel + ((dy + 1) * 3 + dx + 1) * channels;
+                    for (int64_t c = 0; c < channels; c++) o[c] += s[c] * k[c];
+                }
+            }
+            for (int64_t c = 0; c < channels; c++) o[c] = max(o[c], 0.0f);
+        }
+    }
+}
+
+// Features [mel, time] in, class posteriors out. Activations stay [channels, positions] throughout,
+// so conv0 and the pointwise convs are one matrix multiply each and nothing is transposed between layers.
+ggml_tensor* KeywordSpotter::build(ggml_context* ctx) {
+    input = ggml_new_tensor_4d(ctx, GGML_TYPE_F32, melBins, historyFrames, 1, 1);
+    ggml_set_input(input);
+
+    // Full conv over the features, as patches times kernels
+    ggml_tensor* patches = ggml_im2col(ctx, conv0, input, conv0Stride[0], conv0Stride[1], conv0Pad[0], conv0Pad[1], 1, 1, true, GGML_TYPE_F32);
+    int64_t taps = patches->ne[0], width = patches->ne[1], height = patches->ne[2];
+    patches = ggml_pad(ctx, ggml_reshape_2d(ctx, patches, taps, width * height), (int)(conv0Kernels->ne[0] - taps), 0, 0, 0);
+    ggml_tensor* x = ggml_mul_mat(ctx, conv0Kernels, patches);
+    x = ggml_relu(ctx, ggml_add(ctx, x, conv0Bias));
+
+    // Depthwise separable blocks
+    for (const Block& block : blocks) {
+        x = ggml_map_custom3(ctx, ggml_reshape_3d(ctx, x, x->ne[0], width, height), block.depthwise, block.depthwiseBias, depthwise3x3, 1, nullptr);
+        x = ggml_reshape_2d(ctx, x, x->ne[0], width * height);
+        x = ggml_relu(ctx, ggml_add(ctx, ggml_mul_mat(ctx, block.pointwise, x), block.pointwiseBias));
+    }
+
+    // Average over positions, then classify
+    ggml_tensor* pooled = ggml_mean(ctx, ggml_cont(ctx, ggml_transpose(ctx, x)));
+    pooled = ggml_reshape_2d(ctx, pooled, pooled->ne[1], 1);
+    ggml_tensor* logits = ggml_add(ctx, ggml_mul_mat(ctx, fc, pooled), fcBias);
+    ggml_tensor* result = ggml_soft_max(ctx, logits);
+    ggml_set_output(result);
+    return result;
+}
+
+// -----------------------------------------------------------
+// Streaming
+// -----------------------------------------------------------
+
+void KeywordSpotter::reset() {
+    fill(samples.begin(), samples.end(), 0.0f);
+    fill(history.begin(), history.end(), 0.0f);
+    fill(posteriors.begin(), posteriors.end(), 0.0f);
+    historyHead = 0;
+    framesSeen = 0;
+    posteriorHead = 0;
+    smoothed = 0;
+    refractory = 0;
+}
+
+bool KeywordSpotter::process(const int16_t* frame) {
+    if (!graph) return false;
+    addFrame(frame);
+    if (refractory > 0) refractory--;
+
+    // Only once there's a full second, and every few frames
+    if (framesSeen < historyFrames || framesSeen % stride != 0) return false;
+    posteriors[posteriorHead] = evaluate();
+    posteriorHead = (posteriorHead + 1) % SMOOTH_EVALUATIONS;
+    smoothed = 0;
+    for (float p : posteriors) smoothed += p;
+    smoothed /= SMOOTH_EVALUATIONS;
+
+    if (smoothed < threshold || refractory > 0) return false;
+    refractory = REFRACTORY_MS / HOP_MS;
+    fill(posteriors.begin(), posteriors.end(), 0.0f);
+    return true;
+}
+
+// Slide the window along by a hop and add its log-mel row to the history
+void KeywordSpotter::addFrame(const int16_t* frame) {
+    move(samples.begin() + hop, samples.end(), samples.begin());
+    for (int i = 0; i < hop; i++) samples[window - hop + i] = frame[i] * (1.0f / 32768.0f);
+    fft.power(samples.data(), window, spectrum.data());
+
+    float* row = &history[(size_t)historyHead * melBins];
+    for (int m = 0; m < melBins; m++) {
+        float energy = 0;
+        for (const auto& [bin, weight] : melFilters[m]) energy += spectrum[bin] * weight;
+        row[m] = logf(energy + 1e-6f);
+    }
+    historyHead = (historyHead + 1) % historyFrames;
+    framesSeen++;
+}
+
+// Run the network on the history, oldest row first, returns the keyword posterior
+float KeywordSpotter::evaluate() {
+    float* in = (float*)input->data;
+    size_t newer = (size_t)(historyFrames - historyHead) * melBins;
+    copy(history.begin() + (size_t)historyHead * melBins, history.end(), in);
+    copy(history.begin(), history.begin() + (size_t)historyHead * melBins, in + newer);
+
+    ggml_cplan plan = ggml_graph_plan(graph, 1, nullptr);
+    plan.work_data = work.data();
+    if (ggml_graph_compute(graph, &plan) != GGML_STATUS_SUCCESS) return 0;
+    return ((const float*)output->data)[keywordClass];
+}
@@ -0,0 +1,111 @@
+// Deskman robot.
+// Keyword spotter module.
+// Thomas Jacobs
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "fft.h"
+
+struct ggml_context;
+struct ggml_tensor;
+struct ggml_cgraph;
+struct ggml_gallocr;
+
+// On-device wake word, a small depthwise separable CNN over log-mel features run with ggml.
+// Fed 20 ms frames of 16 kHz audio like Porcupine is fed its own frames. Each frame adds a row of
+// 40 log-mel energies (30 ms Hann window) to a one second history, and every few frames the network
+// scores the history. A detection is the keyword's averaged posterior crossing the threshold,
+// after which the spotter stays quiet for a second so one keyword fires once.
+//
+// The model is a GGUF file written by py/kws_export.py: conv0, then blocks of a 3x3 depthwise and a
+// pointwise conv with batch norm folded in, average pooling and fc. conv0, pointwise and fc weights
+// run as int8 (Q8_0), quantized on load if the file has them in float.
+class KeywordSpotter {
+public:
+    static const int SAMPLE_RATE = 16000;
+
+    KeywordSpotter();
+    ~KeywordSpotter();
+
+    // Load a model, false if it can't be used
+    bool load(const std::string& path);
+    bool isReady() const { return graph != nullptr; }
+
+    // Samples per frame passed to process()
+    int frameLength() const { return hop; }
+
+    // Feed one frame, true if the keyword ended in it
+    bool process(const int16_t* frame);
+
+    // Run the network every this many frames, trading latency for CPU, 2 by default
+    void setStride(int frames) { stride = frames < 1 ? 1 : frames; }
+
+    // Posterior the keyword has to reach, higher is fewer false alarms, 0.5 by default
+    void setSensitivity(float sensitivity) { threshold = 1.0f - sensitivity; }
+
+    // Keyword posterior after the last evaluation, for tuning
+    float score() const { return smoothed; }
+
+    void reset();
+
+private:
+    void addFrame(const int16_t* frame);
+    float evaluate();
+    ggml_tensor* convert(ggml_tensor* tensor, int type);
+    ggml_tensor* paddedKernels(ggml_tensor* kernel);
+    ggml_tensor* byTap(ggml_tensor* kernel);
+    ggml_tensor* build(ggml_context* ctx);
+
+    // Front end
+    int hop;
+    int window;
+    RealFFT fft;
+    std::vector<float> samples;          // The last window of audio
+    std::vector<float> spectrum;
+    std::vector<std::vector<std::pair<int, float>>> melFilters;
+
+    // Feature history, a ring of rows
+    int melBins = 40;
+    int historyFrames = 49;
+    std::vector<float> history;
+    int historyHead = 0;
+    int framesSeen = 0;
+
+    // Model
+    struct Block {
+        ggml_tensor* depthwise;
+        ggml_tensor* depthwiseBias;
+        ggml_tensor* pointwise;
+        ggml_tensor* pointwiseBias;
+    };
+    ggml_context* weights = nullptr;
+    ggml_context* converted = nullptr;   // Int8, fp16 and regrouped copies of float weights
+    ggml_tensor* conv0 = nullptr;          // Only its shape is used, for im2col
+    ggml_tensor* conv0Kernels = nullptr;
+    ggml_tensor* conv0Bias = nullptr;
+    int conv0Stride[2] = { 2, 2 };
+    int conv0Pad[2] = { 1, 4 };
+    std::vector<Block> blocks;
+    ggml_tensor* fc = nullptr;
+    ggml_tensor* fcBias = nullptr;
+    int keywordClass = 2;
+
+    // Graph, built and allocated once, evaluation only copies the features in
+    ggml_context* compute = nullptr;
+    ggml_gallocr* allocator = nullptr;
+    ggml_cgraph* graph = nullptr;
+    ggml_tensor* input = nullptr;
+    ggml_tensor* output = nullptr;
+    std::vector<uint8_t> work;
+
+    // Decision
+    int stride = 2;
+    float threshold = 0.5f;
+    std::vector<float> posteriors;
+    int posteriorHead = 0;
+    float smoothed = 0;
+    int refractory = 0;
+};
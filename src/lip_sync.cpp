@@ -0,0 +1,95 @@
+// Deskman robot.
+// Lip sync module.
+// Thomas Jacobs
+
+#include "lip_sync.h"
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+// Bands, voicing and the first formant, the second formant, and fricatives
+static const float LOW_HZ = 100.0f;
+static const float MID_HZ = 900.0f;
+static const float HIGH_HZ = 2500.0f;
+static const float TOP_HZ = 8000.0f;
+
+// Shapes, by level below the recent peak and where the energy is
+static const float SILENT_DB = -35.0f;     // Mouth at rest
+static const float OPEN_DB = -6.0f;        // Wide open, loud vowels
+static const float SLIGHT_DB = -15.0f;     // Slightly open, otherwise narrow
+static const float FRICATIVE = 0.45f;      // Share of energy in the high band for F, S, SH, TH
+static const float NASAL = 0.85f;          // Share in the low band for quiet M, N, B
+static const float NASAL_DB = -12.0f;
+static const float PEAK_DECAY = 0.995f;    // Per block, the peak halves in about 3 s of 20 ms blocks
+static const float RELEASE = 0.5f;         // Level falls this much of the way each block, rises at once
+
+static int nextPowerOfTwo(size_t n) {
+    int size = 1;
+    while ((size_t)size < n) size <<= 1;
+    return size;
+}
+
+LipSync::LipSync(int sampleRate) : fft(nextPowerOfTwo(sampleRate / 50)) {
+    samples.resize(fft.size());
+    spectrum.resize(fft.bins());
+    lowBin = max(1, (int)(LOW_HZ * fft.size() / sampleRate));
+    midBin = (int)(MID_HZ * fft.size() / sampleRate);
+    highBin = (int)(HIGH_HZ * fft.size() / sampleRate);
+    topBin = min(fft.bins() - 1, (int)(TOP_HZ * fft.size() / sampleRate));
+}
+
+void LipSync::analyze(const AudioSpan<int16_t>& block, int64_t heardNs) {
+    char next = '_';
+    if (!block.empty()) {
+        // Up to one FFT's worth, blocks are a playback period of about 20 ms
+        size_t count = min(block.size(), samples.size());
+        for (size_t i = 0; i < count; i++) {
+            int16_t sample = i < block.firstSize ? block.first[i] : block.second[i - block.firstSize];
+            samples[i] = sample / 32768.0f;
+        }
+        fft.power(samples.data(), (int)count, spectrum.data());
+
+        float low = 0, mid = 0, high = 0;
+        for (int i = lowBin; i < midBin; i++) low += spectrum[i];
+        for (int i = midBin; i < highBin; i++) mid += spectrum[i];
+        for (int i = highBin; i <= topBin; i++) high += spectrum[i];
+        next = classify(low, mid, high);
+    }
+    else {
+        level = 0;
+    }
+
+    // Only changes go to the render thread
+    if (next == queued) return;
+    queued = next;
+    Change change;
+    change.timeNs = heardNs;
+    change.shape = next;
+    changes.push(change);
+}
+
+char LipSync::classify(float low, float mid, float high) {
+    float energy = low + mid + high;
+    level = energy > level ? energy : level + (energy - level) * RELEASE;
+    peak = max(level, peak * PEAK_DECAY);
+    if (peak <= 0) return '_';
+
+    float db = 10 * log10f(level / peak + 1e-10f);
+    if (db < SILENT_DB) return '_';
+    if (high > energy * FRICATIVE) return 'F';
+    if (low > energy * NASAL && db < NASAL_DB) return 'M';
+    if (db > OPEN_DB) return 'T';
+    if (db > SLIGHT_DB) return 'F';
+    return 'L';
+}
+
+char LipSync::shape(int64_t nowNs) {
+    // Queued in the order they'll be heard
+    while (Change* change = changes.front()) {
+        if (change->timeNs > nowNs) break;
+        current = change->shape;
+        changes.pop();
+    }
+    return current;
+}
@@ -0,0 +1,50 @@
+// Deskman robot.
+// Lip sync module.
+// Thomas Jacobs
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "fft.h"
+#include "audio_ring.h"
+#include "mpsc_queue.h"
+
+// Mouth shapes from the speech being played rather than the transcript, which runs hundreds of ms
+// ahead or behind. Each block's band energies pick a shape, timed to when the block will be heard,
+// and the render thread takes them up once that time comes. Shapes are face.mouth_shape's letters.
+class LipSync {
+public:
+    explicit LipSync(int sampleRate);
+
+    // Playback thread, each block before it goes to the device with when its first sample will be
+    // heard. Empty for silence from then on.
+    void analyze(const AudioSpan<int16_t>& block, int64_t heardNs);
+
+    // Render thread, the shape to show now
+    char shape(int64_t nowNs);
+
+private:
+    struct Change {
+        int64_t timeNs = 0;
+        char shape = '_';
+    };
+
+    char classify(float low, float mid, float high);
+
+    // Playback thread
+    RealFFT fft;
+    std::vector<float> samples;
+    std::vector<float> spectrum;
+    int lowBin, midBin, highBin, topBin;  // Band edges
+    float level = 0;  // Smoothed block energy
+    float peak = 0;  // Loudest recent level, openness is relative to how loud the voice is
+    char queued = '_';
+    MpscQueue<Change> changes;
+
+    // Render thread
+    char current = '_';
+};
+
+// Fed by the playback thread in speak.cpp
+extern LipSync lipSync;
@@ -7,6 +7,8 @@
 #include "screen.h"
 #include "servos.h"
 #include "vector_renderer.h"
+#include "render_thread.h"
+#include "animation.h"
 #include "face_tracker.hpp"
 #include <iostream>
 #include <thread>
@@ -18,6 +20,9 @@ using namespace std;
 // Global vector renderer
 VectorRenderer vectorRenderer;
 
+// Draws the face, on its own thread on Linux
+RenderThread renderThread;
+
 // Global face tracking
 FaceTracker faceTracker(true);  // Enable camera window
 
@@ -25,46 +30,92 @@ int main(int argc, char **argv) {
     // Connect to servos
     open_servos();
 
+    // Face in a window, or FACE_DISPLAY=drm, fbdev or memory to draw it without SDL or X
+    const char* display = getenv("FACE_DISPLAY");
+    string faceDisplay = display ? display : "sdl";
+
     // Create window
     bool fullscreen = false;
     #ifdef __linux__
     fullscreen = true; 
     #endif
-    if (create_window(fullscreen) != 0) printf("Could not create window\n");
+    if (faceDisplay == "sdl" && create_window(fullscreen, false) != 0) printf("Could not create window\n");
+
+    // The face still loads its font, though only the window draws text
+    if (faceDisplay != "sdl") TTF_Init();
 
     // Create face
     face = create_face(screen_width, screen_height);
 
+    // Start drawing, macOS only draws SDL on the main thread
+    bool threaded = faceDisplay != "sdl";
+    #ifdef __linux__
+    threaded = true;
+    #endif
+
+    // FACE_SCALE=0.5 draws the face in the window at half resolution, auto lowers it only while frames are late
+    const char* scale = getenv("FACE_SCALE");
+    string renderScale = scale ? scale : "1";
+    renderThread.setRenderScale(renderScale == "auto" ? 1 : atof(renderScale.c_str()), renderScale == "auto");
+    if (!renderThread.start(vectorRenderer, threaded, faceDisplay)) printf("Could not start rendering\n");
+
     // Start face tracking if camera is available
     if (faceTracker.isCameraAvailable()) {
         faceTracker.startTracking();
     }
 
-    // Animation variables
-    float time = 0.0f;
-    const float animationSpeed = 0.02f;
-    const float maxTilt = 15.0f;
-    const float blinkSpeed = 8.0f;
-    const float blinkInterval = 10.0f;
-    float blinkTimer = 0.0f;
-    bool isBlinking = false;
-
-    // Look direction variables
-    float lookTimer = 0.0f;
-    const float lookInterval = 5.0f;
-    const float eyeMoveDuration = 0.5f;
+    // Animation, in seconds
+    const float EYE_HEIGHT = 120.0f;
+    const float LISTENING_HEIGHT = 145.0f;  // Eyes wide while the robot listens
+    const float BLINK_HEIGHT = 0.1f;  // Of the eye, closed
+    const double BLINK_INTERVAL = 8.3;
+    const double BLINK_TIME = 0.33;
+    const double LOOK_INTERVAL = 5.2;  // From the start of one look to the next
+    const double EYE_MOVE_TIME = 0.4;
+    const double WAIT_TIME = 1.0;  // At each position
+    const float LOOK_TILT = 20.0f;  // Degrees the eyes lead the head by
     const float HEAD_SCALE = 200.0f;  // Scale factor for head movement
-    const float WAIT_DURATION = 1.2f; // Time to wait at each position
-    bool isLooking = false;
-    float targetX = 0.0f;
-    float targetY = 0.0f;
-    float lookTiltX = 0.0f;
-    float lookTiltY = 0.0f;
-    float currentHeadX = 0.0f;
-    float currentHeadY = 0.0f;
-    float lookStartTime = 0.0f;
-    int lookDirection = 0;  // 0: left, 1: right, 2: up, 3: down
-    int lookState = 0;  // 0: initial look, 1: wait1, 2: move, 3: wait2, 4: move back, 5: wait3
+    const bool SHOW_HUD = false;  // Head position in the corner, for tuning
+    const int FRAME_MS = 16;  // Between looks at the camera
+    const int IDLE_MS = 100;  // Longest sleep, so keys don't wait
+
+    // The face's tracks go to the render thread, which moves them every refresh. The head's are
+    // followed here, so only they and the cues wake this loop.
+    Animation animation;
+    Track eyeHeight(EYE_HEIGHT);
+    Track lookTiltX, lookTiltY;  // Face rotation, degrees
+    Track headX, headY;  // Head target, from -1 to 1
+    animation.add(headX);
+    animation.add(headY);
+    float headAtX = 0.0f;  // Where the head was last sent
+    float headAtY = 0.0f;
+    double lookEnd = 0;
+    bool faceSeen = false;
+    bool firstFrame = true;
+    bool wasListening = false;
+    float eyeOpen = EYE_HEIGHT;
+
+    // Blink every so often
+    Animation::Action blink = [&](double at) {
+        eyeHeight.to(at, eyeOpen * BLINK_HEIGHT, BLINK_TIME / 2, Ease::OutSine).then(eyeOpen, BLINK_TIME / 2, Ease::InSine);
+        animation.cue(at + BLINK_INTERVAL, blink);
+    };
+    animation.cue(Animation::now() + BLINK_INTERVAL, blink);
+
+    // Look somewhere random with the eyes, the head follows as the eyes come back to the middle,
+    // wait, then the head goes back. Not while someone's in view.
+    Animation::Action look = [&](double at) {
+        animation.cue(at + LOOK_INTERVAL, look);
+        if (faceSeen) return;
+        float x = (rand() % 200 - 100) / 100.0f;
+        float y = (rand() % 200 - 100) / 100.0f;
+        lookTiltX.to(at, x * LOOK_TILT, EYE_MOVE_TIME).then(0, EYE_MOVE_TIME);
+        lookTiltY.to(at, y * LOOK_TILT, EYE_MOVE_TIME).then(0, EYE_MOVE_TIME);
+        headX.to(at + EYE_MOVE_TIME, x, 0).then(x, WAIT_TIME).then(0, 0);
+        headY.to(at + EYE_MOVE_TIME, y, 0).then(y, WAIT_TIME).then(0, 0);
+        lookEnd = at + EYE_MOVE_TIME + 2 * WAIT_TIME;
+    };
+    animation.cue(Animation::now() + LOOK_INTERVAL, look);
 
     // Speech
     bool quit = false;
@@ -94,6 +145,9 @@ int main(int argc, char **argv) {
             // Quit on ESC
             if (event.type == SDL_QUIT || (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE)) quit = true;
 
+            // Window shown or exposed again, what's on screen may be gone
+            if (event.type == SDL_WINDOWEVENT) renderThread.redraw();
+
             // Adjust face with keys
             if (event.type == SDL_KEYDOWN) {
                 if (event.key.keysym.sym == SDLK_UP)    { move_head(0, 40); update_face(&face, 0, 1); }
@@ -110,177 +164,68 @@ int main(int argc, char **argv) {
             }
         }
 
-        // Update face tracking if camera is available
+        // Someone in view, stop looking around and look at them
+        double now = Animation::now();
         float faceX, faceY;
-        if (faceTracker.isCameraAvailable() && faceTracker.getFacePosition(faceX, faceY)) {
-            // Update look target
-            targetX = faceX;
-            targetY = faceY;
-            
-            // Move head to follow face (temporarily disabled)
-            // move_head(targetX * HEAD_SCALE, targetY * HEAD_SCALE);
-            currentHeadX = targetX;
-            currentHeadY = targetY;
+        bool changed = false;
+        faceSeen = faceTracker.isCameraAvailable() && faceTracker.getFacePosition(faceX, faceY);
+        if (faceSeen && now < lookEnd) {
+            lookTiltX.to(now, 0, EYE_MOVE_TIME);
+            lookTiltY.to(now, 0, EYE_MOVE_TIME);
+            headX.to(now, 0, 0);
+            headY.to(now, 0, 0);
+            lookEnd = now;
+            changed = true;
         }
 
+        // Move head to follow face (temporarily disabled)
+        // if (faceSeen) { headX.to(now, faceX, 0); headY.to(now, faceY, 0); }
+
         // Update camera window from main thread
         faceTracker.updateWindow();
 
-        // Update animation
-        time += animationSpeed;
-        float tiltX = 0; //sin(time) * maxTilt;
-        float tiltY = 0; //cos(time * 0.5f) * maxTilt * 0.3f;
-
-        // Update looking behavior
-        lookTimer += 0.016f;  // Assuming ~60fps
-        if (!isLooking && lookTimer >= lookInterval && !faceTracker.getFacePosition(faceX, faceY)) {
-            isLooking = true;
-            lookTimer = 0.0f;
-            lookStartTime = time;
-            
-            // Cycle through directions
-            switch(lookDirection) {
-                case 0:  // Left
-                    targetX = -1.0f;
-                    targetY = 0.0f;
-                    break;
-                case 1:  // Right
-                    targetX = 1.0f;
-                    targetY = 0.0f;
-                    break;
-                case 2:  // Up
-                    targetX = 0.0f;
-                    targetY = -1.0f;
-                    break;
-                case 3:  // Down
-                    targetX = 0.0f;
-                    targetY = 1.0f;
-                    break;
-            }
-            lookDirection = (lookDirection + 1) % 4;
-
-            // Choose random look target (-1 to 1 range)
-            targetX = (rand() % 200 - 100) / 100.0f;
-            targetY = (rand() % 200 - 100) / 100.0f;
-            
-            // Reset current positions
-            lookTiltX = 0.0f;
-            lookTiltY = 0.0f;
-            currentHeadX = 0.0f;
-            currentHeadY = 0.0f;
-        }
-
-        // Look
-        if (isLooking && !faceTracker.getFacePosition(faceX, faceY)) {
-            float lookTime = time - lookStartTime;
-            
-            switch (lookState) {
-                case 0:  // Initial look with eye movement
-                    if (lookTime < eyeMoveDuration) {
-                        float t = lookTime / eyeMoveDuration;
-                        lookTiltX = targetX * t * 20.0f;
-                        lookTiltY = targetY * t * 20.0f;
-                    } else {
-                        lookState = 2;
-                        lookStartTime = time;  // Reset timer for next state
-                    }
-                    break;
-
-                case 2:  // Move head
-                    move_head(targetX * HEAD_SCALE, targetY * HEAD_SCALE);
-                    currentHeadX = targetX;
-                    currentHeadY = targetY;
-
-                    // Start transitioning eyes back
-                    lookState = 3;
-                    lookStartTime = time;
-                    break;
-
-                case 3:  // Wait at new position and transition eyes back
-                    if (lookTime < eyeMoveDuration) {
-                        float t = lookTime / eyeMoveDuration;
-                        lookTiltX = targetX * (1.0f - t) * 20.0f;  // Smoothly reduce tilt
-                        lookTiltY = targetY * (1.0f - t) * 20.0f;
-                    } else if (lookTime >= WAIT_DURATION) {
-                        lookState = 4;  // Move to return movement state
-                        lookStartTime = time;
-                        lookTiltX = 0.0f;  // Ensure eyes are centered
-                        lookTiltY = 0.0f;
-                    }
-                    break;
-
-                case 4:  // Move back
-                    move_head(-targetX * HEAD_SCALE, -targetY * HEAD_SCALE);  // Move back by negating the target
-                    currentHeadX = 0.0f;
-                    currentHeadY = 0.0f;
-                    lookState = 5;  // Move to final wait state
-                    lookStartTime = time;
-                    break;
-
-                case 5:  // Final wait before ending cycle
-                    if (lookTime >= WAIT_DURATION) {
-                        lookTiltX = 0.0f;
-                        lookTiltY = 0.0f;
-                        isLooking = false;
-                        lookState = 0;  // Reset state for next cycle
-                    }
-                    break;
-            }
+        // Eyes open wide while the speech thread records a turn, it doesn't wait for this
+        if (listening != wasListening) {
+            wasListening = listening;
+            eyeOpen = wasListening ? LISTENING_HEIGHT : EYE_HEIGHT;
+            eyeHeight.to(now, eyeOpen, EYE_MOVE_TIME);
+            changed = true;
         }
 
-        // Apply combined rotation to the face (base animation + looking tilt)
-        float finalTiltX = sin(time) * maxTilt + lookTiltX;
-        float finalTiltY = cos(time * 0.5f) * maxTilt * 0.3f + lookTiltY;
-        vectorRenderer.setFaceRotation(Vec3(-lookTiltY, lookTiltX, 0));
-
-        // Update blinking
-        blinkTimer += animationSpeed;
-        if (!isBlinking && blinkTimer >= blinkInterval) {
-            isBlinking = true;
-            blinkTimer = 0.0f;
+        // Cues that came due
+        if (animation.update(now)) changed = true;
+
+        // Head to where its tracks say
+        float x = headX.at(now);
+        float y = headY.at(now);
+        if (x != headAtX || y != headAtY) {
+            move_head((x - headAtX) * HEAD_SCALE, (y - headAtY) * HEAD_SCALE);
+            headAtX = x;
+            headAtY = y;
+            if (SHOW_HUD) changed = true;
         }
 
-        // Animate eyes
-        float blinkProgress = 0.0f;
-        if (isBlinking) {
-            blinkProgress = sin(blinkTimer * blinkSpeed);
-            if (blinkProgress < 0) {
-                isBlinking = false;
-                blinkProgress = 0.0f;
+        // Hand new tracks to the render thread, dropping keys it's already past
+        if (changed || firstFrame) {
+            string hud;
+            if (SHOW_HUD) {
+                char coordText[100];
+                snprintf(coordText, sizeof(coordText), "Head X: %.1f  Y: %.1f", headAtX * HEAD_SCALE, headAtY * HEAD_SCALE);
+                hud = coordText;
             }
+            lookTiltX.at(now);
+            lookTiltY.at(now);
+            eyeHeight.at(now);
+            renderThread.publish({ lookTiltX, lookTiltY, eyeHeight, hud });
+            firstFrame = false;
         }
 
-        // Update eye shapes
-        float baseHeight = 120.0f;
-        float eyeHeight = baseHeight * (1.0f - blinkProgress * 0.9f);
-        face.leftEye->radiusY = eyeHeight;
-        face.rightEye->radiusY = eyeHeight;
-
-        // Clear the screen
-        SDL_SetRenderDrawColor(renderer, 255,255,255,255);
-        SDL_RenderClear(renderer);
-
-        // Render the face
-        vectorRenderer.render(renderer);
-
-        // Draw coordinate text
-        char coordText[100];
-        snprintf(coordText, sizeof(coordText), "Head X: %.1f  Y: %.1f", currentHeadX * HEAD_SCALE, currentHeadY * HEAD_SCALE);
-        SDL_Color textColor = {0, 0, 0, 255};
-        SDL_Surface* textSurface = TTF_RenderText_Solid(face.font, coordText, textColor);
-        if (textSurface != NULL) {
-            SDL_Texture* textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
-            SDL_Rect textRect = {10, 10, textSurface->w, textSurface->h};
-            //SDL_RenderCopy(renderer, textTexture, NULL, &textRect);
-            SDL_FreeSurface(textSurface);
-            SDL_DestroyTexture(textTexture);
+        // Wait, drawing first if that happens here. Sleep until the next cue or head move, the face moves
+        // without this loop, but the camera wants looking at every frame.
+        if (!renderThread.step()) {
+            double waitMs = faceTracker.isCameraAvailable() ? FRAME_MS : min((double)IDLE_MS, (animation.next(now) - Animation::now()) * 1000);
+            SDL_Delay((Uint32)max(0.0, waitMs));
         }
-
-        // Present the updated screen
-        SDL_RenderPresent(renderer);
-
-        // Wait
-        SDL_Delay(16);
     }
 
     // Set quit flag and wait for threads to finish
@@ -295,6 +240,9 @@ int main(int argc, char **argv) {
     // Stop face tracking
     faceTracker.stopTracking();
 
+    // Stop drawing
+    renderThread.stop();
+
     // Done
     close_window();
     return 0;
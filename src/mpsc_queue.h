@@ -0,0 +1,56 @@
+// Deskman robot.
+// Multi producer queue module.
+// Thomas Jacobs
+
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+// Unbounded multi producer, single consumer queue, Vyukov's linked list with a dummy head.
+// A push is one allocation and one atomic exchange, so any thread can queue without taking a lock,
+// and only the consumer thread ever looks at the front. Meant for low rate traffic like control events.
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() : head(new Node), tail(head.load()) { }
+
+    ~MpscQueue() {
+        while (front()) pop();
+        delete tail;
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // Any thread
+    void push(T value) {
+        Node* node = new Node;
+        node->value = std::move(value);
+        Node* previous = head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    // Consumer only, nullptr if empty or a push is half way through
+    T* front() {
+        Node* next = tail->next.load(std::memory_order_acquire);
+        return next ? &next->value : nullptr;
+    }
+
+    // Consumer only, drops the front, which must exist
+    void pop() {
+        Node* next = tail->next.load(std::memory_order_acquire);
+        delete tail;
+        tail = next;
+        tail->value = T();
+    }
+
+private:
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+        T value;
+    };
+
+    std::atomic<Node*> head;  // Last pushed
+    Node* tail;               // Dummy, its next is the front
+};
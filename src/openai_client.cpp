@@ -0,0 +1,714 @@
+// Deskman robot.
+// OpenAI realtime client module.
+// Thomas Jacobs
+
+#include "openai_client.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "base64_simd.h"
+#include "g711.h"
+
+// Logging
+#define DEBUG 0
+
+using namespace std;
+using namespace nlohmann;
+
+// Audio waiting for the socket, the uplink holds back once more than the backlog is queued
+static const int UPLINK_QUEUE_MS = 5000;
+static const int UPLINK_BACKLOG_MS = 500;
+
+// Most the service thread writes per writeable callback, and the largest single audio append
+static const size_t WRITE_BUDGET = 64 * 1024;
+static const size_t MAX_APPEND_SAMPLES = OpenAIClient::SAMPLE_RATE / 2;
+
+// Reconnect backoff, lws adds up to 30% random jitter to each step and keeps retrying at the last one.
+// Idle connections are pinged so a dead standby is noticed before it is needed.
+static const uint32_t RECONNECT_BACKOFF_MS[] = { 250, 500, 1000, 2000, 4000, 8000, 16000, 30000 };
+static const lws_retry_bo_t RECONNECT_POLICY = {
+    RECONNECT_BACKOFF_MS, LWS_ARRAY_SIZE(RECONNECT_BACKOFF_MS), LWS_RETRY_CONCEAL_ALWAYS, 20, 40, 30
+};
+
+// G.711 is always 8 kHz
+static const int G711_RATE = 8000;
+
+// TLS session kept across restarts, so the first connection after boot can resume rather than do a full handshake
+static const char* TLS_SESSION_FILE = "tls_session.bin";
+static const uint32_t TLS_SESSION_TIMEOUT_S = 24 * 3600;
+
+// -----------------------------------------------------------
+// RealtimeEndpoint
+// -----------------------------------------------------------
+
+bool RealtimeEndpoint::parse(const string& url) {
+    // Scheme
+    size_t at;
+    if (url.rfind("wss://", 0) == 0) { tls = true; port = 443; at = 6; }
+    else if (url.rfind("ws://", 0) == 0) { tls = false; port = 80; at = 5; }
+    else return false;
+
+    // Host, port and path
+    size_t slash = url.find('/', at);
+    string authority = url.substr(at, slash == string::npos ? string::npos : slash - at);
+    path = slash == string::npos ? "/" : url.substr(slash);
+    size_t colon = authority.rfind(':');
+    if (colon != string::npos) {
+        port = atoi(authority.c_str() + colon + 1);
+        authority.resize(colon);
+    }
+    host = authority;
+    return !host.empty() && port > 0;
+}
+
+RealtimeEndpoint RealtimeEndpoint::fromEnvironment() {
+    RealtimeEndpoint endpoint;
+    const char* url = getenv("REALTIME_URL");
+    if (url && !endpoint.parse(url)) {
+        cerr << "Bad REALTIME_URL, using " << RealtimeEndpoint().host << "." << endl;
+        endpoint = RealtimeEndpoint();
+    }
+    return endpoint;
+}
+
+// -----------------------------------------------------------
+// RealtimeCodec
+// -----------------------------------------------------------
+
+const char* realtimeCodecName(RealtimeCodec codec) {
+    switch (codec) {
+        case RealtimeCodec::G711Ulaw: return "g711_ulaw";
+        case RealtimeCodec::G711Alaw: return "g711_alaw";
+        default: return "pcm16";
+    }
+}
+
+bool parseRealtimeCodec(const string& name, RealtimeCodec& codec) {
+    for (RealtimeCodec c : { RealtimeCodec::Pcm16, RealtimeCodec::G711Ulaw, RealtimeCodec::G711Alaw }) {
+        if (name == realtimeCodecName(c)) {
+            codec = c;
+            return true;
+        }
+    }
+    return false;
+}
+
+// The session config with both audio formats set to the codec
+static json sessionUpdateFor(const json& session, RealtimeCodec codec) {
+    json update { {"type", "session.update"}, {"session", session} };
+    update["session"]["input_audio_format"] = realtimeCodecName(codec);
+    update["session"]["output_audio_format"] = realtimeCodecName(codec);
+    return update;
+}
+
+// -----------------------------------------------------------
+// OpenAIClient
+// -----------------------------------------------------------
+
+OpenAIClient::OpenAIClient(const string& apiKey_, const string& model_, const json& session_, const RealtimeEndpoint& endpoint_) :
+    apiKey(apiKey_), model(model_), session(session_), endpoint(endpoint_),
+    uplinkAudio((size_t)SAMPLE_RATE * UPLINK_QUEUE_MS / 1000), appendScratch(MAX_APPEND_SAMPLES),
+    uplinkResampler(SAMPLE_RATE, G711_RATE), downlinkResampler(G711_RATE, SAMPLE_RATE) {
+    // Every new connection sends the same session config
+    sessionUpdateFrame = string(LWS_PRE, '\0') + sessionUpdateFor(session, sessionCodec).dump();
+
+    // Active and standby connections
+    for (int i = 0; i < 2; i++) {
+        connections[i].client = this;
+        connections[i].retryTimer.connection = &connections[i];
+    }
+}
+
+OpenAIClient::~OpenAIClient() {
+    if (context) {
+        lws_context_destroy(context);
+        context = nullptr;
+    }
+    if (traceFile) fclose(traceFile);
+}
+
+void OpenAIClient::setCodec(RealtimeCodec codec) {
+    // New connections get it from now on
+    json update = sessionUpdateFor(session, codec);
+    {
+        lock_guard<mutex> lock(sessionMutex);
+        sessionUpdateFrame = string(LWS_PRE, '\0') + update.dump();
+        sessionCodec = codec;
+    }
+    cout << "Audio codec " << realtimeCodecName(codec) << "." << endl;
+
+    // The live session switches once the update is written, after the audio queued before it
+    if (!isConnected) return;
+    OutboundEvent outboundEvent;
+    outboundEvent.audioBefore = audioQueued.load();
+    outboundEvent.payload = string(LWS_PRE, '\0') + update.dump();
+    outboundEvent.codec = (int)codec;
+    outbound.push(move(outboundEvent));
+    wakeService();
+}
+
+bool OpenAIClient::recordTrace(const string& path) {
+    traceFile = fopen(path.c_str(), "w");
+    if (!traceFile) {
+        cerr << "Cannot open trace file " << path << "." << endl;
+        return false;
+    }
+    return true;
+}
+
+bool OpenAIClient::start() {
+    // Context
+    struct lws_context_creation_info info;
+    memset(&info, 0, sizeof info);
+
+    // Only log errors and warnings
+    int logs = LLL_ERR | LLL_WARN; //| LLL_INFO;
+    lws_set_log_level(logs, NULL);
+
+    // Configure
+    info.port = CONTEXT_PORT_NO_LISTEN;
+    info.protocols = protocols;
+    info.user = this;
+    info.gid = -1;
+    info.uid = -1;
+    info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+    info.tls_session_timeout = TLS_SESSION_TIMEOUT_S;
+    #ifdef __linux__
+    info.client_ssl_ca_filepath = "/etc/ssl/certs/ca-certificates.crt";
+    #endif
+
+    // Create
+    context = lws_create_context(&info);
+    if (!context) {
+        cerr << "Failed to create lws context." << endl;
+        return false;
+    }
+
+    // Resume the TLS session from last time if there is one
+    struct lws_vhost* vhost = lws_get_vhost_by_name(context, "default");
+    if (vhost && endpoint.tls) lws_tls_session_dump_load(vhost, endpoint.host.c_str(), endpoint.port, loadTlsSession, nullptr);
+
+    // Connect both
+    for (Connection& connection : connections) {
+        connect(connection);
+    }
+    return true;
+}
+
+bool OpenAIClient::waitReady(int timeoutMs) {
+    unique_lock<mutex> lock(readyMutex);
+    return readyChanged.wait_for(lock, chrono::milliseconds(timeoutMs), [this] { return ready.load(); });
+}
+
+void OpenAIClient::serviceLoop() {
+    while (true) {
+        lws_service(context, 50);
+        if (stopRequested) break;
+    }
+}
+
+void OpenAIClient::close() {
+    isConnected = false;
+    stopRequested = true;
+    wakeService();
+}
+
+bool OpenAIClient::canSend() {
+    return isConnected && uplinkAudio.size() < (size_t)SAMPLE_RATE * UPLINK_BACKLOG_MS / 1000;
+}
+
+void OpenAIClient::sendEvent(const json& event) {
+    if (!isConnected) {
+        // The socket is closed
+        cout << "Error: socket is closed." << endl;
+        return;
+    }
+
+    // Trace times are from the last request for a response
+    if (traceFile && event.value("type", "") == "response.create") responseRequestedNs = monotonicNs();
+
+    // The libwebsockets library requires LWS_PRE bytes of space in front for the WS framing.
+    // The event goes out after any audio queued before it, so a commit always follows its audio.
+    OutboundEvent outboundEvent;
+    outboundEvent.audioBefore = audioQueued.load();
+    outboundEvent.payload = string(LWS_PRE, '\0') + event.dump();
+    outbound.push(move(outboundEvent));
+    wakeService();
+}
+
+void OpenAIClient::sendFunctionOutput(const string& callId, const json& output) {
+    json event = {
+        {"type", "conversation.item.create"},
+        {"item", {
+            {"type", "function_call_output"},
+            {"call_id", callId},
+            {"output", output.dump()}
+        }}
+    };
+    sendEvent(event);
+}
+
+void OpenAIClient::sendAudio(const int16_t* samples, size_t count) {
+    if (!isConnected) {
+        cout << "Error: socket is closed." << endl;
+        return;
+    }
+    size_t taken = uplinkAudio.push(samples, count);
+    audioQueued += taken;
+    if (taken < count) cerr << "Uplink queue full, dropped " << count - taken << " samples." << endl;
+    wakeService();
+}
+
+// -----------------------------------------------------------
+// Connections
+// -----------------------------------------------------------
+
+// Open a connection, on failure or close it comes back through onClose
+void OpenAIClient::connect(Connection& connection) {
+    if (stopRequested) return;
+    struct lws_client_connect_info ccinfo = {0};
+    ccinfo.context = context;
+    ccinfo.address = endpoint.host.c_str();
+    ccinfo.host = ccinfo.address;
+    ccinfo.port = endpoint.port;
+    string path = endpoint.path + "?model=" + model;
+    ccinfo.path = path.c_str();
+    ccinfo.origin = "origin";
+    ccinfo.ssl_connection = endpoint.tls ? LCCSCF_USE_SSL : 0;
+    ccinfo.retry_and_idle_policy = &RECONNECT_POLICY;
+    ccinfo.userdata = &connection;
+    ccinfo.pwsi = &connection.wsi;
+    if (!lws_client_connect_via_info(&ccinfo)) {
+        cerr << "Failed to connect to server." << endl;
+        connection.wsi = nullptr;
+
+        // Unless the connection error callback already has
+        if (!connection.retryTimer.sul.list.owner) scheduleReconnect(connection);
+    }
+}
+
+void OpenAIClient::scheduleReconnect(Connection& connection) {
+    if (stopRequested) return;
+    lws_retry_sul_schedule(context, 0, &connection.retryTimer.sul, &RECONNECT_POLICY, onReconnectTimer, &connection.retries);
+}
+
+void OpenAIClient::onReconnectTimer(lws_sorted_usec_list_t* sul) {
+    Connection* connection = reinterpret_cast<RetryTimer*>(sul)->connection;
+    connection->client->connect(*connection);
+}
+
+// Called once a connection is established, it sends "session.update" as soon as it can write
+void OpenAIClient::onConnected(Connection& connection) {
+    connection.rxMessage.clear();
+    connection.needsSessionUpdate = true;
+    lws_callback_on_writable(connection.wsi);
+    if (endpoint.tls && lws_tls_session_is_reused(connection.wsi)) {
+        if (DEBUG) cout << "Resumed TLS session." << endl;
+    }
+}
+
+// A connection's session is configured, the standby just waits to be promoted
+void OpenAIClient::onSessionReady(Connection& connection) {
+    connection.ready = true;
+    connection.retries = 0;
+    if (endpoint.tls) lws_tls_session_dump_save(lws_get_vhost(connection.wsi), endpoint.host.c_str(), endpoint.port, saveTlsSession, nullptr);
+    updateActive();
+}
+
+// Deltas from here on are in whatever format the server now says
+void OpenAIClient::onSessionUpdated(Connection& connection, const json& event) {
+    if (!event.contains("session") || !event["session"].is_object()) return;
+    RealtimeCodec codec;
+    if (parseRealtimeCodec(event["session"].value("output_audio_format", "pcm16"), codec) && codec != connection.outputCodec) {
+        connection.outputCodec = codec;
+        downlinkResampler.reset();
+    }
+}
+
+// Promote the standby if the active connection isn't usable, and publish whether we can talk
+void OpenAIClient::updateActive() {
+    Connection& other = connections[1 - active];
+    if (!connections[active].ready && other.ready) {
+        active = 1 - active;
+        cout << "Switched to standby connection." << endl;
+    }
+    bool nowReady = connections[active].ready;
+    {
+        lock_guard<mutex> lock(readyMutex);
+        ready = nowReady;
+        isConnected = nowReady;
+    }
+    readyChanged.notify_all();
+    if (nowReady) onWakeup();
+}
+
+// Called when a connection closes or fails to open. If it was the active one anything still queued
+// is dropped and any response in progress is given up on. Either way it reconnects after a backoff.
+void OpenAIClient::onClose(Connection& connection) {
+    bool wasActive = &connection == &connections[active] && connection.ready;
+    cout << (wasActive ? "Websocket closed." : "Standby websocket closed.") << endl;
+    connection.wsi = nullptr;
+    connection.ready = false;
+    connection.needsSessionUpdate = false;
+    connection.inputCodec = connection.outputCodec = RealtimeCodec::Pcm16;
+    if (wasActive) {
+        while (outbound.front()) outbound.pop();
+        audioSent += uplinkAudio.clear();
+        talking = false;
+    }
+    updateActive();
+    scheduleReconnect(connection);
+}
+
+// Keep the TLS session in a file
+int OpenAIClient::saveTlsSession(struct lws_context*, struct lws_tls_session_dump* info) {
+    FILE* file = fopen(TLS_SESSION_FILE, "wb");
+    if (!file) return 1;
+    fwrite(info->blob, 1, info->blob_len, file);
+    fclose(file);
+    return 0;
+}
+
+// Read it back, lws frees the blob
+int OpenAIClient::loadTlsSession(struct lws_context*, struct lws_tls_session_dump* info) {
+    FILE* file = fopen(TLS_SESSION_FILE, "rb");
+    if (!file) return 1;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    void* blob = size > 0 ? malloc(size) : nullptr;
+    if (!blob || fread(blob, 1, size, file) != (size_t)size) {
+        free(blob);
+        fclose(file);
+        return 1;
+    }
+    fclose(file);
+    info->blob = blob;
+    info->blob_len = size;
+    return 0;
+}
+
+// -----------------------------------------------------------
+// Receiving
+// -----------------------------------------------------------
+
+// Handler for incoming messages
+void OpenAIClient::onMessage(Connection& connection, const char* data, size_t size) {
+    // The standby only sets itself up
+    if (&connection != &connections[active] || !connection.ready) {
+        onStandbyMessage(connection, data, size);
+        return;
+    }
+    if (traceFile) traceMessage(data, size);
+
+    // Audio deltas are most of the traffic, decode them in place without a DOM
+    if (scanner.scan(data, size) && scanner.string("type") == "response.audio.delta") {
+        string_view delta = scanner.string("delta");
+        if (!delta.empty()) {
+            playDelta(delta);
+            return;
+        }
+    }
+
+    // Parse JSON
+    //cout << string(data, size) << endl;
+    auto j = json::parse(data, data + size, nullptr, false);
+    if (j.is_discarded()) {
+        cerr << "Bad JSON: " << string(data, size) << endl;
+        return;
+    }
+    if (j.contains("type")) {
+        string type = j["type"].get<string>();
+        if (type == "response.audio_transcript.delta" || type == "response.text.delta") {
+            if (handlers.transcript) handlers.transcript(j["delta"].get<string>());
+        }
+        else if (type == "response.audio.done") {
+            if (handlers.audioDone) handlers.audioDone();
+        }
+        else if (type == "response.function_call_arguments.done") {
+            // Parse the complete function arguments
+            auto args = json::parse(j["arguments"].get<string>(), nullptr, false);
+            if (args.is_discarded()) {
+                cerr << "Bad function arguments: " << j.dump() << endl;
+                return;
+            }
+            if (handlers.functionCall) handlers.functionCall(j.value("call_id", ""), j["name"].get<string>(), args);
+        }
+        else if (type == "response.audio.delta") {
+            // Only here if the delta had escapes in it
+            playDelta(j["delta"].get_ref<const string&>());
+        }
+        else if (type == "session.updated") {
+            onSessionUpdated(connection, j);
+        }
+        else if (type == "response.done") {
+            cout << "Response generation completed.\n";
+            talking = false;
+            if (handlers.responseDone) handlers.responseDone();
+        }
+        else if (type == "error") {
+            cerr << "Error event received: " << j.dump() << endl;
+        }
+        else {
+            if (DEBUG) cout << "Event: " << j["type"] << ": " << j.dump() << endl;
+        }
+    }
+}
+
+// Messages on a connection that isn't in use yet
+void OpenAIClient::onStandbyMessage(Connection& connection, const char* data, size_t size) {
+    auto j = json::parse(data, data + size, nullptr, false);
+    if (j.is_discarded() || !j.contains("type")) return;
+    string type = j["type"].get<string>();
+    if (type == "session.updated") {
+        if (DEBUG) cout << "Event: " << j.dump() << endl;
+        onSessionUpdated(connection, j);
+        onSessionReady(connection);
+    }
+    else if (type == "error") {
+        cerr << "Error event received: " << j.dump() << endl;
+    }
+}
+
+// Base64 decode an audio delta straight into samples and hand it on
+void OpenAIClient::playDelta(string_view b64data) {
+    // G.711 goes through bytes and back up to the API's rate
+    RealtimeCodec codec = connections[active].outputCodec;
+    if (codec != RealtimeCodec::Pcm16) {
+        codecBytes.resize(base64DecodedSize(b64data.size()));
+        size_t bytes = base64DecodeTo(b64data.data(), b64data.size(), codecBytes.data());
+        if (bytes == SIZE_MAX) {
+            cerr << "Bad base64 in audio delta." << endl;
+            return;
+        }
+        size_t count = decodeG711(codec, codecBytes.data(), bytes);
+        if (handlers.audio && count > 0) handlers.audio(deltaSamples.data(), count);
+        return;
+    }
+
+    deltaSamples.resize(base64DecodedSize(b64data.size()) / 2 + 1);
+    size_t count = base64DecodePcm(b64data.data(), b64data.size(), deltaSamples.data());
+    if (count == SIZE_MAX) {
+        cerr << "Bad base64 in audio delta." << endl;
+        return;
+    }
+    if (handlers.audio) handlers.audio(deltaSamples.data(), count);
+}
+
+// One line per event, the raw message wrapped with its time, only events that follow a request
+void OpenAIClient::traceMessage(const char* data, size_t size) {
+    int64_t requested = responseRequestedNs.load();
+    if (!requested) return;
+    fprintf(traceFile, "{\"t\":%.3f,\"event\":", (monotonicNs() - requested) / 1e6);
+    fwrite(data, 1, size, traceFile);
+    fputs("}\n", traceFile);
+}
+
+// -----------------------------------------------------------
+// Sending
+// -----------------------------------------------------------
+
+// Have the service thread come round and write, safe from any thread
+void OpenAIClient::wakeService() {
+    if (context) lws_cancel_service(context);
+}
+
+// On the service thread, ask for a writeable callback on the active connection if anything is queued
+void OpenAIClient::onWakeup() {
+    Connection& connection = connections[active];
+    if (connection.wsi && connection.ready && (outbound.front() || uplinkAudio.size() > 0)) lws_callback_on_writable(connection.wsi);
+}
+
+// On the service thread, write queued audio and events in order until the budget is spent or the socket is full.
+// Audio queued since the last callback goes out as one append, and several small events can go in one callback.
+void OpenAIClient::onWriteable(Connection& connection) {
+    struct lws* wsi = connection.wsi;
+
+    // A new connection configures its session first
+    if (connection.needsSessionUpdate) {
+        connection.needsSessionUpdate = false;
+        string frame;
+        {
+            lock_guard<mutex> lock(sessionMutex);
+            frame = sessionUpdateFrame;
+            if (connection.inputCodec != sessionCodec && &connection == &connections[active]) uplinkResampler.reset();
+            connection.inputCodec = sessionCodec;
+        }
+        size_t length = frame.size() - LWS_PRE;
+        lws_write(wsi, (unsigned char*)frame.data() + LWS_PRE, length, LWS_WRITE_TEXT);
+        return;
+    }
+
+    // Only the active connection sends anything else
+    if (&connection != &connections[active] || !connection.ready) return;
+    size_t budget = WRITE_BUDGET;
+    while (budget > 0 && !lws_send_pipe_choked(wsi)) {
+        OutboundEvent* event = outbound.front();
+        uint64_t audioLimit = event ? event->audioBefore : UINT64_MAX;
+
+        // Audio that was queued before the next event goes first
+        if (audioSent < audioLimit && uplinkAudio.size() > 0) {
+            size_t samples = min<uint64_t>(uplinkAudio.size(), audioLimit - audioSent);
+            samples = min(samples, min(MAX_APPEND_SAMPLES, budget * 3 / 8));
+            if (samples == 0) break;
+            AudioSpan<int16_t> span = uplinkAudio.peek(samples);
+            const int16_t* pcm = span.data(appendScratch.data());
+            size_t bytes = span.size() * sizeof(int16_t);
+            const uint8_t* data = reinterpret_cast<const uint8_t*>(pcm);
+            if (connection.inputCodec != RealtimeCodec::Pcm16) {
+                bytes = encodeG711(connection.inputCodec, pcm, span.size());
+                data = codecBytes.data();
+            }
+            size_t length = 0;
+            if (bytes > 0) {
+                size_t chars = base64EncodeTo(data, bytes, appendEvent.value(base64EncodedSize(bytes)));
+                unsigned char* frame = appendEvent.frame(chars, length);
+                if (lws_write(wsi, frame, length, LWS_WRITE_TEXT) < (int)length) return;
+            }
+            uplinkAudio.consume(span.size());
+            audioSent += span.size();
+            budget -= min(budget, length);
+            continue;
+        }
+
+        // Then the event
+        if (!event) break;
+        size_t length = event->payload.size() - LWS_PRE;
+        if (lws_write(wsi, (unsigned char*)event->payload.data() + LWS_PRE, length, LWS_WRITE_TEXT) < (int)length) return;
+        if (event->codec >= 0) onCodecSent(connection, (RealtimeCodec)event->codec);
+        outbound.pop();
+        budget -= min(budget, length);
+    }
+
+    // More to do
+    onWakeup();
+}
+
+// The active session has been told to switch, later appends use the new codec and the standby is told too
+void OpenAIClient::onCodecSent(Connection& connection, RealtimeCodec codec) {
+    if (connection.inputCodec != codec) uplinkResampler.reset();
+    connection.inputCodec = codec;
+    Connection& standby = connections[1 - active];
+    if (standby.wsi && !standby.needsSessionUpdate) {
+        standby.needsSessionUpdate = true;
+        lws_callback_on_writable(standby.wsi);
+    }
+}
+
+// -----------------------------------------------------------
+// G.711
+// -----------------------------------------------------------
+
+// Uplink audio down to 8 kHz and compressed, into codecBytes
+size_t OpenAIClient::encodeG711(RealtimeCodec codec, const int16_t* samples, size_t count) {
+    codecFloat.resize(uplinkResampler.maxOutput(count));
+    size_t n = uplinkResampler.process(samples, count, codecFloat.data());
+    codecPcm.resize(n);
+    floatToInt16(codecFloat.data(), codecPcm.data(), n);
+    codecBytes.resize(n);
+    if (codec == RealtimeCodec::G711Ulaw) g711EncodeUlaw(codecPcm.data(), n, codecBytes.data());
+    else g711EncodeAlaw(codecPcm.data(), n, codecBytes.data());
+    return n;
+}
+
+// Downlink audio expanded and brought up to the API's rate, into deltaSamples
+size_t OpenAIClient::decodeG711(RealtimeCodec codec, const uint8_t* bytes, size_t count) {
+    codecPcm.resize(count);
+    if (codec == RealtimeCodec::G711Ulaw) g711DecodeUlaw(bytes, count, codecPcm.data());
+    else g711DecodeAlaw(bytes, count, codecPcm.data());
+    codecFloat.resize(downlinkResampler.maxOutput(count));
+    size_t n = downlinkResampler.process(codecPcm.data(), count, codecFloat.data());
+    deltaSamples.resize(n);
+    floatToInt16(codecFloat.data(), deltaSamples.data(), n);
+    return n;
+}
+
+// -----------------------------------------------------------
+// The libwebsockets callback
+// -----------------------------------------------------------
+
+int OpenAIClient::callback(struct lws* wsi, enum lws_callback_reasons reason, void* user, void* in, size_t len) {
+    auto* connection = reinterpret_cast<Connection*>(lws_wsi_user(wsi));
+    auto* client = connection ? connection->client : nullptr;
+    //if (DEBUG) printf("Callback reason: %d\n", reason);
+    switch (reason) {
+        case LWS_CALLBACK_CLIENT_APPEND_HANDSHAKE_HEADER:
+            {
+                // The 'in' is a pointer to pointer to the free space in the buffer, 'len' is how much space we have
+                unsigned char** p = (unsigned char**) in;
+                unsigned char* end = (*p) + len;
+
+                // Add "Authorization: Bearer <key>"
+                string authValue = "Bearer " + client->apiKey;
+                int ret = lws_add_http_header_by_name(wsi,
+                    (unsigned char*)"Authorization:",
+                    (unsigned char*)authValue.c_str(),
+                    authValue.size(),
+                    p, end);
+
+                // Add "OpenAI-Beta: realtime=v1"
+                ret = lws_add_http_header_by_name(wsi,
+                    (unsigned char*)"OpenAI-Beta:",
+                    (unsigned char*)"realtime=v1",
+                    strlen("realtime=v1"),
+                    p, end);
+            }
+            break;
+        case LWS_CALLBACK_CLIENT_ESTABLISHED:
+            // Connection established
+            printf("Connected to %s.\n", client->endpoint.host.c_str());
+            client->onConnected(*connection);
+            break;
+        case LWS_CALLBACK_CLIENT_RECEIVE:
+            // Received part of a message, large ones come in several fragments and buffer loads
+            if (in && len > 0) {
+                connection->rxMessage.append((char *)in, len);
+            }
+            if (lws_is_final_fragment(wsi) && lws_remaining_packet_payload(wsi) == 0) {
+                client->onMessage(*connection, connection->rxMessage.data(), connection->rxMessage.size());
+                connection->rxMessage.clear();
+            }
+            break;
+        case LWS_CALLBACK_CLIENT_WRITEABLE:
+            // Room to write
+            client->onWriteable(*connection);
+            break;
+        case LWS_CALLBACK_EVENT_WAIT_CANCELLED:
+            // Another thread queued something, this comes without a connection so find the client from the context
+            client = reinterpret_cast<OpenAIClient*>(lws_context_user(lws_get_context(wsi)));
+            if (client) client->onWakeup();
+            break;
+        case LWS_CALLBACK_CLIENT_CLOSED:
+            if (client) client->onClose(*connection);
+            break;
+        case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+            cout << "Connection error:" << endl;
+            if (in && len > 0) {
+                string msg((char*)in, len);
+                cout << msg << endl;
+            }
+            if (client) client->onClose(*connection);
+            break;
+        default:
+            if (DEBUG) {
+                //cout << "Other:" << endl;
+                if (in && len > 0) {
+                    string msg((char*)in, len);
+                    cout << msg << endl;
+                }
+            }
+            break;
+    }
+    return 0;
+}
+
+// Definition of the websocket protocols
+struct lws_protocols OpenAIClient::protocols[] = {
+    {
+        "realtime-protocol",
+        callback,
+        100*1024, // Per-session data size
+        100*1024, // Receive buffer size
+    },
+    { nullptr, nullptr, 0, 0 }
+};
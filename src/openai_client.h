@@ -0,0 +1,209 @@
+// Deskman robot.
+// OpenAI realtime client module.
+// Thomas Jacobs
+
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <functional>
+#include <condition_variable>
+#include <libwebsockets.h>
+#include <nlohmann/json.hpp>
+#include "audio_ring.h"
+#include "resampler.h"
+#include "event_template.h"
+#include "event_scanner.h"
+#include "mpsc_queue.h"
+
+// Where the realtime API lives. The defaults are the live service, a ws:// URL points the client
+// at something local instead, like the mock server the latency benchmark runs against.
+struct RealtimeEndpoint {
+    std::string host = "api.openai.com";
+    int port = 443;
+    bool tls = true;
+    std::string path = "/v1/realtime";
+
+    // ws://host[:port][/path] or wss://..., false if it doesn't parse
+    bool parse(const std::string& url);
+
+    // From REALTIME_URL if it is set, otherwise the live service
+    static RealtimeEndpoint fromEnvironment();
+};
+
+// Audio formats the API takes. G.711 is 8 kHz at a byte a sample, a sixth of the bytes of 24 kHz PCM.
+enum class RealtimeCodec { Pcm16, G711Ulaw, G711Alaw };
+
+// As named in the session config, "pcm16", "g711_ulaw" or "g711_alaw"
+const char* realtimeCodecName(RealtimeCodec codec);
+bool parseRealtimeCodec(const std::string& name, RealtimeCodec& codec);
+
+// Websocket client for the realtime API. A service thread owns the sockets, keeps a configured
+// standby session ready to take over, and does all the writing. Other threads queue audio and events,
+// and hear back through the handlers, which are all called on the service thread.
+class OpenAIClient {
+private:
+    // One websocket to the API, with its own backoff and reassembly buffer
+    struct Connection;
+    struct RetryTimer {
+        lws_sorted_usec_list_t sul;   // First, lws hands this back to the timer callback
+        Connection* connection;
+    };
+    struct Connection {
+        OpenAIClient* client = nullptr;
+        struct lws* wsi = nullptr;
+        bool ready = false;                // Session configured
+        bool needsSessionUpdate = false;
+        uint16_t retries = 0;
+        RealtimeCodec inputCodec = RealtimeCodec::Pcm16;    // What appends are encoded as
+        RealtimeCodec outputCodec = RealtimeCodec::Pcm16;   // What deltas arrive as
+        RetryTimer retryTimer = {};
+        std::string rxMessage;             // Message being put back together from its fragments
+    };
+
+public:
+    // The API's PCM rate, both ways
+    static const int SAMPLE_RATE = 24000;
+
+    // What the rest of the robot hears about, all on the service thread
+    struct Handlers {
+        std::function<void(const int16_t* samples, size_t count)> audio;                  // Decoded audio delta
+        std::function<void()> audioDone;                                                  // Response has no more audio
+        std::function<void(const std::string& text)> transcript;                          // Transcript or text delta
+        std::function<void(const std::string& callId, const std::string& name, const nlohmann::json& args)> functionCall;
+        std::function<void()> responseDone;
+    };
+
+    OpenAIClient(const std::string& apiKey, const std::string& model, const nlohmann::json& session,
+                 const RealtimeEndpoint& endpoint = RealtimeEndpoint());
+    ~OpenAIClient();
+
+    // Set before start
+    void setHandlers(const Handlers& h) { handlers = h; }
+
+    // Audio format on the wire, the handlers and sendAudio stay at SAMPLE_RATE either way.
+    // Before start this only changes the session config, after it a session.update goes out in order with the audio.
+    void setCodec(RealtimeCodec codec);
+
+    // Append every received event to a file with its time since the last response.create, for the mock server to replay
+    bool recordTrace(const std::string& path);
+
+    // Create the lws context and start connecting both the active and standby sessions, they are
+    // set up in the background and kept connected from then on
+    bool start();
+
+    // Wait for a session to be ready, false on timeout
+    bool waitReady(int timeoutMs);
+
+    // Service loop, returns after close
+    void serviceLoop();
+    void close();
+
+    // True while the uplink queue has room, so the caller can hold audio back when the connection is slow
+    bool canSend();
+
+    // Queue an event for the service thread, any thread can call this
+    void sendEvent(const nlohmann::json& event);
+
+    // Queue a function call's output as a conversation item, any thread can call this
+    void sendFunctionOutput(const std::string& callId, const nlohmann::json& output);
+
+    // Queue audio to append to the input buffer, from one thread only
+    void sendAudio(const int16_t* samples, size_t count);
+
+    // Flags
+    std::atomic<bool> ready{false};
+    std::atomic<bool> talking{false};
+    std::atomic<bool> isConnected{false};
+
+private:
+    // Connection lifetime, on the service thread
+    void connect(Connection& connection);
+    void scheduleReconnect(Connection& connection);
+    void onConnected(Connection& connection);
+    void onSessionReady(Connection& connection);
+    void onSessionUpdated(Connection& connection, const nlohmann::json& event);
+    void updateActive();
+    void onClose(Connection& connection);
+    static void onReconnectTimer(lws_sorted_usec_list_t* sul);
+
+    // Receiving
+    void onMessage(Connection& connection, const char* data, size_t size);
+    void onStandbyMessage(Connection& connection, const char* data, size_t size);
+    void playDelta(std::string_view b64data);
+    void traceMessage(const char* data, size_t size);
+
+    // Sending
+    void wakeService();
+    void onWakeup();
+    void onWriteable(Connection& connection);
+    void onCodecSent(Connection& connection, RealtimeCodec codec);
+
+    // G.711 either side of the socket, on the service thread
+    size_t encodeG711(RealtimeCodec codec, const int16_t* samples, size_t count);
+    size_t decodeG711(RealtimeCodec codec, const uint8_t* bytes, size_t count);
+
+    // TLS session kept in a file
+    static int saveTlsSession(struct lws_context*, struct lws_tls_session_dump* info);
+    static int loadTlsSession(struct lws_context*, struct lws_tls_session_dump* info);
+
+    static int callback(struct lws* wsi, enum lws_callback_reasons reason, void* user, void* in, size_t len);
+
+    // An event waiting for the service thread
+    struct OutboundEvent {
+        uint64_t audioBefore = 0;  // Audio samples queued ahead of it
+        std::string payload;       // LWS_PRE bytes then the JSON
+        int codec = -1;            // A session.update that switches the uplink codec once written
+    };
+
+    // Data
+    static struct lws_protocols protocols[];
+    struct lws_context* context = nullptr;
+    std::atomic<bool> stopRequested{false};
+    Handlers handlers;
+
+    // Where and who
+    std::string apiKey;
+    std::string model;
+    nlohmann::json session;
+    RealtimeEndpoint endpoint;
+
+    // Connections, the service thread switches between them
+    Connection connections[2];
+    int active = 0;
+
+    // Session config for new connections, setCodec swaps it from other threads
+    std::mutex sessionMutex;
+    std::string sessionUpdateFrame;
+    RealtimeCodec sessionCodec = RealtimeCodec::Pcm16;
+
+    // Readiness for other threads
+    std::mutex readyMutex;
+    std::condition_variable readyChanged;
+
+    // Outbound, filled by other threads and drained by the service thread
+    MpscQueue<OutboundEvent> outbound;
+    AudioFifo<int16_t> uplinkAudio;
+    std::atomic<uint64_t> audioQueued{0};
+    uint64_t audioSent = 0;
+    EventTemplate appendEvent = EventTemplate({ {"type", "input_audio_buffer.append"} }, "audio");
+    std::vector<int16_t> appendScratch;
+
+    // Inbound
+    EventScanner scanner;
+    std::vector<int16_t> deltaSamples;
+
+    // G.711 conversion
+    Resampler uplinkResampler;
+    Resampler downlinkResampler;
+    std::vector<float> codecFloat;
+    std::vector<int16_t> codecPcm;
+    std::vector<uint8_t> codecBytes;
+
+    // Trace recording
+    FILE* traceFile = nullptr;
+    std::atomic<int64_t> responseRequestedNs{0};
+};
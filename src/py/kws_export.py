@@ -0,0 +1,93 @@
+# Deskman robot.
+# Keyword spotter export.
+# Thomas Jacobs
+#
+# Writes a trained DS-CNN as the GGUF file kws.cpp loads. Train on 40 log-mel energies per 20 ms
+# (30 ms Hann window, 20-7600 Hz, log(x + 1e-6)) over 49 frames, input shaped [batch, 1, frames, mel].
+#
+#   pip install torch gguf
+#   python kws_export.py checkpoint.pt ../wakeword/kws.gguf --keyword 2
+
+import argparse
+import torch
+import torch.nn as nn
+import gguf
+
+class DSCNN(nn.Module):
+    """conv0 then depthwise separable blocks, each conv followed by batch norm and relu"""
+    def __init__(self, classes=3, channels=64, blocks=4, kernel=(10, 4), stride=(2, 2), padding=(4, 1)):
+        super().__init__()
+        self.conv0 = nn.Conv2d(1, channels, kernel, stride, padding, bias=False)
+        self.bn0 = nn.BatchNorm2d(channels)
+        self.blocks = nn.ModuleList()
+        for _ in range(blocks):
+            self.blocks.append(nn.ModuleDict({
+                "dw": nn.Conv2d(channels, channels, 3, 1, 1, groups=channels, bias=False),
+                "dw_bn": nn.BatchNorm2d(channels),
+                "pw": nn.Conv2d(channels, channels, 1, bias=False),
+                "pw_bn": nn.BatchNorm2d(channels),
+            }))
+        self.fc = nn.Linear(channels, classes)
+
+    def forward(self, x):
+        x = torch.relu(self.bn0(self.conv0(x)))
+        for block in self.blocks:
+            x = torch.relu(block["dw_bn"](block["dw"](x)))
+            x = torch.relu(block["pw_bn"](block["pw"](x)))
+        return self.fc(x.mean(dim=(2, 3)))
+
+def fold(conv, bn):
+    """Conv weight and bias with the batch norm applied"""
+    scale = bn.weight / torch.sqrt(bn.running_var + bn.eps)
+    weight = conv.weight * scale.reshape(-1, 1, 1, 1)
+    bias = bn.bias - bn.running_mean * scale
+    return weight.detach().float().numpy(), bias.detach().float().numpy()
+
+def main():
+    parser = argparse.ArgumentParser(description="Export a DS-CNN keyword spotter for kws.cpp")
+    parser.add_argument("checkpoint", help="state_dict of a DSCNN")
+    parser.add_argument("output", help="GGUF file to write")
+    parser.add_argument("--classes", type=int, default=3)
+    parser.add_argument("--channels", type=int, default=64)
+    parser.add_argument("--blocks", type=int, default=4)
+    parser.add_argument("--keyword", type=int, default=2, help="class index of the wake word")
+    parser.add_argument("--frames", type=int, default=49)
+    parser.add_argument("--mel", type=int, default=40)
+    args = parser.parse_args()
+
+    model = DSCNN(args.classes, args.channels, args.blocks)
+    model.load_state_dict(torch.load(args.checkpoint, map_location="cpu"))
+    model.eval()
+
+    # Torch [out, in, h, w] is ggml [w, h, in, out], so arrays go in as they are
+    writer = gguf.GGUFWriter(args.output, "kws")
+    writer.add_uint32("kws.n_mel", args.mel)
+    writer.add_uint32("kws.n_frames", args.frames)
+    writer.add_uint32("kws.keyword", args.keyword)
+    writer.add_uint32("kws.conv0.stride_w", model.conv0.stride[1])
+    writer.add_uint32("kws.conv0.stride_h", model.conv0.stride[0])
+    writer.add_uint32("kws.conv0.pad_w", model.conv0.padding[1])
+    writer.add_uint32("kws.conv0.pad_h", model.conv0.padding[0])
+
+    # Float weights, the loader quantizes conv0, pointwise and fc to int8
+    weight, bias = fold(model.conv0, model.bn0)
+    writer.add_tensor("conv0.weight", weight)
+    writer.add_tensor("conv0.bias", bias)
+    for i, block in enumerate(model.blocks):
+        weight, bias = fold(block["dw"], block["dw_bn"])
+        writer.add_tensor(f"block.{i}.dw.weight", weight)
+        writer.add_tensor(f"block.{i}.dw.bias", bias)
+        weight, bias = fold(block["pw"], block["pw_bn"])
+        writer.add_tensor(f"block.{i}.pw.weight", weight.reshape(weight.shape[0], weight.shape[1]))
+        writer.add_tensor(f"block.{i}.pw.bias", bias)
+    writer.add_tensor("fc.weight", model.fc.weight.detach().float().numpy())
+    writer.add_tensor("fc.bias", model.fc.bias.detach().float().numpy())
+
+    writer.write_header_to_file()
+    writer.write_kv_data_to_file()
+    writer.write_tensors_to_file()
+    writer.close()
+    print(f"Wrote {args.output}")
+
+if __name__ == "__main__":
+    main()
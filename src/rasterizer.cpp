@@ -0,0 +1,215 @@
+// Deskman robot.
+// Rasterizer module.
+// Thomas Jacobs
+
+#include "rasterizer.h"
+#include <cmath>
+#include <algorithm>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Corners snap to this fraction of a pixel
+static const int SUBPIXEL = 16;
+
+using namespace std;
+
+// Rounding towards minus and plus infinity, b positive
+static inline int64_t floorDiv(int64_t a, int64_t b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static inline int64_t ceilDiv(int64_t a, int64_t b) {
+    return -floorDiv(-a, b);
+}
+
+static inline uint32_t pack(SDL_Color color) {
+    return 0xFF000000 | (uint32_t)color.r << 16 | (uint32_t)color.g << 8 | color.b;
+}
+
+static inline float clamp255(float v) {
+    return min(max(v, 0.0f), 255.0f);
+}
+
+// -----------------------------------------------------------
+// Spans
+// -----------------------------------------------------------
+
+// Colour and alpha along a span, from start at the first pixel by step per pixel, over what's there
+static void blendSpan(uint32_t* row, int count, const float* start, const float* step) {
+    int i = 0;
+
+#if defined(__ARM_NEON)
+    static const float INDEX[4] = { 0, 1, 2, 3 };
+    float32x4_t index = vld1q_f32(INDEX);
+    float32x4_t r = vmlaq_n_f32(vdupq_n_f32(start[0]), index, step[0]);
+    float32x4_t g = vmlaq_n_f32(vdupq_n_f32(start[1]), index, step[1]);
+    float32x4_t b = vmlaq_n_f32(vdupq_n_f32(start[2]), index, step[2]);
+    float32x4_t a = vmlaq_n_f32(vdupq_n_f32(start[3]), index, step[3]);
+    float32x4_t zero = vdupq_n_f32(0), full = vdupq_n_f32(255), half = vdupq_n_f32(0.5f);
+    uint32x4_t mask = vdupq_n_u32(0xFF), opaque = vdupq_n_u32(0xFF000000);
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t d = vld1q_u32(row + i);
+        float32x4_t dr = vcvtq_f32_u32(vandq_u32(vshrq_n_u32(d, 16), mask));
+        float32x4_t dg = vcvtq_f32_u32(vandq_u32(vshrq_n_u32(d, 8), mask));
+        float32x4_t db = vcvtq_f32_u32(vandq_u32(d, mask));
+        float32x4_t alpha = vmulq_n_f32(vminq_f32(vmaxq_f32(a, zero), full), 1.0f / 255);
+        dr = vmlaq_f32(dr, vsubq_f32(vminq_f32(vmaxq_f32(r, zero), full), dr), alpha);
+        dg = vmlaq_f32(dg, vsubq_f32(vminq_f32(vmaxq_f32(g, zero), full), dg), alpha);
+        db = vmlaq_f32(db, vsubq_f32(vminq_f32(vmaxq_f32(b, zero), full), db), alpha);
+        uint32x4_t out = vorrq_u32(vshlq_n_u32(vcvtq_u32_f32(vaddq_f32(dr, half)), 16), vshlq_n_u32(vcvtq_u32_f32(vaddq_f32(dg, half)), 8));
+        out = vorrq_u32(vorrq_u32(out, vcvtq_u32_f32(vaddq_f32(db, half))), opaque);
+        vst1q_u32(row + i, out);
+        r = vaddq_f32(r, vdupq_n_f32(4 * step[0]));
+        g = vaddq_f32(g, vdupq_n_f32(4 * step[1]));
+        b = vaddq_f32(b, vdupq_n_f32(4 * step[2]));
+        a = vaddq_f32(a, vdupq_n_f32(4 * step[3]));
+    }
+#elif defined(__SSE2__)
+    __m128 index = _mm_setr_ps(0, 1, 2, 3);
+    __m128 r = _mm_add_ps(_mm_set1_ps(start[0]), _mm_mul_ps(index, _mm_set1_ps(step[0])));
+    __m128 g = _mm_add_ps(_mm_set1_ps(start[1]), _mm_mul_ps(index, _mm_set1_ps(step[1])));
+    __m128 b = _mm_add_ps(_mm_set1_ps(start[2]), _mm_mul_ps(index, _mm_set1_ps(step[2])));
+    __m128 a = _mm_add_ps(_mm_set1_ps(start[3]), _mm_mul_ps(index, _mm_set1_ps(step[3])));
+    __m128 zero = _mm_setzero_ps(), full = _mm_set1_ps(255), half = _mm_set1_ps(0.5f);
+    __m128i mask = _mm_set1_epi32(0xFF), opaque = _mm_set1_epi32((int)0xFF000000);
+    for (; i + 4 <= count; i += 4) {
+        __m128i d = _mm_loadu_si128((const __m128i*)(row + i));
+        __m128 dr = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(d, 16), mask));
+        __m128 dg = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(d, 8), mask));
+        __m128 db = _mm_cvtepi32_ps(_mm_and_si128(d, mask));
+        __m128 alpha = _mm_mul_ps(_mm_min_ps(_mm_max_ps(a, zero), full), _mm_set1_ps(1.0f / 255));
+        dr = _mm_add_ps(dr, _mm_mul_ps(_mm_sub_ps(_mm_min_ps(_mm_max_ps(r, zero), full), dr), alpha));
+        dg = _mm_add_ps(dg, _mm_mul_ps(_mm_sub_ps(_mm_min_ps(_mm_max_ps(g, zero), full), dg), alpha));
+        db = _mm_add_ps(db, _mm_mul_ps(_mm_sub_ps(_mm_min_ps(_mm_max_ps(b, zero), full), db), alpha));
+        __m128i out = _mm_or_si128(_mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(dr, half)), 16), _mm_slli_epi32(_mm_cvttps_epi32(_mm_add_ps(dg, half)), 8));
+        out = _mm_or_si128(_mm_or_si128(out, _mm_cvttps_epi32(_mm_add_ps(db, half))), opaque);
+        _mm_storeu_si128((__m128i*)(row + i), out);
+        r = _mm_add_ps(r, _mm_set1_ps(4 * step[0]));
+        g = _mm_add_ps(g, _mm_set1_ps(4 * step[1]));
+        b = _mm_add_ps(b, _mm_set1_ps(4 * step[2]));
+        a = _mm_add_ps(a, _mm_set1_ps(4 * step[3]));
+    }
+#endif
+
+    for (; i < count; i++) {
+        uint32_t d = row[i];
+        float alpha = clamp255(start[3] + step[3] * i) * (1.0f / 255);
+        float dr = (d >> 16) & 0xFF, dg = (d >> 8) & 0xFF, db = d & 0xFF;
+        dr += (clamp255(start[0] + step[0] * i) - dr) * alpha;
+        dg += (clamp255(start[1] + step[1] * i) - dg) * alpha;
+        db += (clamp255(start[2] + step[2] * i) - db) * alpha;
+        row[i] = 0xFF000000 | (uint32_t)(dr + 0.5f) << 16 | (uint32_t)(dg + 0.5f) << 8 | (uint32_t)(db + 0.5f);
+    }
+}
+
+// -----------------------------------------------------------
+// Rasterizer
+// -----------------------------------------------------------
+
+void Rasterizer::setTarget(uint32_t* pixels_, int width_, int height_, int stride_) {
+    pixels = pixels_;
+    width = width_;
+    height = height_;
+    stride = stride_;
+}
+
+void Rasterizer::clear(SDL_Color color) {
+    uint32_t value = pack(color);
+    for (int y = 0; y < height; y++) fill(pixels + (size_t)y * stride, pixels + (size_t)y * stride + width, value);
+}
+
+void Rasterizer::draw(const Mesh& mesh) {
+    for (size_t i = 0; i + 3 <= mesh.indices.size(); i += 3) {
+        triangle(mesh.vertices[mesh.indices[i]], mesh.vertices[mesh.indices[i + 1]], mesh.vertices[mesh.indices[i + 2]]);
+    }
+}
+
+void Rasterizer::triangle(const SDL_Vertex& a, const SDL_Vertex& b, const SDL_Vertex& c) {
+    // Fixed point corners, turned so the area is positive
+    const SDL_Vertex* v[3] = { &a, &b, &c };
+    int64_t x[3], y[3];
+    for (int i = 0; i < 3; i++) {
+        x[i] = llroundf(v[i]->position.x * SUBPIXEL);
+        y[i] = llroundf(v[i]->position.y * SUBPIXEL);
+    }
+    int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (area == 0) return;
+    if (area < 0) {
+        swap(v[1], v[2]);
+        swap(x[1], x[2]);
+        swap(y[1], y[2]);
+        area = -area;
+    }
+
+    // Pixels whose centres can be inside, on the target
+    const int64_t HALF = SUBPIXEL / 2;
+    int top = (int)max<int64_t>(0, ceilDiv(min({ y[0], y[1], y[2] }) - HALF, SUBPIXEL));
+    int bottom = (int)min<int64_t>(height - 1, floorDiv(max({ y[0], y[1], y[2] }) - HALF, SUBPIXEL));
+    int64_t left = max<int64_t>(0, ceilDiv(min({ x[0], x[1], x[2] }) - HALF, SUBPIXEL));
+    int64_t right = min<int64_t>(width - 1, floorDiv(max({ x[0], x[1], x[2] }) - HALF, SUBPIXEL));
+    if (top > bottom || left > right) return;
+
+    // Edge i runs from corner i to the next, a centre is inside where dx * (py - y) - dy * (px - x) >= 0 for all three.
+    // A centre exactly on an edge goes to one of the two triangles sharing it, by which way the edge runs.
+    int64_t edgeX[3], edgeY[3], bias[3];
+    for (int i = 0; i < 3; i++) {
+        int j = (i + 1) % 3;
+        edgeX[i] = x[j] - x[i];
+        edgeY[i] = y[j] - y[i];
+        bias[i] = edgeY[i] > 0 || (edgeY[i] == 0 && edgeX[i] < 0) ? 0 : 1;
+    }
+
+    // Colour and alpha as planes over the triangle, per pixel right and down
+    float fx[3], fy[3], value[3][4];
+    for (int i = 0; i < 3; i++) {
+        fx[i] = (float)x[i] / SUBPIXEL;
+        fy[i] = (float)y[i] / SUBPIXEL;
+        SDL_Color color = v[i]->color;
+        value[i][0] = color.r;
+        value[i][1] = color.g;
+        value[i][2] = color.b;
+        value[i][3] = color.a;
+    }
+    float det = (float)area / (SUBPIXEL * SUBPIXEL);
+    float stepX[4], stepY[4];
+    bool flat = true;
+    for (int k = 0; k < 4; k++) {
+        float d1 = value[1][k] - value[0][k], d2 = value[2][k] - value[0][k];
+        stepX[k] = (d1 * (fy[2] - fy[0]) - d2 * (fy[1] - fy[0])) / det;
+        stepY[k] = (d2 * (fx[1] - fx[0]) - d1 * (fx[2] - fx[0])) / det;
+        if (d1 != 0 || d2 != 0) flat = false;
+    }
+
+    // Nothing to see, or the solid inside of a shape, which needs no blending
+    if (flat && value[0][3] == 0) return;
+    bool opaque = flat && value[0][3] == 255;
+    uint32_t solid = pack(v[0]->color);
+
+    for (int row = top; row <= bottom; row++) {
+        // Span where all three edges are satisfied, each edge is linear along the row
+        int64_t py = (int64_t)row * SUBPIXEL + HALF;
+        int64_t first = left, last = right;
+        for (int i = 0; i < 3; i++) {
+            int64_t e0 = edgeX[i] * (py - y[i]) - edgeY[i] * (HALF - x[i]) - bias[i];
+            int64_t step = -edgeY[i] * SUBPIXEL;
+            if (step > 0) first = max(first, ceilDiv(-e0, step));
+            else if (step < 0) last = min(last, floorDiv(e0, -step));
+            else if (e0 < 0) last = first - 1;
+        }
+        if (first > last) continue;
+
+        uint32_t* span = pixels + (size_t)row * stride + first;
+        int count = (int)(last - first + 1);
+        if (opaque) {
+            fill(span, span + count, solid);
+            continue;
+        }
+        float start[4];
+        for (int k = 0; k < 4; k++) start[k] = value[0][k] + stepX[k] * (first + 0.5f - fx[0]) + stepY[k] * (row + 0.5f - fy[0]);
+        blendSpan(span, count, start, stepX);
+    }
+}
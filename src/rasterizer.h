@@ -0,0 +1,33 @@
+// Deskman robot.
+// Rasterizer module.
+// Thomas Jacobs
+
+#pragma once
+
+#include <cstdint>
+#include <SDL2/SDL.h>
+#include "vector_renderer.h"
+
+// Draws meshes into 32 bit XRGB pixels without a GPU or a window system. Triangles go a scanline span
+// at a time over exactly the pixel centres inside them, so triangles that share an edge never both
+// cover a pixel, and colours blend over what's there 4 pixels at a time with NEON or SSE. Edges come
+// out anti-aliased since the meshes already fade them out with vertex alpha, so coverage is the
+// interpolated alpha.
+class Rasterizer {
+public:
+    // Pixels of the frame to draw, stride in pixels
+    void setTarget(uint32_t* pixels, int width, int height, int stride);
+
+    void clear(SDL_Color color);
+
+    // Untextured triangles, blended like SDL_RenderGeometry with SDL_BLENDMODE_BLEND
+    void draw(const Mesh& mesh);
+
+private:
+    void triangle(const SDL_Vertex& a, const SDL_Vertex& b, const SDL_Vertex& c);
+
+    uint32_t* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    int stride = 0;
+};
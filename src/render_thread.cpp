@@ -0,0 +1,313 @@
+// Deskman robot.
+// Render thread module.
+// Thomas Jacobs
+
+#include "render_thread.h"
+#include "screen.h"
+#include "face.h"
+#include "lip_sync.h"
+#include <cmath>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+
+// Logging
+#define DEBUG 0
+
+// Statistics every this many frames when logging
+static const int REPORT_FRAMES = 600;
+
+// Refresh rate if the display doesn't say
+static const int DEFAULT_REFRESH_HZ = 60;
+
+// Text colour, and the space around captions and the HUD
+static const SDL_Color TEXT_COLOR = { 0, 0, 0, 255 };
+static const int TEXT_MARGIN = 10;
+
+// Adaptive render scale, stepped down after a run of late frames, back up after a long run of easy ones
+static const float MIN_RENDER_SCALE = 0.5f;
+static const float RENDER_SCALE_STEP = 0.125f;
+static const int LATE_FRAMES = 3;
+static const int EASY_FRAMES = 300;
+static const double EASY_FRACTION = 0.5;  // Of the frame budget
+
+using namespace std;
+
+Caption caption;
+
+// -----------------------------------------------------------
+// Frame statistics
+// -----------------------------------------------------------
+
+void FrameStats::add(double workMs, double intervalMs, double periodMs) {
+    frames++;
+    work[min((int)workMs, BUCKETS - 1)]++;
+    if (workMs > periodMs) overBudget++;
+    if (intervalMs <= 0) return;
+    interval[min((int)intervalMs, BUCKETS - 1)]++;
+
+    // Each refresh in between showed the frame before again
+    if (intervalMs > periodMs * 1.5) dropped += (uint64_t)lround(intervalMs / periodMs) - 1;
+}
+
+// Upper edge of the bucket the fraction p of counts falls in
+static int percentile(const uint32_t* buckets, int count, double p) {
+    uint64_t total = 0;
+    for (int i = 0; i < count; i++) total += buckets[i];
+    if (total == 0) return 0;
+    uint64_t seen = 0;
+    for (int i = 0; i < count; i++) {
+        seen += buckets[i];
+        if (seen >= p * total) return i + 1;
+    }
+    return count;
+}
+
+void FrameStats::print(double periodMs) const {
+    cout << "Frames " << frames << ", dropped " << dropped << ", over the " << fixed << setprecision(1) << periodMs << " ms budget " << overBudget
+         << ", work p50 " << percentile(work, BUCKETS, 0.5) << " p99 " << percentile(work, BUCKETS, 0.99)
+         << " ms, interval p50 " << percentile(interval, BUCKETS, 0.5) << " p99 " << percentile(interval, BUCKETS, 0.99) << " ms" << endl;
+    cout << "    ms      work  interval" << endl;
+    for (int i = 0; i < BUCKETS; i++) {
+        if (!work[i] && !interval[i]) continue;
+        cout << setw(5) << i << (i == BUCKETS - 1 ? "+" : " ") << setw(9) << work[i] << setw(10) << interval[i] << endl;
+    }
+}
+
+// -----------------------------------------------------------
+// Render thread
+// -----------------------------------------------------------
+
+RenderThread::~RenderThread() {
+    stop();
+}
+
+bool RenderThread::start(VectorRenderer& vectorRenderer_, bool threaded_, const string& display_) {
+    vectorRenderer = &vectorRenderer_;
+    threaded = threaded_;
+    display = display_;
+    if (!threaded) return running = open();
+
+    // The renderer belongs to the thread that made it. The thread owns the promise, it may still be
+    // inside set_value after we've had the result and gone.
+    promise<bool> opened;
+    future<bool> result = opened.get_future();
+    thread = std::thread([this, opened = std::move(opened)]() mutable {
+        bool ok = open();
+        opened.set_value(ok);
+        if (ok) run();
+    });
+    running = result.get();
+    if (!running) thread.join();
+    return running;
+}
+
+void RenderThread::setRenderScale(float scale, bool adaptive_) {
+    maxScale = scale > 0 && scale < 1 ? scale : 1;
+    adaptive = adaptive_;
+}
+
+bool RenderThread::step() {
+    if (threaded || !running) return false;
+    frame();
+    return true;
+}
+
+void RenderThread::stop() {
+    if (!running) return;
+    running = false;
+    if (threaded) {
+        stopping = true;
+        thread.join();
+    }
+    else {
+        close();
+    }
+}
+
+bool RenderThread::open() {
+    // Straight to the display, the face is projected for its size
+    if (display != "sdl") {
+        framebuffer.reset(Framebuffer::create(display));
+        if (!framebuffer) return false;
+        screen_width = framebuffer->width;
+        screen_height = framebuffer->height;
+        periodMs = 1000.0 / framebuffer->refreshHz;
+        if (DEBUG) cout << "Rasterizing at " << framebuffer->refreshHz << " Hz" << endl;
+
+        // Render scale is for the SDL renderer's texture, the rasterizer always draws at full size
+        if (maxScale < 1 || adaptive) cerr << "Render scale is ignored on " << display << ", drawing the face at full resolution." << endl;
+        maxScale = 1;
+        adaptive = false;
+        return true;
+    }
+
+    if (!create_renderer(true)) return false;
+
+    // Presents wait for the refresh if the driver gives us vsync, otherwise frames sleep to it
+    SDL_RendererInfo info;
+    vsync = SDL_GetRendererInfo(renderer, &info) == 0 && (info.flags & SDL_RENDERER_PRESENTVSYNC);
+    SDL_DisplayMode mode;
+    int hz = SDL_GetWindowDisplayMode(window, &mode) == 0 && mode.refresh_rate > 0 ? mode.refresh_rate : DEFAULT_REFRESH_HZ;
+    periodMs = 1000.0 / hz;
+    if (!vsync) cerr << "No vsync, pacing frames with a timer." << endl;
+
+    // Reduced resolution needs drawing into a texture
+    if (maxScale < 1 || adaptive) {
+        if (info.flags & SDL_RENDERER_TARGETTEXTURE) resizeTarget(maxScale);
+        else {
+            cerr << "Renderer can't draw to textures, drawing the face at full resolution." << endl;
+            adaptive = false;
+        }
+    }
+
+    // Captions and HUD, the face still draws without them
+    text.load(renderer, face.font);
+    if (DEBUG) cout << "Rendering at " << hz << " Hz" << (threaded ? " on its own thread" : "") << endl;
+    return true;
+}
+
+void RenderThread::run() {
+    while (!stopping) frame();
+    close();
+}
+
+void RenderThread::close() {
+    stats.print(periodMs);
+    if (framebuffer) {
+        framebuffer.reset();
+        return;
+    }
+    text.unload();
+    resizeTarget(1);
+    SDL_DestroyRenderer(renderer);
+    renderer = NULL;
+}
+
+void RenderThread::frame() {
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = start + chrono::microseconds((int64_t)(periodMs * 1000));
+
+    // Newest tracks from the animation
+    bool textChanged = false;
+    if (snapshot.read(state)) {
+        haveState = true;
+        if (state.hud != hud) {
+            hud = state.hud;
+            textChanged = true;
+        }
+    }
+
+    // Where they are this refresh, at rest they don't change and the frame is skipped
+    if (haveState) {
+        double now = Animation::now();
+        vectorRenderer->setFaceRotation(Vec3(-state.tiltY.at(now), state.tiltX.at(now), 0));
+        face.leftEye->radiusY = state.eyeHeight.at(now);
+        face.rightEye->radiusY = face.leftEye->radiusY;
+    }
+
+    // Mouth for the speech being heard now, a new shape rebuilds the mouth and draws the frame
+    shape_mouth(&face, lipSync.shape(monotonicNs()));
+
+    // Words that arrived, laid out into the text's mesh
+    if (text.isLoaded()) {
+        if (caption.update(text, screen_width - 2 * TEXT_MARGIN)) textChanged = true;
+        if (textChanged) {
+            textMesh.clear();
+            caption.draw(text, textMesh, screen_width / 2, screen_height - TEXT_MARGIN, TEXT_COLOR);
+            if (!hud.empty()) text.draw(textMesh, text.shape(hud), TEXT_MARGIN, TEXT_MARGIN, TEXT_COLOR);
+        }
+    }
+    else {
+        // Framebuffer displays and missing fonts show no text, but the queue still has to be emptied
+        caption.discard();
+    }
+
+    // Nothing changed, the last frame stays on screen, look again next refresh
+    bool redrawing = redrawNeeded.exchange(false);
+    bool faceChanged = vectorRenderer->update();
+    if (!faceChanged && !textChanged && !redrawing) {
+        presentedLast = false;
+        this_thread::sleep_until(deadline);
+        return;
+    }
+
+    // Draw, the present waits for the refresh with vsync
+    double workMs;
+    if (framebuffer) {
+        rasterizer.setTarget(framebuffer->back(), framebuffer->width, framebuffer->height, framebuffer->stride);
+        rasterizer.clear({ 255, 255, 255, 255 });
+        rasterizer.draw(vectorRenderer->frame());
+        workMs = chrono::duration<double, milli>(Clock::now() - start).count();
+        if (!framebuffer->flip()) this_thread::sleep_until(deadline);
+    }
+    else {
+        // The face is still projected at full resolution, the scale fits it to the texture
+        if (target) {
+            SDL_SetRenderTarget(renderer, target);
+            SDL_RenderSetScale(renderer, (float)targetWidth / screen_width, (float)targetHeight / screen_height);
+        }
+        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+        SDL_RenderClear(renderer);
+        vectorRenderer->render(renderer);
+        if (target) {
+            SDL_SetRenderTarget(renderer, NULL);
+            SDL_RenderCopy(renderer, target, NULL, NULL);
+        }
+
+        // Text on top at full resolution, it would blur
+        text.submit(textMesh);
+        workMs = chrono::duration<double, milli>(Clock::now() - start).count();
+        SDL_RenderPresent(renderer);
+        if (!vsync) this_thread::sleep_until(deadline);
+    }
+    Clock::time_point presented = Clock::now();
+    double intervalMs = presentedLast ? chrono::duration<double, milli>(presented - lastPresent).count() : 0;
+    stats.add(workMs, intervalMs, periodMs);
+    if (adaptive) adaptScale(workMs, intervalMs);
+    presentedLast = true;
+    lastPresent = presented;
+    if (DEBUG && stats.frames % REPORT_FRAMES == 0) stats.print(periodMs);
+}
+
+// Texture to draw the face into at this fraction of the window, none at full resolution.
+// False if it can't be made, and the face draws at full resolution.
+bool RenderThread::resizeTarget(float scale) {
+    if (target) SDL_DestroyTexture(target);
+    target = NULL;
+    renderScale = 1;
+    if (scale >= 1) return true;
+
+    targetWidth = max(1, (int)lround(screen_width * scale));
+    targetHeight = max(1, (int)lround(screen_height * scale));
+    target = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, targetWidth, targetHeight);
+    if (!target) {
+        cerr << "Could not create a " << targetWidth << "x" << targetHeight << " render target: " << SDL_GetError() << endl;
+        adaptive = false;
+        return false;
+    }
+
+    // Smooth when scaled up, and copied over what's there rather than blended
+    SDL_SetTextureScaleMode(target, SDL_ScaleModeLinear);
+    SDL_SetTextureBlendMode(target, SDL_BLENDMODE_NONE);
+    renderScale = scale;
+    if (DEBUG) cout << "Rendering the face at " << targetWidth << "x" << targetHeight << endl;
+    return true;
+}
+
+// Late is over budget before the present, or a refresh missed after it, which is where GPU time shows
+void RenderThread::adaptScale(double workMs, double intervalMs) {
+    bool late = workMs > periodMs || intervalMs > periodMs * 1.5;
+    bool easy = workMs < periodMs * EASY_FRACTION && intervalMs < periodMs * 1.5;
+    lateFrames = late ? lateFrames + 1 : 0;
+    easyFrames = easy ? easyFrames + 1 : 0;
+    if (lateFrames >= LATE_FRAMES && renderScale > MIN_RENDER_SCALE) {
+        resizeTarget(max(MIN_RENDER_SCALE, renderScale - RENDER_SCALE_STEP));
+        lateFrames = 0;
+    }
+    else if (easyFrames >= EASY_FRAMES && renderScale < maxScale) {
+        resizeTarget(min(maxScale, renderScale + RENDER_SCALE_STEP));
+        easyFrames = 0;
+    }
+}
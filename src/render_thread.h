@@ -0,0 +1,115 @@
+// Deskman robot.
+// Render thread module.
+// Thomas Jacobs
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include "snapshot.h"
+#include "animation.h"
+#include "rasterizer.h"
+#include "framebuffer.h"
+#include "text_renderer.h"
+#include "vector_renderer.h"
+
+// What the face does, from the animation on the main thread. Whole tracks rather than values, evaluated
+// here every refresh, so a late main loop only delays new cues and never holds a blink or look mid-way.
+struct FaceState {
+    Track tiltX, tiltY;  // Look, degrees
+    Track eyeHeight;
+    std::string hud;  // Corner text, none if empty
+};
+
+// What the robot is saying, appended to from the speech threads
+extern Caption caption;
+
+// Frame times in 1 ms buckets, and refreshes that showed an old frame because the next one was late
+struct FrameStats {
+    static const int BUCKETS = 50;  // The last one holds everything longer
+
+    uint32_t work[BUCKETS] = {};  // Update, draw and submit, up to waiting for the display
+    uint32_t interval[BUCKETS] = {};  // Present to present, for frames drawn back to back
+    uint64_t frames = 0;
+    uint64_t dropped = 0;
+    uint64_t overBudget = 0;
+
+    // Interval 0 for a frame after an idle spell, which has nothing to be late against
+    void add(double workMs, double intervalMs, double periodMs);
+    void print(double periodMs) const;
+};
+
+// Draws the face on its own thread, paced by the display with vsync, so vision, servos and the camera
+// window on the main thread can't make it stutter. The main thread publishes a FaceState each tick and
+// only this thread touches the renderer and the shapes. Without SDL the face is rasterized in software
+// straight into a framebuffer, and there's no text. On slow GPUs the window can draw the face at a
+// lower resolution and scale it up.
+class RenderThread {
+public:
+    ~RenderThread();
+
+    // Renderer and frames on a new thread, or on this one if threaded is false, as macOS needs.
+    // Display is sdl for the window, or a framebuffer for Framebuffer::create. False if there's no display.
+    bool start(VectorRenderer& vectorRenderer, bool threaded, const std::string& display = "sdl");
+
+    // Before start, draw the face in the window at this fraction of its resolution and scale it up.
+    // Adaptive starts at scale and steps down while frames run over budget, and back up when they don't.
+    void setRenderScale(float scale, bool adaptive);
+
+    // Main thread, whenever the tracks change, newest state wins
+    void publish(const FaceState& state) { snapshot.publish(state); }
+
+    // Draw the next frame even if nothing changed, what's on screen may be gone
+    void redraw() { redrawNeeded = true; }
+
+    // Unthreaded, draw a frame if anything changed and wait for the display. False if threaded.
+    bool step();
+
+    // Join the thread and print the frame statistics
+    void stop();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    bool open();
+    void run();
+    void frame();
+    void close();
+    bool resizeTarget(float scale);
+    void adaptScale(double workMs, double intervalMs);
+
+    VectorRenderer* vectorRenderer = nullptr;
+    std::string display;
+    Snapshot<FaceState> snapshot;
+    std::atomic<bool> redrawNeeded{true};
+    std::atomic<bool> stopping{false};
+    bool threaded = false;
+    bool running = false;
+    std::thread thread;
+
+    // Render side
+    std::unique_ptr<Framebuffer> framebuffer;
+    Rasterizer rasterizer;
+    TextRenderer text;
+    Mesh textMesh;
+    FaceState state;
+    bool haveState = false;
+    std::string hud;
+    SDL_Texture* target = NULL;  // Face at reduced resolution, none at full
+    int targetWidth = 0;
+    int targetHeight = 0;
+    float renderScale = 1;
+    float maxScale = 1;
+    bool adaptive = false;
+    int lateFrames = 0;
+    int easyFrames = 0;
+    bool vsync = false;
+    double periodMs = 1000.0 / 60;
+    bool presentedLast = false;
+    Clock::time_point lastPresent;
+    FrameStats stats;
+};
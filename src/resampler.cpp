@@ -0,0 +1,155 @@
+// Deskman robot.
+// Polyphase sample rate converter.
+// Thomas Jacobs
+
+#include "resampler.h"
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Filter design
+static const int HALF_WIDTH = 8;         // Zero crossings each side of the sinc, at the narrower rate
+static const double KAISER_BETA = 8.0;   // About 80 dB stopband
+static const double ROLLOFF = 0.9;       // Passband edge as a fraction of the output Nyquist
+
+// Zeroth order modified Bessel function, for the Kaiser window
+static double bessel0(double x) {
+    double sum = 1, term = 1;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+void Resampler::configure(int inRate_, int outRate_) {
+    inRate = inRate_;
+    outRate = outRate_;
+    int g = gcd(inRate, outRate);
+    up = outRate / g;
+    down = inRate / g;
+
+    // Prototype runs at L * inRate, cutoff below the lower of the two Nyquist rates
+    double ratio = min(1.0, (double)up / down);
+    double cutoff = 0.5 * ratio * ROLLOFF / up;
+    taps = (int)ceil(2 * HALF_WIDTH / ratio);
+    taps = (taps + 7) & ~7;
+    int length = taps * up;
+    double center = (length - 1) / 2.0;
+
+    // Windowed sinc, DC gain of L so each phase sums to about one
+    vector<double> h(length);
+    double sum = 0;
+    for (int i = 0; i < length; i++) {
+        double x = i - center;
+        double sinc = x == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * x) / (M_PI * x);
+        double w = (2.0 * i) / (length - 1) - 1;
+        h[i] = sinc * bessel0(KAISER_BETA * sqrt(max(0.0, 1 - w * w))) / bessel0(KAISER_BETA);
+        sum += h[i];
+    }
+
+    // Split into phases, reversed so the window over the input runs forwards
+    coeffs.assign((size_t)up * taps, 0.0f);
+    for (int p = 0; p < up; p++) {
+        for (int k = 0; k < taps; k++) {
+            coeffs[(size_t)p * taps + (taps - 1 - k)] = (float)(h[k * up + p] * up / sum);
+        }
+    }
+    groupDelay = passthrough() ? 0 : (int)(center / down);
+    reset();
+}
+
+void Resampler::reset() {
+    history.assign(max(taps - 1, 0), 0.0f);
+    phase = 0;
+}
+
+// Dot product of one phase with the input window
+static inline float dot(const float* a, const float* b, int n) {
+    #if defined(__ARM_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0), acc1 = vdupq_n_f32(0);
+    for (int i = 0; i < n; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    float32x4_t acc = vaddq_f32(acc0, acc1);
+    float32x2_t pair = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    return vget_lane_f32(vpadd_f32(pair, pair), 0);
+    #elif defined(__SSE2__)
+    __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+    for (int i = 0; i < n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    __m128 acc = _mm_add_ps(acc0, acc1);
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    return _mm_cvtss_f32(acc);
+    #else
+    float sum = 0;
+    for (int i = 0; i < n; i++) sum += a[i] * b[i];
+    return sum;
+    #endif
+}
+
+size_t Resampler::process(const int16_t* in, size_t n, float* out) {
+    // Append the block after the carried history, as floats
+    size_t carried = taps - 1;
+    history.resize(carried + n);
+    float* x = history.data();
+    for (size_t i = 0; i < n; i++) x[carried + i] = in[i] * (1.0f / 32768.0f);
+
+    // Same rate, just convert
+    if (passthrough()) {
+        copy(x + carried, x + carried + n, out);
+        history.resize(carried);
+        return n;
+    }
+
+    // Each output ends its window phase / L samples into the new block
+    size_t count = 0;
+    while (phase / up < n) {
+        size_t end = phase / up;
+        const float* row = coeffs.data() + (phase % up) * taps;
+        out[count++] = dot(row, x + end, taps);
+        phase += down;
+    }
+
+    // Carry the last taps - 1 samples into the next block
+    phase -= n * up;
+    copy(x + n, x + n + carried, x);
+    history.resize(carried);
+    return count;
+}
+
+void floatToInt16(const float* in, int16_t* out, size_t n) {
+    size_t i = 0;
+    // Round to nearest everywhere, like _mm_cvtps_epi32, so platforms agree to the sample
+    #if defined(__ARM_NEON) && defined(__aarch64__)
+    float32x4_t scale = vdupq_n_f32(32767.0f);
+    for (; i + 8 <= n; i += 8) {
+        int32x4_t a = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(in + i), scale));
+        int32x4_t b = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(in + i + 4), scale));
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+    }
+    #elif defined(__SSE2__)
+    __m128 scale = _mm_set1_ps(32767.0f);
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i), scale));
+        __m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(a, b));
+    }
+    #endif
+    for (; i < n; i++) {
+        float v = in[i] * 32767.0f;
+        out[i] = (int16_t)lrintf(max(-32768.0f, min(32767.0f, v)));
+    }
+}
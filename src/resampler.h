@@ -0,0 +1,50 @@
+// Deskman robot.
+// Polyphase sample rate converter.
+// Thomas Jacobs
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Rational L/M resampler for streaming mono PCM.
+// A Kaiser windowed sinc prototype is split into L phases, each padded to a multiple of 8 taps
+// and stored reversed, so every output sample is one contiguous dot product that NEON or SSE
+// can do 4 taps at a time.
+class Resampler {
+public:
+    Resampler() {}
+    Resampler(int inRate, int outRate) { configure(inRate, outRate); }
+
+    // Design the filter, resets any history
+    void configure(int inRate, int outRate);
+    void reset();
+
+    // Resample a block, returns the number of samples written to out
+    size_t process(const int16_t* in, size_t n, float* out);
+
+    // Most output samples that n input samples can produce
+    size_t maxOutput(size_t n) const { return (n * up + phase) / down + 1; }
+
+    // Delay the filter adds, in output samples
+    int delay() const { return groupDelay; }
+
+    int inputRate() const { return inRate; }
+    int outputRate() const { return outRate; }
+    bool passthrough() const { return up == 1 && down == 1; }
+
+private:
+    int inRate = 0;
+    int outRate = 0;
+    int up = 1;             // L
+    int down = 1;           // M
+    int taps = 0;           // Taps per phase, multiple of 8
+    int groupDelay = 0;
+    size_t phase = 0;       // Position of the next output, in 1/L input samples past the history
+    std::vector<float> coeffs;   // [phase][tap], reversed
+    std::vector<float> history;  // taps - 1 carried samples then the current block
+};
+
+// Convert float samples in [-1, 1] to int16 with saturation
+void floatToInt16(const float* in, int16_t* out, size_t n);
@@ -11,7 +11,7 @@ SDL_Texture* texture = NULL;
 int screen_width;
 int screen_height;
 
-bool create_window(bool fullscreen) {
+bool create_window(bool fullscreen, bool with_renderer) {
     // Initialize SDL
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         fprintf(stderr, "SDL could not initialize: %s\n", SDL_GetError());
@@ -39,7 +39,7 @@ bool create_window(bool fullscreen) {
     screen_height = display_mode.h;
 
     // Create window
-    SDL_Window* window = SDL_CreateWindow("Deskman Robot", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, screen_width, screen_height, fullscreen ? SDL_WINDOW_FULLSCREEN : 0);
+    window = SDL_CreateWindow("Deskman Robot", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, screen_width, screen_height, fullscreen ? SDL_WINDOW_FULLSCREEN : 0);
     if (!window) {
         fprintf(stderr, "Window could not be created: %s\n", SDL_GetError());
         IMG_Quit();
@@ -53,21 +53,28 @@ bool create_window(bool fullscreen) {
     }
 
     // Create renderer for the window
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-    if (!renderer) {
-        fprintf(stderr, "Renderer could not be created: %s\n", SDL_GetError());
+    if (with_renderer && !create_renderer(false)) {
         SDL_DestroyWindow(window);
         IMG_Quit();
         SDL_Quit();
         return -1;
     }
+    return 0;
+}
+
+bool create_renderer(bool vsync) {
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0));
+    if (!renderer) {
+        fprintf(stderr, "Renderer could not be created: %s\n", SDL_GetError());
+        return false;
+    }
 
     // Clear screen
     SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
     SDL_RenderClear(renderer);
     SDL_RenderPresent(renderer);
     SDL_Delay(16);
-    return 0;
+    return true;
 }
 
 bool close_window() {
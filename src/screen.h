@@ -1,11 +1,16 @@
+#pragma once
+
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 
 // Screen
 extern int screen_width;
 extern int screen_height;
+extern SDL_Window* window;
 extern SDL_Renderer* renderer;
 
-bool create_window(bool fullscreen);
+// Without a renderer, the thread that draws makes its own with create_renderer
+bool create_window(bool fullscreen, bool with_renderer = true);
+bool create_renderer(bool vsync);
 bool close_window();
 
@@ -0,0 +1,37 @@
+// Deskman robot.
+// Snapshot module.
+// Thomas Jacobs
+
+#pragma once
+
+#include <atomic>
+
+// Latest value from one writer thread to one reader thread, neither ever locks or waits.
+// Each side has its own copy and they trade through a third, so it's double buffered from
+// either side's point of view. Values published in between reads are skipped, only the newest counts.
+template <typename T>
+class Snapshot {
+public:
+    // Writer only
+    void publish(const T& value) {
+        slots[writing] = value;
+        writing = middle.exchange(writing | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // Reader only, true and the newest value if one was published since the last read
+    bool read(T& value) {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+        reading = middle.exchange(reading, std::memory_order_acq_rel) & INDEX;
+        value = slots[reading];
+        return true;
+    }
+
+private:
+    static const int INDEX = 3;
+    static const int FRESH = 4;
+
+    T slots[3];
+    int writing = 0;
+    int reading = 1;
+    std::atomic<int> middle{2};  // Slot index, with FRESH while the reader hasn't taken it
+};
@@ -3,39 +3,39 @@
 // Thomas Jacobs
 
 #include "face.h"
+#include "speak.h"
+#include "render_thread.h"
 #include <queue>
 #include <mutex>
 #include <string>
 #include <vector>
 #include <chrono>
+#include <cmath>
 #include <thread>
+#include <cstdlib>
 #include <iostream>
 #include <condition_variable>
 
-// On linux, use ALSA
-#ifdef __linux__
-#define ALSA
-#endif
-#ifdef ALSA
-#include <alsa/asoundlib.h>
-#else
-#include "portaudio.h"
-#endif
-
 // Logging
 #define DEBUG 0
 
 // JSON
 #include <nlohmann/json.hpp>
 
-// Picovoice Porcupine
+// Picovoice Porcupine, or the built-in keyword spotter
 #include "pv_porcupine.h"
+#include "kws.h"
 
-// WebSockets
-#include <libwebsockets.h>
+// Realtime API, and the tools it can call
+#include "openai_client.h"
+#include "tool_executor.h"
 
-// Base64 encoding
-#include "base64.hpp"
+// Capture and playback threads
+#include "audio_ring.h"
+#include "audio_bus.h"
+#include "audio_playback.h"
+#include "vad.h"
+#include "lip_sync.h"
 
 // Keys
 #include "keys.h"
@@ -61,6 +61,48 @@ static const int SAMPLE_RATE = 24000;
 static const int CHANNELS    = 1;
 static const int FRAMES_PER_BUFFER = 512 * 10;
 
+// Capture once at the device's native rate, every consumer gets its own rate from the bus
+static const int CAPTURE_RATE = 48000;
+static const int WAKEWORD_RATE = 16000;
+
+// How far back captured audio stays readable, for pre-roll and playback of the recording
+static const int CAPTURE_RETENTION_MS = 10000;
+
+// Playback thread writes 20 ms periods, responses arrive faster than realtime so the queue holds a minute
+static const int PLAYBACK_PERIOD = SAMPLE_RATE / 50;
+static const int PLAYBACK_QUEUE_MS = 60000;
+
+// Mouth shapes from what's played, taken up by the render thread
+LipSync lipSync(SAMPLE_RATE);
+
+// While a turn is being recorded, for the face
+atomic<bool> listening{false};
+
+// Uplink sends whatever has been captured, at least 20 ms at a time, more if the socket held us back
+static const int UPLINK_MIN_FRAMES = SAMPLE_RATE / 50;
+static const int UPLINK_MAX_FRAMES = FRAMES_PER_BUFFER;
+
+// A turn ends after this much silence following speech, or gives up if nobody speaks
+static const int ENDPOINT_SILENCE_MS = 700;
+static const int ENDPOINT_NO_SPEECH_MS = 8000;
+static const int ENDPOINT_MAX_TURN_MS = 30000;
+
+// The endpointer learns the noise floor from this much of what was captured before the turn
+static const int ENDPOINT_FLOOR_MS = 2000;
+
+// Audio from before the detector triggered that still goes up, so soft word starts aren't clipped
+static const int SPEECH_PREROLL_MS = 300;
+
+// After the wake word, audio from this far before the keyword ended still goes up. The detector fires a
+// frame or more late, and what's said straight after the keyword would otherwise lose its start.
+static const int WAKEWORD_PREROLL_MS = 500;
+
+// The wake word detector wakes up for this many 32 ms frames at a time
+static const int WAKEWORD_FRAMES_PER_WAKE = 4;
+
+// Play the recording back locally after each turn, for checking the microphone
+static const bool ECHO_RECORDING = false;
+
 // -----------------------------------------------------------
 // Utility functions for movement
 // -----------------------------------------------------------
@@ -79,367 +121,175 @@ void move_head(const string &direction) {
     else if (direction == "Right") move_head( 600,   0);
 }
 
+// -----------------------------------------------------------
+// Tools the model can call, run on the tool executor's thread
+// -----------------------------------------------------------
+static vector<Tool> robotTools() {
+    Tool moveHead;
+    moveHead.name = "move_head";
+    moveHead.description = "Move your head to point more left, right, up, or down, to look in a direction.";
+    moveHead.parameters = {
+        {"type", "object"},
+        {"properties", {
+            {"direction", {
+                {"type", "string"},
+                {"description", "The direction to move."},
+                {"enum", {
+                    "Up",
+                    "Down", 
+                    "Left",
+                    "Right"
+                }}
+            }}
+        }},
+        {"required", {"direction"}}
+    };
+    moveHead.handler = [](const json& args) -> json {
+        string direction = args.at("direction").get<string>();
+        if (direction != "Up" && direction != "Down" && direction != "Left" && direction != "Right") {
+            return { {"error", "Unknown direction " + direction} };
+        }
+        move_head(direction);
+        return { {"result", "Moved " + direction} };
+    };
+    return { moveHead };
+}
+
 // -----------------------------------------------------------
 // AudioHandler
 // -----------------------------------------------------------
 class AudioHandler {
 public:
-    AudioHandler() : capture_handle(nullptr), playback_handle(nullptr) {
-        bool success = initAudio();
+    AudioHandler() : bus(CAPTURE_RETENTION_MS), playback(SAMPLE_RATE, PLAYBACK_QUEUE_MS) {
+        // The mouth follows what's played, when it's heard
+        playback.setTap([](const AudioSpan<int16_t>& block, int64_t heardNs) { lipSync.analyze(block, heardNs); });
     }
 
     ~AudioHandler() {
         cleanup();
     }
 
-    // Initialize both input and output devices
-    bool initAudio() {
-        return openAudioInput() && openAudioOutput();
-    }
-
-    // ALSA
-    #ifdef ALSA
-    static const snd_pcm_format_t AUDIO_FORMAT = SND_PCM_FORMAT_S16_LE;
-
-    // Set up ALSA capture
-    bool openAudioInput() {
-        if (snd_pcm_open(&capture_handle, "default", SND_PCM_STREAM_CAPTURE, 0) < 0) {
-            cerr << "Failed to open ALSA capture device." << endl;
-            return false;
-        }
-        if (configureDevice(capture_handle) < 0) {
-            cerr << "Failed to configure ALSA capture device." << endl;
+    // Start the capture thread if it isn't running, it then stays on so the rings always hold the recent past
+    bool startCapture() {
+        if (!bus.start(CAPTURE_RATE)) {
+            cerr << "Cannot open input stream for recording." << endl;
             return false;
         }
         return true;
     }
 
-    // Set up ALSA playback
-    bool openAudioOutput() {
-        if (snd_pcm_open(&playback_handle, "default", SND_PCM_STREAM_PLAYBACK, 0) < 0) {
-            cerr << "Failed to open ALSA playback device." << endl;
-            return false;
-        }
-        if (configureDevice(playback_handle) < 0) {
-            cerr << "Failed to configure ALSA playback device." << endl;
-            return false;
-        }
+    // Begin a new recording at the live edge, false if there's no microphone
+    bool startRecording() {
+        if (!startCapture()) return false;
+        recordReader = captureRing.reader();
+        recordStart = recordEnd = recordReader.position();
         return true;
     }
 
-    // Configure common device params
-    int configureDevice(snd_pcm_t *handle) {
-        snd_pcm_hw_params_t *hw_params;
-        snd_pcm_hw_params_alloca(&hw_params);
-        if (snd_pcm_hw_params_any(handle, hw_params) < 0) return -1;
-        if (snd_pcm_hw_params_set_access(handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED) < 0) return -1;
-        if (snd_pcm_hw_params_set_format(handle, hw_params, AUDIO_FORMAT) < 0) return -1;
-        unsigned int rate = SAMPLE_RATE;
-        if (snd_pcm_hw_params_set_rate_near(handle, hw_params, &rate, 0) < 0) return -1;
-        if (snd_pcm_hw_params_set_channels(handle, hw_params, CHANNELS) < 0) return -1;
-        if (snd_pcm_hw_params(handle, hw_params) < 0) return -1;
-        return 0;
-    }
-
-    void startRecording() {
-        recordedBuffer.clear();
-        if (!openAudioInput()) {
-            cerr << "Cannot open input stream for recording." << endl;
-        }
-    }
-
-    // Record a chunk of audio data, returns a vector of int16_t samples
-    vector<int16_t> recordChunk(int size) {
-        vector<int16_t> chunk(size, 0);
-        if (capture_handle) {
-            snd_pcm_sframes_t framesRead = snd_pcm_readi(capture_handle, chunk.data(), size);
-            if (false && DEBUG) cout << "Frames read: " << framesRead << endl;
-            if (framesRead < 0) {
-                // Try to recover
-                snd_pcm_recover(capture_handle, (int)framesRead, 0);
-
-                // Return an empty chunk if we can't read
-                cerr << "Error recording. " << endl;
-            } else {
-                // Store recorded audio in buffer
-                recordedBuffer.insert(recordedBuffer.end(), chunk.begin(), chunk.end());
-            }
-        }
-        return chunk;
+    // Begin a new recording with what was captured from a time on, as far back as the ring goes
+    bool startRecordingFrom(int64_t timeNs) {
+        if (!startCapture()) return false;
+        uint64_t from = captureRing.positionAt(timeNs);
+        uint64_t oldest = captureRing.position() - min<uint64_t>(captureRing.position(), captureRing.retentionSamples());
+        recordReader = captureRing.readerAt(max(from, oldest));
+        recordStart = recordEnd = recordReader.position();
+        return true;
     }
 
-    // Play (output) a chunk of audio data
-    void playChunk(const vector<int16_t>& data) {
-        if (playback_handle) {
-            snd_pcm_sframes_t framesWritten = snd_pcm_writei(playback_handle, data.data(), data.size());
-            if (framesWritten < 0) {
-                snd_pcm_recover(playback_handle, (int)framesWritten, 0);
-            }
-        }
+    // Wait for the next chunk of captured audio, returns a view of it in the capture ring
+    AudioSpan<int16_t> recordChunk(int size) {
+        recordReader.wait(size);
+        return recordReader.read(size);
     }
 
-    // Stop recording
-    void stopRecording() {
-        if (capture_handle) {
-            snd_pcm_close(capture_handle);
-            capture_handle = nullptr;
-        }
+    // Wait for at least minSize of captured audio then take everything there is, up to maxSize
+    AudioSpan<int16_t> recordAvailable(size_t minSize, size_t maxSize) {
+        if (!recordReader.wait(minSize)) return AudioSpan<int16_t>();
+        return recordReader.read(min(recordReader.available(), maxSize));
     }
 
-    // Clean up
-    void cleanup() {
-        if (capture_handle) {
-            snd_pcm_close(capture_handle);
-            capture_handle = nullptr;
-        }
-        if (playback_handle) {
-            snd_pcm_close(playback_handle);
-            playback_handle = nullptr;
-        }
+    // Up to ms of what was captured before the recording started, as far back as the ring goes
+    AudioSpan<int16_t> beforeRecording(int ms) {
+        uint64_t back = min<uint64_t>(recordStart, (uint64_t)SAMPLE_RATE * ms / 1000);
+        back = min<uint64_t>(back, captureRing.retentionSamples());
+        AudioRing<int16_t>::Reader reader = captureRing.readerAt(recordStart - back);
+        return reader.read(back);
     }
 
-    void startPlaybackThread() { }
-
-private:
-    snd_pcm_t *capture_handle;
-    snd_pcm_t *playback_handle;
-
-    #else
-
-    // PortAudio
-    static const PaSampleFormat AUDIO_FORMAT  = paInt16;
-
-    bool openAudioInput() {
-        // Init PortAudio
-        Pa_Initialize();
-
-        // Check already open
-        if (streamIn) return true;
-
-        // Params
-        PaStreamParameters inputParameters;
-        memset(&inputParameters, 0, sizeof(inputParameters));
-        inputParameters.device = Pa_GetDefaultInputDevice();
-        inputParameters.channelCount = CHANNELS;
-        inputParameters.sampleFormat = AUDIO_FORMAT;
-        inputParameters.suggestedLatency = Pa_GetDeviceInfo(inputParameters.device)->defaultLowInputLatency;
-        inputParameters.hostApiSpecificStreamInfo = nullptr;
-
-        // Open stream
-        PaError err = Pa_OpenStream(
-            &streamIn,
-            &inputParameters,
-            nullptr,
-            SAMPLE_RATE,
-            FRAMES_PER_BUFFER,
-//               pv_sample_rate(),
-//               pv_porcupine_frame_length(),
-            paClipOff,
-            nullptr,
-            nullptr
-        );
-        //cout << "SAMPLE_RATE: " << SAMPLE_RATE << endl;
-        //cout << "FRAMES_PER_BUFFER: " << FRAMES_PER_BUFFER << endl;
-        //cout << "pv_sample_rate(): " << pv_sample_rate() << endl;
-        //cout << "pv_porc: " << pv_porcupine_frame_length() << endl;
-        if (err != paNoError) {
-            cerr << "Pa_OpenStream input failed: " << Pa_GetErrorText(err) << endl;
-            return false;
-        }
-
-        // Start stream
-        err = Pa_StartStream(streamIn);
-        if (err != paNoError) {
-            cerr << "Pa_StartStream input failed: " << Pa_GetErrorText(err) << endl;
-            return false;
-        }
-        return true;
-    }
-
-    bool openAudioOutput() {
-        // Check already open
-        if (streamOut) return true;
-
-        // Params
-        PaStreamParameters outputParameters;
-        memset(&outputParameters, 0, sizeof(outputParameters));
-        outputParameters.device = Pa_GetDefaultOutputDevice();
-        outputParameters.channelCount = CHANNELS;
-        outputParameters.sampleFormat = AUDIO_FORMAT;
-        outputParameters.suggestedLatency = Pa_GetDeviceInfo(outputParameters.device)->defaultLowOutputLatency;
-        outputParameters.hostApiSpecificStreamInfo = nullptr;
-
-        // Open stream
-        PaError err = Pa_OpenStream(
-            &streamOut,
-            nullptr,
-            &outputParameters,
-            SAMPLE_RATE,
-            FRAMES_PER_BUFFER,
-            paClipOff,
-            nullptr,
-            nullptr
-        );
-        if (err != paNoError) {
-            cerr << "Pa_OpenStream output failed: " << Pa_GetErrorText(err) << endl;
-            return false;
-        }
-
-        // Start stream
-        err = Pa_StartStream(streamOut);
-        if (err != paNoError) {
-            cerr << "Pa_StartStream output failed: " << Pa_GetErrorText(err) << endl;
-            return false;
-        }
-        return true;
-    }
-
-    void startRecording() {
-        recordedBuffer.clear();
-        isRecording = true;
-        audioBuffer.clear();
-        if (!openAudioInput()) {
-            cerr << "Cannot open input stream for recording." << endl;
-        }
+    // Position up to ms before the recording started, as far back as the ring still goes
+    uint64_t positionBeforeRecording(int ms) {
+        uint64_t oldest = captureRing.position() - min<uint64_t>(captureRing.position(), captureRing.retentionSamples());
+        uint64_t back = min<uint64_t>(recordStart, (uint64_t)SAMPLE_RATE * ms / 1000);
+        return max(recordStart - back, oldest);
     }
 
-    // Record a chunk of audio data, returns a vector of int16_t samples
-    vector<int16_t> recordChunk(int size) {
-        vector<int16_t> chunk(size, 0);
-        if (streamIn && isRecording) {
-            PaError err = Pa_ReadStream(streamIn, chunk.data(), size);
-            if (err != paNoError) {
-
-            }
-            else {
-                // Store recorded audio in buffer
-                recordedBuffer.insert(recordedBuffer.end(), chunk.begin(), chunk.end());
-            }
-        }
-        else cout << "Not recording. " << endl;
-        return chunk;
+    // Stop recording, capture carries on for the wake word
+    void stopRecording() {
+        recordEnd = captureRing.position();
     }
 
+    // Start the playback thread, audio queued before this waits for it
     void startPlaybackThread() {
-        if (!playThread.joinable()) {
-            playThread = thread(&AudioHandler::playLoop, this);
-        }
-    }
-
-    void stopPlaybackThread() {
-        lock_guard<mutex> lock(playMutex);
-        playbackRunning = false;
-        playCond.notify_one();
-        if (playThread.joinable()) {
-            playThread.join();
+        if (!playback.start(PLAYBACK_PERIOD)) {
+            cerr << "Failed to open output audio stream." << endl;
         }
     }
 
-    void playChunk(const vector<int16_t>& audioData) {
-        lock_guard<mutex> lock(playMutex);
-        playQueue.push(audioData);
-        playCond.notify_one();
+    // Queue a chunk of audio for the playback thread, never blocks
+    void playChunk(const int16_t* data, size_t size) {
+        playback.push(data, size);
     }
 
-    void stopRecording() {
-        isRecording = false;
-        stopAudioStreamIn();
-    }
-
-    void cleanup() {
-        stopAudioStreamIn();
-        stopAudioStreamOut();
-        stopPlaybackThread();
-        Pa_Terminate();
-    }
-
-    void stopAudioStreamIn() {
-        if (streamIn) {
-            Pa_StopStream(streamIn);
-            Pa_CloseStream(streamIn);
-            streamIn = nullptr;
-        }
+    void playChunk(const vector<int16_t>& data) {
+        playChunk(data.data(), data.size());
     }
 
-    void stopAudioStreamOut() {
-        if (streamOut) {
-            Pa_StopStream(streamOut);
-            Pa_CloseStream(streamOut);
-            streamOut = nullptr;
+    // The current response has no more audio
+    void endPlayback() {
+        playback.endStream();
+        if (DEBUG) {
+            AudioPlayback::Stats stats = playback.stats();
+            cout << "Playback: " << stats.underruns << " underruns, " << stats.overruns << " overruns, jitter buffer " << stats.targetMs << " ms" << endl;
         }
     }
 
-    void playLoop() {
-        // Start
-        if (!openAudioOutput()) {
-            cerr << "Failed to open output audio stream.\n";
-            return;
-        }
-        while (true) {
-            vector<int16_t> front;
-            unique_lock<mutex> lock(playMutex);
-            playCond.wait(lock, [this]{ return !playQueue.empty() || !playbackRunning; });
-
-            // If done, break out
-            //cout << "Playback running: " << playbackRunning << " " << playQueue.empty() << endl;
-            if (!playbackRunning && playQueue.empty()) { break; }
-
-            // Grab
-            front = playQueue.front();
-            playQueue.pop();
-
-            // Write to PortAudio output
-            Pa_WriteStream(streamOut, front.data(), front.size());
-        }
-        cout << "Playback done" << endl;
-        stopAudioStreamOut();
+    // Clean up
+    void cleanup() {
+        bus.stop();
+        playback.stop();
     }
 
-private:
-    // Unused
-    int *capture_handle;
-    int *playback_handle;
-
-    // Streams
-    PaStream *streamIn;
-    PaStream *streamOut;
-
-    // Flags
-    bool isRecording = false;
-    bool playbackRunning = true;
+    // Captured audio, preallocated and shared by all consumers, filled by the capture thread
+    AudioBus bus;
+    AudioRing<int16_t>& captureRing = bus.int16Stream(SAMPLE_RATE);
+    AudioRing<int16_t>& wakewordRing = bus.int16Stream(WAKEWORD_RATE);
+    AudioRing<int16_t>::Reader recordReader;
+    uint64_t recordStart = 0;
+    uint64_t recordEnd = 0;
 
-    // Playback
-    mutex playMutex;
-    thread playThread;
-    condition_variable playCond;
-    vector<int16_t> audioBuffer;
-    queue<vector<int16_t>> playQueue;
+    // Audio to play, drained by the playback thread
+    AudioPlayback playback;
 
-    #endif
-
-public:
-
-    // Play back recorded buffer
-    vector<int16_t> recordedBuffer;
+    // Play back the last recording straight out of the capture ring
     bool isPlayingBack = false;
     void playbackRecordedAudio() {
-        if (recordedBuffer.empty()) {
+        AudioRing<int16_t>::Reader reader = captureRing.readerAt(recordStart);
+        if (reader.available() == 0 || recordEnd <= reader.position()) {
             cout << "No recorded audio to play back" << endl;
             return;
         }
-        
+
         // Play in chunks
         isPlayingBack = true;
         cout << "Playing back recorded audio..." << endl;
-        size_t position = 0;
-        const size_t CHUNK_SIZE = FRAMES_PER_BUFFER;        
-        while (position < recordedBuffer.size()) {
-            size_t remaining = recordedBuffer.size() - position;
-            size_t chunkSize = min(CHUNK_SIZE, remaining);
-            vector<int16_t> chunk(recordedBuffer.begin() + position, recordedBuffer.begin() + position + chunkSize);
-            playChunk(chunk);
-            position += chunkSize;
-        }        
+        while (reader.position() < recordEnd) {
+            size_t chunkSize = min<uint64_t>(FRAMES_PER_BUFFER, recordEnd - reader.position());
+            AudioSpan<int16_t> chunk = reader.read(chunkSize);
+            if (chunk.empty()) break;
+            playChunk(chunk.first, chunk.firstSize);
+            if (chunk.secondSize) playChunk(chunk.second, chunk.secondSize);
+        }
+        endPlayback();
         isPlayingBack = false;
         cout << "Playback complete" << endl;
     }
@@ -448,355 +298,18 @@ public:
 AudioHandler audioHandler;
 
 // -----------------------------------------------------------
-// OpenAIClient (WebSocket connection to OpenAI Realtime API)
+// Wakeword
 // -----------------------------------------------------------
-class OpenAIClient {
+class Wakeword {
 public:
-
-    // Functions
-    vector<string> functions = {"move_head", "move_face"};
-
-    OpenAIClient(const string& instructions_, const string& voice_): instructions(instructions_), voice(voice_), context(nullptr), wsi(nullptr) {
-        // Build session config JSON
-        json sessionConfig = {
-            //{"modalities", {"text"}},
-            {"modalities", {"audio", "text"}},
-            {"instructions", instructions},
-            {"voice", voice},
-            {"input_audio_format", "pcm16"},
-            {"output_audio_format", "pcm16"},
-            {"turn_detection", {/*
-                {"type", "server_vad"},
-                {"threshold", 0.5},
-                {"prefix_padding_ms", 300},
-                {"silence_duration_ms", 600}
-            */}},
-            {"tools", {
-                {
-                    {"type", "function"},
-                    {"name", functions[0]},
-                    {"description", "Move your head to point more left, right, up, or down, to look in a direction."},
-                    {"parameters", {
-                        {"type", "object"},
-                        {"properties", {
-                            {"direction", {
-                                {"type", "string"},
-                                {"description", "The direction to move."},
-                                {"enum", {
-                                    "Up",
-                                    "Down", 
-                                    "Left",
-                                    "Right"
-                                }}
-                            }}
-                        }},
-                        {"required", {"direction"}}
-                    }}
-                }
-            }},
-            {"tool_choice", "auto"},
-            {"input_audio_transcription", {{"model", "whisper-1"}}},
-            {"temperature", 0.6}
-        };
-        sessionConfigStr = sessionConfig.dump();
-    }
-
-    ~OpenAIClient() {
-        if (context) {
-            lws_context_destroy(context);
-            context = nullptr;
-        }
-    }
-
-    // Initialize the WebSocket client
-    bool initWebSocket() {
-        // Context
-        struct lws_context_creation_info info;
-        memset(&info, 0, sizeof info);
-
-        // Only log errors and warnings
-        int logs = LLL_ERR | LLL_WARN; //| LLL_INFO;
-        lws_set_log_level(logs, NULL);
-
-        // Configure
-        info.port = CONTEXT_PORT_NO_LISTEN;
-        info.protocols = protocols;
-        info.gid = -1;
-        info.uid = -1;
-        info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
-        #ifdef __linux__
-        info.client_ssl_ca_filepath = "/etc/ssl/certs/ca-certificates.crt";
-        #endif
-
-        // Create
-        context = lws_create_context(&info);
-        if (!context) {
-            cerr << "Failed to create lws context." << endl;
-            return false;
-        }
-
-        // Connect to wss://api.openai.com/v1/realtime?model=MODEL
-        struct lws_client_connect_info ccinfo = {0};
-        ccinfo.context = context;
-        ccinfo.address = "api.openai.com";
-        ccinfo.host = ccinfo.address;
-        ccinfo.port = 443;
-        string path = "/v1/realtime?model=" + MODEL;
-        ccinfo.path = path.c_str();
-        ccinfo.origin = "origin";
-        ccinfo.ssl_connection = LCCSCF_USE_SSL;
-        ccinfo.userdata = this;
-        wsi = lws_client_connect_via_info(&ccinfo);
-        if (!wsi) {
-            cerr << "Failed to connect to server." << endl;
-            return false;
-        }
-        return true;
-    }
-
-    // Service loop
-    void serviceLoop() {
-        while (true) {
-            lws_service(context, 50);
-            if (stopRequested) break;
-        }
-    }
-
-    // Send event
-    void sendEvent(const json &event) {
-        if (!isConnected || wsi == nullptr) {
-            // The socket is closed
-            cout << "Error: socket is closed." << endl;
+    Wakeword(): handle(nullptr) {
+        // Built-in spotter instead of Porcupine
+        const char* engine = getenv("WAKEWORD_ENGINE");
+        if (engine && string(engine) == "kws") {
+            if (!spotter.load("../wakeword/kws.gguf")) cerr << "Failed to init keyword spotter.\n";
             return;
         }
 
-        // Get mutex and payload
-        lock_guard<mutex> lock(writeMutex);
-        string payload = event.dump();
-
-        // The libwebsockets library requires us to allocate buffer with extra space for the WS framing
-        size_t len = LWS_PRE + payload.size();
-        vector<unsigned char> buf(len);
-        memcpy(buf.data() + LWS_PRE, payload.data(), payload.size());
-
-        // Send
-        lws_write(wsi, buf.data() + LWS_PRE, payload.size(), LWS_WRITE_TEXT);
-    }
-
-    // Called once the connection is established, we send "session.update"
-    void onConnected() {
-        isConnected = true;
-        json event { {"type", "session.update"}, {"session", json::parse(sessionConfigStr)} };
-        sendEvent(event);
-    }
-
-    // Handler for incoming messages
-    void onMessage(const string& msg) {
-        // Parse JSON
-        //cout << msg << endl;
-        auto j = json::parse(msg, nullptr, false);
-        if (j.is_discarded()) {
-            cerr << "Bad JSON: " << msg << endl;
-            return;
-        }
-        if (j.contains("type")) {
-            string type = j["type"].get<string>();
-            if (type == "response.audio_transcript.delta" || type == "response.text.delta") {
-                // Get this chunk of response
-                string part = j["delta"].get<string>();
-                cout << "" << part << "";
-                response += part;
-                flush(cout);
-
-                // Update mouth shape based on phonemes in the text
-                char mouth_shape = '_';
-                string upperPart = part;
-                transform(upperPart.begin(), upperPart.end(), upperPart.begin(), ::toupper);
-                if (upperPart.find("M") != string::npos) mouth_shape = 'M';
-                else if (upperPart.find("F") != string::npos) mouth_shape = 'F';
-                else if (upperPart.find("H") != string::npos) mouth_shape = 'F';
-                else if (upperPart.find("E") != string::npos) mouth_shape = 'F';
-                else if (upperPart.find("L") != string::npos) mouth_shape = 'L';
-                else if (upperPart.find("T") != string::npos) mouth_shape = 'T';
-                face.mouth_shape = mouth_shape;
-
-                // Commands
-              /*if (response.find("<UP>")      != string::npos) { move_head(   0,   40); move_face( 0,  1); response.clear(); }
-                if (response.find("<DOWN>")    != string::npos) { move_head(   0,  -40); move_face( 0, -1); response.clear(); }
-                if (response.find("<LEFT>")    != string::npos) { move_head(  40,    0); move_face( 0,  0); response.clear(); }
-                if (response.find("<RIGHT>")   != string::npos) { move_head( -40,    0); move_face( 0,  0); response.clear(); }
-                if (response.find("<UP 2>")    != string::npos) { move_head( 900,    0); move_face( 5,  0); response.clear(); }
-                if (response.find("<DOWN 2>")  != string::npos) { move_head(-900,    0); move_face(-5,  0); response.clear(); }
-                if (response.find("<LEFT 2>")  != string::npos) { move_head(   0,  200); move_face( 5,  0); response.clear(); }
-                if (response.find("<RIGHT 2>") != string::npos) { move_head(   0, -200); move_face(-5,  0); response.clear(); }
-                */
-            }
-            else if (type == "response.audio.done") {
-                cout << endl;
-                response.clear();
-            }
-            else if (type == "response.function_call_arguments.done") {
-                // Parse the complete function arguments
-                auto args = json::parse(j["arguments"].get<string>());
-                string function = j["name"].get<string>();
-                
-                // Call the corresponding function
-                if (function == functions[0]) {
-                    string direction = args["direction"].get<string>();
-                    move_head(direction);
-                }
-            }
-            else if (type == "response.audio.delta") {
-                // Base64 decode
-                string b64data = j["delta"].get<string>();
-                vector<uint8_t> audioBytes = base64Decode(b64data);
-
-                // Convert to int16_t for playback
-                vector<int16_t> samples(audioBytes.size() / 2);
-                memcpy(samples.data(), audioBytes.data(), audioBytes.size());
-
-                // Play
-                audioHandler.playChunk(samples);
-            }
-            else if (type == "response.done") {
-                cout << "Response generation completed.\n";
-                talking = false;
-            }
-            else if (type == "session.created") {
-                audioHandler.startPlaybackThread();
-            }
-            else if (type == "session.updated") {
-                if (DEBUG) cout << "Event: " << j.dump() << endl;
-                ready = true;
-            }
-            else if (type == "error") {
-                cerr << "Error event received: " << j.dump() << endl;
-            }
-            else {
-                if (DEBUG) cout << "Event: " << j["type"] << ": " << j.dump() << endl;
-            }
-        }
-    }
-
-    // Called on close
-    void onClose() {
-        cout << "Websocket closed." << endl;
-        isConnected = false;
-        wsi = nullptr;
-    }
-
-    void close() {
-        if (wsi) {
-            lws_callback_on_writable(wsi);
-            lws_cancel_service(lws_get_context(wsi));
-            wsi = nullptr;
-        }
-        isConnected = false;
-        stopRequested = true;
-    }
-
-    // Flags
-    bool ready = false;
-    bool talking = false;
-    bool isConnected = false;
-
-    // Response text as it comes in
-    string response;
-
-private:
-    // The libwebsockets callbacks
-    static int callback_openai(struct lws* wsi, enum lws_callback_reasons reason, void* user, void* in, size_t len) {
-        auto* client = reinterpret_cast<OpenAIClient*>(lws_wsi_user(wsi));
-        //if (DEBUG) printf("Callback reason: %d\n", reason);
-        switch (reason) {
-            case LWS_CALLBACK_CLIENT_APPEND_HANDSHAKE_HEADER:
-                {
-                    // The 'in' is a pointer to pointer to the free space in the buffer, 'len' is how much space we have
-                    unsigned char** p = (unsigned char**) in;
-                    unsigned char* end = (*p) + len;
-
-                    // Add "Authorization: Bearer <OPENAI_KEY>"
-                    string authValue = "Bearer " + OPENAI_KEY;
-                    int ret = lws_add_http_header_by_name(wsi,
-                        (unsigned char*)"Authorization:",
-                        (unsigned char*)authValue.c_str(),
-                        authValue.size(),
-                        p, end);
-
-                    // Add "OpenAI-Beta: realtime=v1"
-                    ret = lws_add_http_header_by_name(wsi,
-                        (unsigned char*)"OpenAI-Beta:",
-                        (unsigned char*)"realtime=v1",
-                        strlen("realtime=v1"),
-                        p, end);
-                }
-                break;
-            case LWS_CALLBACK_CLIENT_ESTABLISHED:
-                // Connection established
-                printf("Connected to OpenAI.\n");
-                client->onConnected();
-                break;
-            case LWS_CALLBACK_CLIENT_RECEIVE:
-                // Received a message
-                if (in && len > 0) {
-                    string msg((char *)in, len);
-                    client->onMessage(msg);
-                }
-                break;
-            case LWS_CALLBACK_CLIENT_CLOSED:
-                client->onClose();
-                break;
-            case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
-                cout << "Connection error:" << endl;
-                client->onClose();
-                if (in && len > 0) {
-                    string msg((char*)in, len);
-                    cout << msg << endl;
-                }
-                break;
-            default:
-                if (DEBUG) {
-                    //cout << "Other:" << endl;
-                    if (in && len > 0) {
-                        string msg((char*)in, len);
-                        cout << msg << endl;
-                    }
-                }
-                break;
-        }
-        return 0;
-    }
-
-    // Data
-    static struct lws_protocols protocols[];
-    struct lws_context *context;
-    struct lws *wsi;
-    mutex writeMutex;
-    bool stopRequested = false;
-
-    // Params
-    string instructions;
-    string voice;
-    string sessionConfigStr;
-};
-
-// Definition of the websocket protocols
-struct lws_protocols OpenAIClient::protocols[] = {
-    {
-        "realtime-protocol",
-        callback_openai,
-        100*1024, // Per-session data size
-        100*1024, // Receive buffer size
-    },
-    { nullptr, nullptr, 0, 0 }
-};
-
-// -----------------------------------------------------------
-// Wakeword
-// -----------------------------------------------------------
-class Wakeword {
-public:
-    Wakeword(): handle(nullptr), listening(false) {
         // Init
         #ifdef __linux__
             const char* keyword_paths[] = { "../wakeword/hey_robot_pi.ppn" };
@@ -819,50 +332,114 @@ public:
     }
 
     ~Wakeword() {
+        stop();
         if (handle) {
             pv_porcupine_delete(handle);
         }
     }
 
-    // Start listening in a blocking fashion, can move to separate thread
+    // Block until the wake word is heard, false if there is no detector. The detector thread runs
+    // on the always-on capture stream, and only between a listen() and the detection it returns.
     bool listen() {
         // Check init
-        if (!handle) { return false; }
-
-        // Start mic
-        audioHandler.startRecording();
-        cout << "Listening for wake word...\n";
+        if (!isReady()) { return false; }
 
-        // Listen
-        listening = true;
-        while (listening) {
-            // Read data
-            auto chunk = audioHandler.recordChunk(pv_porcupine_frame_length());
-            if (!chunk.empty()) {
-                int32_t keyword_index = -1;
-                pv_status_t status = pv_porcupine_process(handle, chunk.data(), &keyword_index);
-                if (status != PV_STATUS_SUCCESS) { cout << "Error" << endl; continue; }
-
-                // Detected?
-                if (keyword_index >= 0) {
-                    cout << "Wake word detected!\n";
-                    stop();
-                }
-            }
+        // Start mic and detector
+        if (!audioHandler.startCapture()) return false;
+        if (!detector.joinable()) {
+            running = true;
+            detector = thread(&Wakeword::detectLoop, this);
         }
+        cout << "Listening for wake word...\n";
 
-        // Got it
-        audioHandler.stopRecording();
-        return true;
+        // Arm and wait
+        unique_lock<mutex> lock(detectMutex);
+        armed = true;
+        detected = false;
+        detectChanged.notify_all();
+        detectChanged.wait(lock, [this] { return detected || !running; });
+        return detected;
     }
 
+    bool isReady() const { return handle != nullptr || spotter.isReady(); }
+
+    // Capture time of the end of the last wake word
+    int64_t detectionTime() const { return detectedAt; }
+
     void stop() {
-        listening = false;
+        {
+            lock_guard<mutex> lock(detectMutex);
+            running = false;
+        }
+        detectChanged.notify_all();
+        if (detector.joinable()) detector.join();
     }
 
 private:
+    // Wakes a few frames at a time rather than for every one, and sleeps outright while disarmed
+    void detectLoop() {
+        int frameLength = spotter.isReady() ? spotter.frameLength() : pv_porcupine_frame_length();
+        frame.resize(frameLength);
+        AudioRing<int16_t>& ring = audioHandler.wakewordRing;
+        AudioRing<int16_t>::Reader reader = ring.reader();
+        while (true) {
+            // Wait to be armed, then start from the live edge
+            {
+                unique_lock<mutex> lock(detectMutex);
+                if (!armed) {
+                    detectChanged.wait(lock, [this] { return armed || !running; });
+                    reader.seek(ring.position());
+                    spotter.reset();
+                }
+                if (!running) break;
+            }
+
+            // A batch of frames, both engines want 16 kHz
+            if (!reader.wait((size_t)frameLength * WAKEWORD_FRAMES_PER_WAKE)) {
+                this_thread::sleep_for(chrono::milliseconds(100));
+                continue;
+            }
+            while (reader.available() >= (size_t)frameLength) {
+                auto chunk = reader.read(frameLength);
+                bool heard = false;
+                if (spotter.isReady()) {
+                    heard = spotter.process(chunk.data(frame.data()));
+                }
+                else {
+                    int32_t keyword_index = -1;
+                    pv_status_t status = pv_porcupine_process(handle, chunk.data(frame.data()), &keyword_index);
+                    if (status != PV_STATUS_SUCCESS) { cout << "Error" << endl; continue; }
+                    heard = keyword_index >= 0;
+                }
+
+                // Detected, note when the keyword ended so the turn can start right there
+                if (heard) {
+                    cout << "Wake word detected!\n";
+                    lock_guard<mutex> lock(detectMutex);
+                    detectedAt = ring.timeOf(chunk.position + chunk.size());
+                    detected = true;
+                    armed = false;
+                    detectChanged.notify_all();
+                    break;
+                }
+            }
+        }
+    }
+
     pv_porcupine_t *handle;
-    bool listening;
+    KeywordSpotter spotter;
+
+    // Detector thread
+    thread detector;
+    mutex detectMutex;
+    condition_variable detectChanged;
+    bool running = false;
+    bool armed = false;
+    bool detected = false;
+    int64_t detectedAt = 0;
+
+    // Only used when a frame wraps around the end of the capture ring
+    vector<int16_t> frame;
 };
 
 // -----------------------------------------------------------
@@ -870,23 +447,51 @@ private:
 // -----------------------------------------------------------
 class VoiceAssistant {
 public:
-    VoiceAssistant(): openAIClient(INSTRUCTIONS, VOICE), wakeword() { }
+    VoiceAssistant(): openAIClient(OPENAI_KEY, MODEL, sessionConfig(), RealtimeEndpoint::fromEnvironment()), wakeword() {
+        // Responses come back on the websocket's service thread
+        OpenAIClient::Handlers handlers;
+        handlers.audio = [](const int16_t* samples, size_t count) { audioHandler.playChunk(samples, count); };
+        handlers.audioDone = [this] { onAudioDone(); };
+        handlers.transcript = [this](const string& part) { onTranscript(part); };
+        handlers.functionCall = [this](const string& callId, const string& name, const json& args) { onFunctionCall(callId, name, args); };
+        openAIClient.setHandlers(handlers);
+
+        // Audio format on the wire, G.711 for units on weak Wi-Fi
+        const char* codecName = getenv("REALTIME_CODEC");
+        RealtimeCodec codec;
+        if (codecName && parseRealtimeCodec(codecName, codec)) openAIClient.setCodec(codec);
+        else if (codecName) cerr << "Unknown REALTIME_CODEC " << codecName << ", using pcm16." << endl;
+
+        // Keep what the API sends, for replaying through the mock server
+        const char* tracePath = getenv("REALTIME_TRACE");
+        if (tracePath) openAIClient.recordTrace(tracePath);
+    }
+
+    // Tool calls post back through the client, so the worker stops first
+    ~VoiceAssistant() {
+        tools.stop();
+    }
 
     void run() {
-        // Init websockets and start a thread that runs the websocket's service loop
-        if (!openAIClient.initWebSocket()) {
+        // Audio can arrive as soon as the first session is up
+        audioHandler.startPlaybackThread();
+
+        // Start connecting, with a thread that runs the websocket's service loop, sessions warm up in the background
+        if (!openAIClient.start()) {
             cerr << "Websocket init failed.\n";
             return;
         }
         thread wsThread([this] { openAIClient.serviceLoop(); });
 
-        // Wait for session creation
-        this_thread::sleep_for(chrono::seconds(1));
-
         // Main loop
         while (true) {
-            // Listen for wake word
-            //wakeword.listen();
+            // Listen for wake word, the turn then starts where the keyword ended, so the keyword itself isn't
+            // endpointed and a pause after it waits for speech rather than ending the turn
+            if (wakeword.isReady()) {
+                if (!wakeword.listen()) break;
+                startConversation(wakeword.detectionTime());
+                continue;
+            }
 
             // Start conversation
             startConversation();
@@ -899,6 +504,8 @@ public:
 
         // Clean up
         cout << "Speaking becoming done." << endl;
+        wakeword.stop();
+        tools.stop();
         openAIClient.close();
         if (wsThread.joinable()) { wsThread.join(); }
         audioHandler.cleanup();
@@ -906,12 +513,72 @@ public:
     }
 
 private:
-    void startConversation() {
+    // Tools, before the client since the session config lists them
+    ToolExecutor tools = ToolExecutor(robotTools());
+
+    // Session config sent on every connection, the client fills in the audio formats for its codec
+    json sessionConfig() {
+        return {
+            //{"modalities", {"text"}},
+            {"modalities", {"audio", "text"}},
+            {"instructions", INSTRUCTIONS},
+            {"voice", VOICE},
+            {"turn_detection", {/*
+                {"type", "server_vad"},
+                {"threshold", 0.5},
+                {"prefix_padding_ms", 300},
+                {"silence_duration_ms", 600}
+            */}},
+            {"tools", tools.definitions()},
+            {"tool_choice", "auto"},
+            {"input_audio_transcription", {{"model", "whisper-1"}}},
+            {"temperature", 0.6}
+        };
+    }
+
+    // A piece of the response text
+    void onTranscript(const string& part) {
+        cout << "" << part << "";
+        response += part;
+        flush(cout);
+        caption.append(part);
+
+        // Commands
+      /*if (response.find("<UP>")      != string::npos) { move_head(   0,   40); move_face( 0,  1); response.clear(); }
+        if (response.find("<DOWN>")    != string::npos) { move_head(   0,  -40); move_face( 0, -1); response.clear(); }
+        if (response.find("<LEFT>")    != string::npos) { move_head(  40,    0); move_face( 0,  0); response.clear(); }
+        if (response.find("<RIGHT>")   != string::npos) { move_head( -40,    0); move_face( 0,  0); response.clear(); }
+        if (response.find("<UP 2>")    != string::npos) { move_head( 900,    0); move_face( 5,  0); response.clear(); }
+        if (response.find("<DOWN 2>")  != string::npos) { move_head(-900,    0); move_face(-5,  0); response.clear(); }
+        if (response.find("<LEFT 2>")  != string::npos) { move_head(   0,  200); move_face( 5,  0); response.clear(); }
+        if (response.find("<RIGHT 2>") != string::npos) { move_head(   0, -200); move_face(-5,  0); response.clear(); }
+        */
+    }
+
+    // The response has no more audio
+    void onAudioDone() {
+        audioHandler.endPlayback();
+        cout << endl;
+        response.clear();
+        caption.finish();
+    }
+
+    // Run the tool on the executor, its output goes back through the outbound queue
+    void onFunctionCall(const string& callId, const string& name, const json& args) {
+        if (DEBUG) cout << "Calling " << name << " " << args.dump() << endl;
+        bool queued = tools.call(callId, name, args, [this](const string& id, const json& output) {
+            openAIClient.sendFunctionOutput(id, output);
+        });
+        if (!queued) openAIClient.sendFunctionOutput(callId, { {"error", "No tool called " + name} });
+    }
+
+    // Without a wake word time the robot speaks first, with one the user's turn starts from then
+    void startConversation(int64_t fromNs = 0) {
         cout << "Starting conversation...\n";
 
-        // Sleep until OpenAI is session.updated ready
-        while (!openAIClient.ready) {
-            this_thread::sleep_for(chrono::milliseconds(100));
+        // Wait until a session is connected and configured
+        while (!openAIClient.waitReady(5000)) {
+            cout << "Waiting for OpenAI session..." << endl;
         }
 
         // Ask a question in text
@@ -927,50 +594,99 @@ private:
          openAIClient.sendEvent(eventAsk);
         }
 
-        // Ask for a response
-        json eventHey{ {"type", "response.create"} };
-        openAIClient.sendEvent(eventHey);
-        if (true || DEBUG) cout << "Sent response.create" << endl;
-
-        // Indicate listening
-        move_head(0, 100);
-        this_thread::sleep_for(chrono::milliseconds(1000));
-        move_head(0, -100);
-        this_thread::sleep_for(chrono::milliseconds(1000));
-
-        // Start mic
-        face.eye_height = 40;
-        if (true) {
-        audioHandler.startRecording();
-
-        // Send audio chunks to the OpenAI realtime API
-        for (int i = 0; i < 40; i++) {
-            // Get audio chunk
-            auto chunk = audioHandler.recordChunk(FRAMES_PER_BUFFER);
-            if (!chunk.empty()) {
-                cout << "Listening... " << i << endl;
-
-                // Base64 encode
-                string b64chunk = base64Encode(reinterpret_cast<const uint8_t*>(chunk.data()), chunk.size()*sizeof(int16_t));
-
-                // Send to OpenAI
-                json event{ {"type", "input_audio_buffer.append"}, {"audio", b64chunk} };
-                openAIClient.sendEvent(event);
-
-                // Throttle sending
-                this_thread::sleep_for(chrono::milliseconds(100));
+        // Woken up, no greeting or nod so nothing the user says next is missed, the face shows it's listening
+        bool recording;
+        if (fromNs) {
+            listening = true;
+            recording = audioHandler.startRecordingFrom(fromNs);
+        }
+        else {
+            // Ask for a response
+            json eventHey{ {"type", "response.create"} };
+            openAIClient.sendEvent(eventHey);
+            if (true || DEBUG) cout << "Sent response.create" << endl;
+
+            // Indicate listening
+            move_head(0, 100);
+            this_thread::sleep_for(chrono::milliseconds(1000));
+            move_head(0, -100);
+            this_thread::sleep_for(chrono::milliseconds(1000));
+
+            // Start mic
+            listening = true;
+            recording = audioHandler.startRecording();
+        }
+
+        // No microphone, nothing to listen to
+        if (!recording) {
+            listening = false;
+            return;
+        }
+
+        // Stream audio to the OpenAI realtime API as it is captured, only once the user is speaking
+        VoiceActivityDetector vad(SAMPLE_RATE, ENDPOINT_SILENCE_MS);
+        vad.prime(audioHandler.beforeRecording(ENDPOINT_FLOOR_MS));
+        uint64_t start = audioHandler.recordStart;
+        uint64_t sent = start;
+        bool streaming = false;
+        while (vad.state() != VoiceActivityDetector::Ended) {
+            // Let audio build up in the capture ring while the socket is backed up
+            if (!openAIClient.isConnected) break;
+            if (!openAIClient.canSend()) {
+                this_thread::sleep_for(chrono::milliseconds(5));
+                continue;
+            }
+
+            // Take everything captured since the last look
+            auto chunk = audioHandler.recordAvailable(UPLINK_MIN_FRAMES, UPLINK_MAX_FRAMES);
+            if (chunk.empty()) break;
+            vad.process(chunk);
+            uint64_t end = chunk.position + chunk.size();
+            uint64_t elapsedMs = (end - start) * 1000 / SAMPLE_RATE;
+
+            // Nothing goes up during silence
+            if (!vad.heardSpeech()) {
+                if (elapsedMs >= ENDPOINT_NO_SPEECH_MS) break;
+                continue;
             }
+
+            // Speech just started, send from a little before it, back past the end of the wake word if it
+            // came straight after, since the detector only notices the keyword once it's over
+            if (!streaming) {
+                uint64_t onset = start + vad.speechStart();
+                uint64_t earliest = fromNs ? audioHandler.positionBeforeRecording(WAKEWORD_PREROLL_MS) : start;
+                sent = max(earliest, onset - min<uint64_t>(onset, SAMPLE_RATE * SPEECH_PREROLL_MS / 1000));
+                streaming = true;
+                cout << "Listening..." << endl;
+            }
+
+            // Send everything up to the end of this chunk
+            AudioRing<int16_t>::Reader reader = audioHandler.captureRing.readerAt(sent);
+            while (reader.position() < end) {
+                auto span = reader.read(min<uint64_t>(UPLINK_MAX_FRAMES, end - reader.position()));
+                if (span.empty()) break;
+                sendAudio(span);
+            }
+            sent = end;
+            if (elapsedMs >= ENDPOINT_MAX_TURN_MS) break;
         }
 
         // Stop recording
         cout << "Done listening." << endl;
         audioHandler.stopRecording();
-        face.eye_height = 10;
+        listening = false;
 
         // Play back the recorded audio
-        cout << "Playing back what was recorded..." << endl;
-        audioHandler.playbackRecordedAudio();
-        this_thread::sleep_for(chrono::milliseconds(1000));
+        if (ECHO_RECORDING) {
+            cout << "Playing back what was recorded..." << endl;
+            audioHandler.playbackRecordedAudio();
+        }
+
+        // Nothing said, nothing was sent
+        if (!vad.heardSpeech()) {
+            cout << "No speech heard." << endl;
+            return;
+        }
 
         // Commit the audio buffer
         json event{ {"type", "input_audio_buffer.commit"} };
@@ -981,7 +697,6 @@ private:
         json eventResponse{ {"type", "response.create"} };
         openAIClient.sendEvent(eventResponse);
         if (DEBUG) cout << "Sent response.create" << endl;
-        }
 
         // Sleep until OpenAI is done
         openAIClient.talking = true;
@@ -989,9 +704,21 @@ private:
         cout << "Speaking almost done." << endl;
     }
 
+    // Append a span of captured audio to the input buffer
+    void sendAudio(const AudioSpan<int16_t>& chunk) {
+        if (chunk.empty()) return;
+        openAIClient.sendAudio(chunk.data(uplinkScratch.data()), chunk.size());
+    }
+
 private:
     OpenAIClient openAIClient;
     Wakeword wakeword;
+
+    // Response text as it comes in
+    string response;
+
+    // Only used when a chunk wraps around the end of the capture ring
+    vector<int16_t> uplinkScratch = vector<int16_t>(FRAMES_PER_BUFFER);
 };
 
 int speak(bool &quit) {
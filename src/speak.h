@@ -1,2 +1,8 @@
+#pragma once
+
+#include <atomic>
+
 int speak(bool &quit);
 
+// True while the robot is listening to the user, the face shows it
+extern std::atomic<bool> listening;
@@ -0,0 +1,260 @@
+// Deskman robot.
+// Text renderer module.
+// Thomas Jacobs
+
+#include "text_renderer.h"
+#include <cctype>
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+
+// Atlas size in pixels, plenty for a couple of sizes of Latin text
+static const int ATLAS_SIZE = 512;
+
+// Empty pixels between glyphs, so filtering doesn't pick up a neighbour
+static const int GAP = 1;
+
+// Runs kept before the cache starts over
+static const size_t MAX_RUNS = 512;
+
+// Caption lines on screen, and how long a caption stays after the reply
+static const int CAPTION_LINES = 2;
+static const int CAPTION_HOLD_MS = 4000;
+
+// Next code point in UTF-8 text, bytes that aren't valid UTF-8 pass through as Latin-1
+static uint32_t nextCodepoint(const string& text, size_t& at) {
+    unsigned char first = text[at++];
+    int length = first >= 0xF0 ? 3 : first >= 0xE0 ? 2 : first >= 0xC0 ? 1 : 0;
+    if (length == 0 || at + length > text.size()) return first;
+    uint32_t codepoint = first & (0x3F >> length);
+    for (int i = 0; i < length; i++) {
+        unsigned char next = text[at + i];
+        if ((next & 0xC0) != 0x80) return first;
+        codepoint = codepoint << 6 | (next & 0x3F);
+    }
+    at += length;
+    return codepoint;
+}
+
+// -----------------------------------------------------------
+// Text renderer
+// -----------------------------------------------------------
+
+bool TextRenderer::load(SDL_Renderer* renderer_, TTF_Font* font_) {
+    if (!font_) {
+        cerr << "No font for text." << endl;
+        return false;
+    }
+    renderer = renderer_;
+    font = font_;
+    lineSkip = TTF_FontLineSkip(font);
+
+    // Transparent to start with, glyphs are white and take their colour from the vertices
+    atlas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, ATLAS_SIZE, ATLAS_SIZE);
+    if (!atlas) {
+        cerr << "Could not create glyph atlas: " << SDL_GetError() << endl;
+        return false;
+    }
+    SDL_SetTextureBlendMode(atlas, SDL_BLENDMODE_BLEND);
+    vector<uint32_t> clear(ATLAS_SIZE * ATLAS_SIZE, 0);
+    SDL_UpdateTexture(atlas, NULL, clear.data(), ATLAS_SIZE * 4);
+
+    for (uint32_t c = ' '; c <= '~'; c++) glyph(c);
+    return true;
+}
+
+void TextRenderer::unload() {
+    if (atlas) SDL_DestroyTexture(atlas);
+    atlas = nullptr;
+    glyphs.clear();
+    runs.clear();
+    shelfX = shelfY = shelfHeight = 0;
+}
+
+const TextRenderer::Glyph& TextRenderer::glyph(uint32_t codepoint) {
+    auto found = glyphs.find(codepoint);
+    if (found != glyphs.end()) return found->second;
+
+    // Not in the font, shows as a question mark
+    int minx, maxx, miny, maxy, advance;
+    if (!TTF_GlyphIsProvided32(font, codepoint) || TTF_GlyphMetrics32(font, codepoint, &minx, &maxx, &miny, &maxy, &advance) != 0) {
+        Glyph fallback = codepoint == '?' ? Glyph() : glyph('?');
+        return glyphs[codepoint] = fallback;
+    }
+    Glyph& g = glyphs[codepoint];
+    g.advance = advance;
+    if (maxx <= minx) return g;
+
+    // Rendered glyphs start at the pen, or further left if the glyph reaches back past it
+    SDL_Surface* rendered = TTF_RenderGlyph32_Blended(font, codepoint, { 255, 255, 255, 255 });
+    if (!rendered) return g;
+    SDL_Surface* surface = SDL_ConvertSurfaceFormat(rendered, SDL_PIXELFORMAT_ARGB8888, 0);
+    SDL_FreeSurface(rendered);
+    if (!surface) return g;
+
+    // Next shelf if this one's full
+    if (shelfX + surface->w > ATLAS_SIZE) {
+        shelfX = 0;
+        shelfY += shelfHeight + GAP;
+        shelfHeight = 0;
+    }
+    if (shelfY + surface->h > ATLAS_SIZE) {
+        cerr << "Glyph atlas is full." << endl;
+    }
+    else {
+        g.source = { shelfX, shelfY, surface->w, surface->h };
+        g.offset = min(minx, 0);
+        SDL_UpdateTexture(atlas, &g.source, surface->pixels, surface->pitch);
+        shelfX += surface->w + GAP;
+        shelfHeight = max(shelfHeight, surface->h);
+    }
+    SDL_FreeSurface(surface);
+    return g;
+}
+
+const TextRenderer::Run& TextRenderer::shape(const string& text) {
+    auto found = runs.find(text);
+    if (found != runs.end()) return found->second;
+    if (runs.size() >= MAX_RUNS) runs.clear();
+
+    // Glyphs along the pen, kerned
+    Run& run = runs[text];
+    SDL_Color white = { 255, 255, 255, 255 };
+    float pen = 0;
+    uint32_t previous = 0;
+    for (size_t at = 0; at < text.size(); ) {
+        uint32_t codepoint = nextCodepoint(text, at);
+        if (previous) pen += TTF_GetFontKerningSizeGlyphs32(font, previous, codepoint);
+        const Glyph& g = glyph(codepoint);
+        if (g.source.w > 0) {
+            float x0 = pen + g.offset, x1 = x0 + g.source.w, y1 = g.source.h;
+            float u0 = (float)g.source.x / ATLAS_SIZE, u1 = (float)(g.source.x + g.source.w) / ATLAS_SIZE;
+            float v0 = (float)g.source.y / ATLAS_SIZE, v1 = (float)(g.source.y + g.source.h) / ATLAS_SIZE;
+            run.vertices.push_back({ { x0, 0 }, white, { u0, v0 } });
+            run.vertices.push_back({ { x1, 0 }, white, { u1, v0 } });
+            run.vertices.push_back({ { x1, y1 }, white, { u1, v1 } });
+            run.vertices.push_back({ { x0, y1 }, white, { u0, v1 } });
+        }
+        pen += g.advance;
+        previous = codepoint;
+    }
+    run.width = pen;
+    return run;
+}
+
+void TextRenderer::draw(Mesh& mesh, const Run& run, float x, float y, SDL_Color color) const {
+    for (size_t i = 0; i + 4 <= run.vertices.size(); i += 4) {
+        int base = (int)mesh.vertices.size();
+        for (int k = 0; k < 4; k++) {
+            const SDL_Vertex& v = run.vertices[i + k];
+            mesh.add({ v.position.x + x, v.position.y + y }, color, v.tex_coord);
+        }
+        mesh.quad(base, base + 1, base + 2, base + 3);
+    }
+}
+
+// -----------------------------------------------------------
+// Caption
+// -----------------------------------------------------------
+
+void Caption::append(const string& text) {
+    events.push({ text, false });
+}
+
+void Caption::finish() {
+    events.push({ "", true });
+}
+
+void Caption::clear() {
+    text.clear();
+    words.clear();
+    laidOut = 0;
+}
+
+bool Caption::update(TextRenderer& textRenderer, float width) {
+    bool changed = false;
+
+    // Held long enough
+    if (finished && !text.empty() && Clock::now() - finishedAt > chrono::milliseconds(CAPTION_HOLD_MS)) {
+        clear();
+        changed = true;
+    }
+
+    // New text, a new reply replaces the last one
+    while (Event* event = events.front()) {
+        if (event->finish) {
+            finished = true;
+            finishedAt = Clock::now();
+        }
+        else {
+            if (finished) clear();
+            finished = false;
+            text += event->text;
+            changed = true;
+        }
+        events.pop();
+    }
+    if (text.size() == laidOut) return changed;
+    if (spaceWidth == 0) spaceWidth = textRenderer.shape(" ").width;
+
+    // From the last word on, it may have grown
+    size_t at = laidOut;
+    if (!words.empty() && words.back().end == laidOut) {
+        at = words.back().start;
+        words.pop_back();
+    }
+    while (at < text.size()) {
+        if (isspace((unsigned char)text[at])) {
+            at++;
+            continue;
+        }
+        size_t end = min(text.find_first_of(" \t\r\n", at), text.size());
+        place(textRenderer, at, end, width);
+        at = end;
+    }
+    laidOut = text.size();
+    if (words.empty()) return changed;
+
+    // Lines that scrolled off aren't needed, the last word places the next
+    int first = words.back().line - CAPTION_LINES + 1;
+    auto kept = find_if(words.begin(), words.end() - 1, [first](const Word& w) { return w.line >= first; });
+    words.erase(words.begin(), kept);
+    return true;
+}
+
+void Caption::discard() {
+    while (events.front()) events.pop();
+}
+
+void Caption::place(TextRenderer& textRenderer, size_t start, size_t end, float width) {
+    Word word = { start, end, 0, 0, textRenderer.shape(text.substr(start, end - start)).width };
+    if (!words.empty()) {
+        const Word& previous = words.back();
+        word.line = previous.line;
+        word.x = previous.x + previous.width + spaceWidth;
+
+        // Wrap, a word wider than a line runs over the end of its own
+        if (word.x + word.width > width) {
+            word.line++;
+            word.x = 0;
+        }
+    }
+    words.push_back(word);
+}
+
+void Caption::draw(TextRenderer& textRenderer, Mesh& mesh, float x, float bottom, SDL_Color color) {
+    if (words.empty()) return;
+    int last = words.back().line;
+    for (size_t i = 0; i < words.size(); ) {
+        // Words on this line, centred
+        size_t end = i;
+        while (end < words.size() && words[end].line == words[i].line) end++;
+        float left = x - (words[end - 1].x + words[end - 1].width) / 2;
+        float top = bottom - (last - words[i].line + 1) * textRenderer.lineHeight();
+        for (; i < end; i++) {
+            const Word& w = words[i];
+            textRenderer.draw(mesh, textRenderer.shape(text.substr(w.start, w.end - w.start)), left + w.x, top, color);
+        }
+    }
+}
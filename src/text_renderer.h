@@ -0,0 +1,114 @@
+// Deskman robot.
+// Text renderer module.
+// Thomas Jacobs
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include "mpsc_queue.h"
+#include "vector_renderer.h"
+
+// Text from glyphs drawn once into a texture atlas. Strings are laid out into runs of quads that are
+// cached, so drawing text is copying vertices, and all of it goes out in one SDL_RenderGeometry call.
+class TextRenderer {
+public:
+    // A string in white from the pen at 0, 0, the top of the line
+    struct Run {
+        std::vector<SDL_Vertex> vertices;  // 4 per glyph
+        float width = 0;
+    };
+
+    ~TextRenderer() { unload(); }
+
+    // Atlas for the font on the renderer, starting with printable ASCII
+    bool load(SDL_Renderer* renderer, TTF_Font* font);
+    bool isLoaded() const { return atlas != nullptr; }
+
+    // Before the renderer goes
+    void unload();
+
+    // Cached layout, valid until the next call. Glyphs not seen before go into the atlas.
+    const Run& shape(const std::string& text);
+
+    // Add a run's quads to the mesh with its top left at x, y
+    void draw(Mesh& mesh, const Run& run, float x, float y, SDL_Color color) const;
+
+    // Draw the mesh's text
+    void submit(const Mesh& mesh) const { mesh.submit(renderer, atlas); }
+
+    int lineHeight() const { return lineSkip; }
+
+private:
+    struct Glyph {
+        SDL_Rect source = { 0, 0, 0, 0 };  // In the atlas, empty for blanks
+        int offset = 0;  // From the pen to the left of the source
+        int advance = 0;
+    };
+
+    const Glyph& glyph(uint32_t codepoint);
+
+    SDL_Renderer* renderer = nullptr;
+    TTF_Font* font = nullptr;
+    SDL_Texture* atlas = nullptr;
+    int lineSkip = 0;
+    std::unordered_map<uint32_t, Glyph> glyphs;
+    std::unordered_map<std::string, Run> runs;
+
+    // Shelf the next glyph goes on
+    int shelfX = 0;
+    int shelfY = 0;
+    int shelfHeight = 0;
+};
+
+// Words on screen as a reply streams in. Text can come from any thread, the render thread lays out only
+// what's new, from the last word on since a delta can end half way through one.
+class Caption {
+public:
+    // Any thread
+    void append(const std::string& text);
+
+    // Any thread, the reply is over, the caption stays a while then goes
+    void finish();
+
+    // Render thread, take what arrived and lay it out in lines this wide, true if the caption changed
+    bool update(TextRenderer& text, float width);
+
+    // Render thread, drop what arrived when there's no text renderer to show it
+    void discard();
+
+    // Render thread, the last few lines, centred on x, bottom line ending at bottom
+    void draw(TextRenderer& text, Mesh& mesh, float x, float bottom, SDL_Color color);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Event {
+        std::string text;
+        bool finish = false;
+    };
+
+    struct Word {
+        size_t start, end;  // In text
+        int line;
+        float x, width;
+    };
+
+    void clear();
+    void place(TextRenderer& text, size_t start, size_t end, float width);
+
+    MpscQueue<Event> events;
+
+    // Render thread
+    std::string text;
+    size_t laidOut = 0;
+    std::vector<Word> words;
+    float spaceWidth = 0;
+    bool finished = false;
+    Clock::time_point finishedAt;
+};
@@ -0,0 +1,81 @@
+// Deskman robot.
+// Tool executor module.
+// Thomas Jacobs
+
+#include "tool_executor.h"
+#include <iostream>
+
+// Logging
+#define DEBUG 0
+
+using namespace std;
+using namespace nlohmann;
+
+ToolExecutor::ToolExecutor(vector<Tool> tools_) : tools(move(tools_)) {
+    worker = thread(&ToolExecutor::run, this);
+}
+
+ToolExecutor::~ToolExecutor() {
+    stop();
+}
+
+json ToolExecutor::definitions() const {
+    json list = json::array();
+    for (const Tool& tool : tools) {
+        list.push_back({
+            {"type", "function"},
+            {"name", tool.name},
+            {"description", tool.description},
+            {"parameters", tool.parameters}
+        });
+    }
+    return list;
+}
+
+bool ToolExecutor::call(const string& callId, const string& name, const json& args, Done done) {
+    for (const Tool& tool : tools) {
+        if (tool.name != name) continue;
+        {
+            lock_guard<mutex> lock(callsMutex);
+            if (stopping) return false;
+            calls.push_back({ callId, &tool, args, move(done) });
+        }
+        callsChanged.notify_one();
+        return true;
+    }
+    cerr << "No tool called " << name << "." << endl;
+    return false;
+}
+
+void ToolExecutor::stop() {
+    {
+        lock_guard<mutex> lock(callsMutex);
+        stopping = true;
+        calls.clear();
+    }
+    callsChanged.notify_one();
+    if (worker.joinable()) worker.join();
+}
+
+void ToolExecutor::run() {
+    while (true) {
+        // Next call
+        unique_lock<mutex> lock(callsMutex);
+        callsChanged.wait(lock, [this] { return stopping || !calls.empty(); });
+        if (stopping) break;
+        Call call = move(calls.front());
+        calls.pop_front();
+        lock.unlock();
+
+        // Bad arguments from the model come back to it as an error rather than taking the robot down
+        json output;
+        try {
+            output = call.tool->handler(call.args);
+        } catch (const exception& e) {
+            cerr << "Tool " << call.tool->name << " failed: " << e.what() << endl;
+            output = { {"error", e.what()} };
+        }
+        if (DEBUG) cout << "Tool " << call.tool->name << " returned " << output.dump() << endl;
+        if (call.done) call.done(call.callId, output);
+    }
+}
@@ -0,0 +1,58 @@
+// Deskman robot.
+// Tool executor module.
+// Thomas Jacobs
+
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+#include <nlohmann/json.hpp>
+
+// A function the model can call, described by a JSON schema, with a handler that returns its output
+struct Tool {
+    std::string name;
+    std::string description;
+    nlohmann::json parameters;
+    std::function<nlohmann::json(const nlohmann::json& args)> handler;
+};
+
+// The robot's tools, and a worker thread that runs their calls in the order they came in.
+// Handlers can block on hardware as long as they like without holding up the socket thread.
+class ToolExecutor {
+public:
+    typedef std::function<void(const std::string& callId, const nlohmann::json& output)> Done;
+
+    ToolExecutor(std::vector<Tool> tools);
+    ~ToolExecutor();
+
+    // The "tools" list for the session config
+    nlohmann::json definitions() const;
+
+    // Queue a call, done gets the output on the worker thread, false if there's no such tool
+    bool call(const std::string& callId, const std::string& name, const nlohmann::json& args, Done done);
+
+    // Finish the call in progress, drop the rest and join the worker
+    void stop();
+
+private:
+    struct Call {
+        std::string callId;
+        const Tool* tool;
+        nlohmann::json args;
+        Done done;
+    };
+
+    void run();
+
+    std::vector<Tool> tools;
+    std::deque<Call> calls;
+    std::mutex callsMutex;
+    std::condition_variable callsChanged;
+    bool stopping = false;
+    std::thread worker;
+};
@@ -0,0 +1,132 @@
+// Deskman robot.
+// Voice activity detector.
+// Thomas Jacobs
+
+#include "vad.h"
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+// Tuning
+static const float HIGH_PASS_HZ = 100.0f;    // Rumble and DC below this is ignored
+static const float BAND_LOW_HZ = 200.0f;     // Flatness is measured over the speech band
+static const float BAND_HIGH_HZ = 4000.0f;
+static const float MARGIN_DB = 9.0f;         // Speech is this far above the noise floor
+static const float MIN_LEVEL_DB = -50.0f;    // And never quieter than this
+static const float MAX_FLATNESS = 0.3f;      // Voiced speech is peaky, noise near 0.5 or above
+static const float MAX_CROSSINGS = 0.25f;    // Per sample, white noise is about 0.5
+static const int ONSET_FRAMES = 3;           // 60 ms of speech in a row starts an utterance
+static const int MIN_WINDOW_FRAMES = 50;     // Floor's minimum is tracked over one to two of these 1 s windows
+static const float FLOOR_CREEP = 0.05f;      // Per frame, towards that minimum while frames pass for speech
+
+static int nextPowerOfTwo(size_t n) {
+    int size = 1;
+    while ((size_t)size < n) size <<= 1;
+    return size;
+}
+
+VoiceActivityDetector::VoiceActivityDetector(int sampleRate, int hangoverMs) :
+    rate(sampleRate),
+    hangoverFrames(max(1, hangoverMs / 20)),
+    frameSize(sampleRate / 50),
+    fft(nextPowerOfTwo(sampleRate / 50)) {
+    frame.resize(frameSize);
+    spectrum.resize(fft.bins());
+    bandLow = max(1, (int)(BAND_LOW_HZ * fft.size() / rate));
+    bandHigh = min(fft.bins() - 1, (int)(BAND_HIGH_HZ * fft.size() / rate));
+
+    // First order high pass, as in the whisper examples
+    float rc = 1.0f / (2.0f * (float)M_PI * HIGH_PASS_HZ);
+    float dt = 1.0f / rate;
+    highPassAlpha = rc / (rc + dt);
+}
+
+void VoiceActivityDetector::reset() {
+    current = Silence;
+    voicedRun = 0;
+    silentRun = 0;
+    processedSamples = 0;
+    speechStartSample = 0;
+    filled = 0;
+}
+
+void VoiceActivityDetector::prime(const AudioSpan<int16_t>& span) {
+    process(span);
+    float minimum = min(minDb, previousMinDb);
+    if (minimum < 100) floorDb = minimum;
+    reset();
+}
+
+VoiceActivityDetector::State VoiceActivityDetector::process(const int16_t* samples, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        float x = samples[i] * (1.0f / 32768.0f);
+        previousOut = highPassAlpha * (previousOut + x - previousIn);
+        previousIn = x;
+        frame[filled++] = previousOut;
+        processedSamples++;
+        if (filled == frameSize) {
+            analyse();
+            filled = 0;
+        }
+    }
+    return current;
+}
+
+VoiceActivityDetector::State VoiceActivityDetector::process(const AudioSpan<int16_t>& span) {
+    process(span.first, span.firstSize);
+    return process(span.second, span.secondSize);
+}
+
+void VoiceActivityDetector::analyse() {
+    // Energy and zero crossings
+    float energy = 0;
+    int crossings = 0;
+    for (size_t i = 0; i < frameSize; i++) {
+        energy += frame[i] * frame[i];
+        if (i > 0 && (frame[i] >= 0) != (frame[i - 1] >= 0)) crossings++;
+    }
+    last.levelDb = 10 * log10f(energy / frameSize + 1e-10f);
+    last.zeroCrossings = (float)crossings / frameSize;
+
+    // Spectral flatness, geometric over arithmetic mean of the band's power
+    fft.power(frame.data(), (int)frameSize, spectrum.data());
+    float logSum = 0, sum = 0;
+    for (int k = bandLow; k <= bandHigh; k++) {
+        logSum += logf(spectrum[k] + 1e-12f);
+        sum += spectrum[k];
+    }
+    int count = bandHigh - bandLow + 1;
+    last.flatness = expf(logSum / count) / (sum / count + 1e-12f);
+
+    // Loud, tonal and not noise-like, low passed noise has few crossings but isn't tonal
+    bool loud = last.levelDb > floorDb + MARGIN_DB && last.levelDb > MIN_LEVEL_DB;
+    last.speech = loud && last.flatness < MAX_FLATNESS && last.zeroCrossings < MAX_CROSSINGS;
+
+    // Quietest frame over the last one to two seconds
+    minDb = min(minDb, last.levelDb);
+    if (++minFrames == MIN_WINDOW_FRAMES) {
+        previousMinDb = minDb;
+        minDb = 100;
+        minFrames = 0;
+    }
+
+    // Noise floor drops quickly and rises slowly from frames that aren't speech. Speech has gaps, so if even
+    // the quietest recent frame is above the floor, it's noise taken for speech and the floor creeps up to it.
+    if (!last.speech) floorDb += (last.levelDb - floorDb) * (last.levelDb < floorDb ? 0.3f : 0.02f);
+    else if (previousMinDb < 100 && min(minDb, previousMinDb) > floorDb) floorDb += (min(minDb, previousMinDb) - floorDb) * FLOOR_CREEP;
+    last.floorDb = floorDb;
+
+    // Onset and hangover
+    if (current == Silence) {
+        voicedRun = last.speech ? voicedRun + 1 : 0;
+        if (voicedRun >= ONSET_FRAMES) {
+            current = Speech;
+            speechStartSample = processedSamples - (uint64_t)ONSET_FRAMES * frameSize;
+        }
+    }
+    else if (current == Speech) {
+        silentRun = last.speech ? 0 : silentRun + 1;
+        if (silentRun >= hangoverFrames) current = Ended;
+    }
+}
@@ -0,0 +1,80 @@
+// Deskman robot.
+// Voice activity detector.
+// Thomas Jacobs
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "audio_ring.h"
+#include "fft.h"
+
+// Streaming voice activity detection on 20 ms frames of captured audio, fed in any block size.
+// Each frame is high passed like vad_simple() in the whisper examples, then scored on three features:
+// energy above an adaptive noise floor, zero crossing rate, and spectral flatness across the speech band.
+// A frame is speech when it is loud, tonal and low in crossings, so steady hiss, fans and clicks
+// don't start a turn. The floor also creeps up to the quietest frame of the last second or two, so
+// steady noise loud enough to pass for speech still ends the turn. Speech starts after a short run of such frames and ends after a hangover of silence.
+class VoiceActivityDetector {
+public:
+    enum State { Silence, Speech, Ended };
+
+    // Features of the last frame, for tuning
+    struct Features {
+        float levelDb = -100;
+        float floorDb = -100;
+        float zeroCrossings = 0;
+        float flatness = 1;
+        bool speech = false;
+    };
+
+    VoiceActivityDetector(int sampleRate, int hangoverMs = 700);
+
+    // Feed captured samples, returns the state after them
+    State process(const int16_t* samples, size_t n);
+    State process(const AudioSpan<int16_t>& span);
+
+    // Start listening for a new utterance, keeps the noise floor
+    void reset();
+
+    // Learn the noise floor from audio heard before listening, like the always-on capture ring, then reset
+    void prime(const AudioSpan<int16_t>& span);
+
+    State state() const { return current; }
+    bool heardSpeech() const { return current != Silence; }
+
+    // Samples fed in since reset, and the sample speech started at
+    uint64_t processed() const { return processedSamples; }
+    uint64_t speechStart() const { return speechStartSample; }
+
+    const Features& features() const { return last; }
+
+private:
+    void analyse();
+
+    int rate;
+    int hangoverFrames;
+    size_t frameSize;
+    RealFFT fft;
+    int bandLow, bandHigh;
+
+    // Frame being filled
+    std::vector<float> frame;
+    size_t filled = 0;
+    float previousIn = 0;
+    float previousOut = 0;
+    float highPassAlpha;
+    std::vector<float> spectrum;
+
+    // Decision
+    State current = Silence;
+    float floorDb = -60;
+    float minDb = 100;  // Quietest frame in this window and the one before, what the floor creeps up to
+    float previousMinDb = 100;
+    int minFrames = 0;
+    int voicedRun = 0;
+    int silentRun = 0;
+    uint64_t processedSamples = 0;
+    uint64_t speechStartSample = 0;
+    Features last;
+};
@@ -1,31 +1,327 @@
 #include "vector_renderer.h"
+#include <algorithm>
 
-void drawLargeDot(SDL_Renderer* renderer, int x, int y) {
-    // Draw a 3x3 pattern for each point
-    SDL_RenderDrawPoint(renderer, x-1, y-1);
-    SDL_RenderDrawPoint(renderer, x, y-1);
-    SDL_RenderDrawPoint(renderer, x+1, y-1);
-    SDL_RenderDrawPoint(renderer, x-1, y);
-    SDL_RenderDrawPoint(renderer, x, y);
-    SDL_RenderDrawPoint(renderer, x+1, y);
-    SDL_RenderDrawPoint(renderer, x-1, y+1);
-    SDL_RenderDrawPoint(renderer, x, y+1);
-    SDL_RenderDrawPoint(renderer, x+1, y+1);
-}
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Edges fade to transparent over this many pixels, for anti-aliasing
+static const float FEATHER = 1.0f;
+
+// Outlines are split into segments about this long, in pixels
+static const float SEGMENT_LENGTH = 4.0f;
+static const int MIN_SEGMENTS = 24;
+static const int MAX_SEGMENTS = 360;
+
+// Shapes with a cutout are built from vertical strips this wide
+static const float COLUMN_STEP = 2.0f;
 
 namespace Projection {
-    SDL_Point project(const Vec3& point, const Vec3& faceRotation) {
+    SDL_FPoint projectF(const Vec3& point, const Vec3& faceRotation) {
         // Apply face rotation first
         Vec3 rotated = point
             .rotateX(faceRotation.x)
             .rotateY(faceRotation.y)
             .rotateZ(faceRotation.z);
-            
+
         // Simple perspective projection
         float perspective = 1.0f / (1.0f + rotated.z * 0.001f);
         return {
-            static_cast<int>(rotated.x * perspective + screen_width/2),
-            static_cast<int>(rotated.y * perspective + screen_height/2)
+            rotated.x * perspective + screen_width/2,
+            rotated.y * perspective + screen_height/2
         };
     }
-} 
\ No newline at end of file
+
+    SDL_Point project(const Vec3& point, const Vec3& faceRotation) {
+        SDL_FPoint p = projectF(point, faceRotation);
+        return { static_cast<int>(p.x), static_cast<int>(p.y) };
+    }
+
+    // Rotation about one axis, as the Vec3 rotations do it
+    static void axisRotation(int axis, float angle, float r[3][3]) {
+        float rad = angle * M_PI / 180.0f;
+        float c = cos(rad), s = sin(rad);
+        int a = (axis + 1) % 3, b = (axis + 2) % 3;
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) r[i][j] = i == j ? 1.0f : 0.0f;
+        }
+        r[a][a] = c;
+        r[a][b] = -s;
+        r[b][a] = s;
+        r[b][b] = c;
+    }
+
+    Matrix::Matrix(const Vec3& faceRotation) : offset(0, 0, 0), centerX(screen_width/2), centerY(screen_height/2) {
+        // X first, then Y, then Z
+        float angles[3] = { faceRotation.x, faceRotation.y, faceRotation.z };
+        axisRotation(0, angles[0], m);
+        for (int axis = 1; axis < 3; axis++) {
+            float r[3][3], product[3][3];
+            axisRotation(axis, angles[axis], r);
+            for (int i = 0; i < 3; i++) {
+                for (int j = 0; j < 3; j++) product[i][j] = r[i][0] * m[0][j] + r[i][1] * m[1][j] + r[i][2] * m[2][j];
+            }
+            std::copy(&product[0][0], &product[0][0] + 9, &m[0][0]);
+        }
+    }
+
+    Matrix Matrix::translated(const Vec3& origin) const {
+        Matrix t = *this;
+        t.offset = Vec3(
+            offset.x + m[0][0] * origin.x + m[0][1] * origin.y + m[0][2] * origin.z,
+            offset.y + m[1][0] * origin.x + m[1][1] * origin.y + m[1][2] * origin.z,
+            offset.z + m[2][0] * origin.x + m[2][1] * origin.y + m[2][2] * origin.z);
+        return t;
+    }
+
+    SDL_FPoint Matrix::apply(const Vec3& p) const {
+        float x = m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + offset.x;
+        float y = m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + offset.y;
+        float z = m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + offset.z;
+        float perspective = 1.0f / (1.0f + z * 0.001f);
+        return { x * perspective + centerX, y * perspective + centerY };
+    }
+
+#if defined(__ARM_NEON)
+
+    // 4 points, rotated, divided and centred
+    static inline void projectLanes(const Matrix& t, const float* x, const float* y, const float* z, float32x4_t& outX, float32x4_t& outY) {
+        float32x4_t px = vld1q_f32(x), py = vld1q_f32(y);
+        float32x4_t pz = z ? vld1q_f32(z) : vdupq_n_f32(0);
+        float32x4_t rx = vdupq_n_f32(t.offset.x), ry = vdupq_n_f32(t.offset.y), rz = vdupq_n_f32(t.offset.z);
+        rx = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(rx, px, t.m[0][0]), py, t.m[0][1]), pz, t.m[0][2]);
+        ry = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(ry, px, t.m[1][0]), py, t.m[1][1]), pz, t.m[1][2]);
+        rz = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(rz, px, t.m[2][0]), py, t.m[2][1]), pz, t.m[2][2]);
+        float32x4_t w = vmlaq_n_f32(vdupq_n_f32(1.0f), rz, 0.001f);
+        #if defined(__aarch64__)
+        float32x4_t perspective = vdivq_f32(vdupq_n_f32(1.0f), w);
+        #else
+        // Estimate refined twice, as close as the divide for screen sized values
+        float32x4_t perspective = vrecpeq_f32(w);
+        perspective = vmulq_f32(perspective, vrecpsq_f32(w, perspective));
+        perspective = vmulq_f32(perspective, vrecpsq_f32(w, perspective));
+        #endif
+        outX = vmlaq_f32(vdupq_n_f32(t.centerX), rx, perspective);
+        outY = vmlaq_f32(vdupq_n_f32(t.centerY), ry, perspective);
+    }
+
+#define PROJECTION_VECTOR
+#define STORE_FLOAT(out, v) vst1q_f32(out, v)
+#define STORE_INT(out, v) vst1q_s32(out, vcvtq_s32_f32(v))
+    typedef float32x4_t Lanes;
+
+#elif defined(__SSE2__)
+
+    static inline void projectLanes(const Matrix& t, const float* x, const float* y, const float* z, __m128& outX, __m128& outY) {
+        __m128 px = _mm_loadu_ps(x), py = _mm_loadu_ps(y);
+        __m128 pz = z ? _mm_loadu_ps(z) : _mm_setzero_ps();
+        __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(t.m[0][0])), _mm_mul_ps(py, _mm_set1_ps(t.m[0][1]))),
+                               _mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(t.m[0][2])), _mm_set1_ps(t.offset.x)));
+        __m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(t.m[1][0])), _mm_mul_ps(py, _mm_set1_ps(t.m[1][1]))),
+                               _mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(t.m[1][2])), _mm_set1_ps(t.offset.y)));
+        __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(t.m[2][0])), _mm_mul_ps(py, _mm_set1_ps(t.m[2][1]))),
+                               _mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(t.m[2][2])), _mm_set1_ps(t.offset.z)));
+        __m128 w = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(rz, _mm_set1_ps(0.001f)));
+        __m128 perspective = _mm_div_ps(_mm_set1_ps(1.0f), w);
+        outX = _mm_add_ps(_mm_mul_ps(rx, perspective), _mm_set1_ps(t.centerX));
+        outY = _mm_add_ps(_mm_mul_ps(ry, perspective), _mm_set1_ps(t.centerY));
+    }
+
+#define PROJECTION_VECTOR
+#define STORE_FLOAT(out, v) _mm_storeu_ps(out, v)
+#define STORE_INT(out, v) _mm_storeu_si128((__m128i*)(out), _mm_cvttps_epi32(v))
+    typedef __m128 Lanes;
+
+#endif
+
+    void Matrix::project(const float* x, const float* y, const float* z, size_t count, float* outX, float* outY) const {
+        size_t i = 0;
+        #ifdef PROJECTION_VECTOR
+        for (; i + 4 <= count; i += 4) {
+            Lanes sx, sy;
+            projectLanes(*this, x + i, y + i, z ? z + i : nullptr, sx, sy);
+            STORE_FLOAT(outX + i, sx);
+            STORE_FLOAT(outY + i, sy);
+        }
+        #endif
+        for (; i < count; i++) {
+            SDL_FPoint p = apply(Vec3(x[i], y[i], z ? z[i] : 0));
+            outX[i] = p.x;
+            outY[i] = p.y;
+        }
+    }
+
+    void Matrix::project(const float* x, const float* y, const float* z, size_t count, int* outX, int* outY) const {
+        size_t i = 0;
+        #ifdef PROJECTION_VECTOR
+        for (; i + 4 <= count; i += 4) {
+            Lanes sx, sy;
+            projectLanes(*this, x + i, y + i, z ? z + i : nullptr, sx, sy);
+            STORE_INT(outX + i, sx);
+            STORE_INT(outY + i, sy);
+        }
+        #endif
+        for (; i < count; i++) {
+            SDL_FPoint p = apply(Vec3(x[i], y[i], z ? z[i] : 0));
+            outX[i] = static_cast<int>(p.x);
+            outY[i] = static_cast<int>(p.y);
+        }
+    }
+}
+
+void Mesh::submit(SDL_Renderer* renderer, SDL_Texture* texture) const {
+    if (indices.empty()) return;
+
+    // Untextured geometry blends with the draw blend mode, the feathered edges need it
+    if (!texture) SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_RenderGeometry(renderer, texture, vertices.data(), (int)vertices.size(), indices.data(), (int)indices.size());
+}
+
+// Shapes shrink with distance like the points on them
+static float perspectiveScale(float z) {
+    return 1.0f / (1.0f + z * 0.001f);
+}
+
+static SDL_Color transparent(SDL_Color color) {
+    color.a = 0;
+    return color;
+}
+
+void VectorShape::keepPositions() {
+    localX.resize(local.vertices.size());
+    localY.resize(local.vertices.size());
+    for (size_t i = 0; i < local.vertices.size(); i++) {
+        localX[i] = local.vertices[i].position.x;
+        localY[i] = local.vertices[i].position.y;
+    }
+}
+
+void VectorShape::project(Mesh& frame, const Vec3& facePosition, const Projection::Matrix& faceMatrix) {
+    size_t count = local.vertices.size();
+    screenX.resize(count);
+    screenY.resize(count);
+    faceMatrix.translated(localPosition + facePosition).project(localX.data(), localY.data(), nullptr, count, screenX.data(), screenY.data());
+
+    // Colours come with the local vertices, positions from the projection
+    int base = (int)frame.vertices.size();
+    frame.vertices.insert(frame.vertices.end(), local.vertices.begin(), local.vertices.end());
+    for (size_t i = 0; i < count; i++) frame.vertices[base + i].position = { screenX[i], screenY[i] };
+    for (int index : local.indices) frame.indices.push_back(base + index);
+}
+
+// Filled ellipse as a fan from its centre, with a ring around it that fades out at the edge
+static void fillEllipse(Mesh& mesh, float radiusX, float radiusY, SDL_Color color) {
+    if (radiusX <= 0 || radiusY <= 0) return;
+
+    // Enough segments that the outline looks round at any size
+    float perimeter = M_PI * (3 * (radiusX + radiusY) - sqrtf((3 * radiusX + radiusY) * (radiusX + 3 * radiusY)));
+    int segments = std::clamp((int)(perimeter / SEGMENT_LENGTH), MIN_SEGMENTS, MAX_SEGMENTS);
+    float half = FEATHER * 0.5f;
+    SDL_Color clear = transparent(color);
+
+    // Centre, then an inner and outer vertex per step around
+    int centre = mesh.add({ 0, 0 }, color);
+    int first = centre + 1;
+    for (int i = 0; i < segments; i++) {
+        float angle = 2.0f * M_PI * i / segments;
+        float c = cosf(angle), s = sinf(angle);
+        mesh.add({ c * std::max(radiusX - half, 0.0f), s * std::max(radiusY - half, 0.0f) }, color);
+        mesh.add({ c * (radiusX + half), s * (radiusY + half) }, clear);
+    }
+    for (int i = 0; i < segments; i++) {
+        int inner = first + 2 * i;
+        int next = first + 2 * ((i + 1) % segments);
+        mesh.triangle(centre, inner, next);
+        mesh.quad(inner, inner + 1, next + 1, next);
+    }
+}
+
+// Ellipse less a cutout ellipse, as vertical strips. A column has up to two runs, above and below
+// the cutout, each with its ends faded out, and runs join the same run in the column before.
+static void fillEllipseCutout(Mesh& mesh, float radiusX, float radiusY, float cutoutY, float cutoutRadiusX, float cutoutRadiusY, SDL_Color color) {
+    if (radiusX <= 0 || radiusY <= 0) return;
+    int columns = std::max(2, (int)ceilf(2 * radiusX / COLUMN_STEP) + 1);
+    float half = FEATHER * 0.5f;
+    SDL_Color clear = transparent(color);
+
+    int previous[2] = { -1, -1 };
+    for (int i = 0; i < columns; i++) {
+        float x = -radiusX + 2 * radiusX * i / (columns - 1);
+        float outer = radiusY * sqrtf(std::max(0.0f, 1 - x * x / (radiusX * radiusX)));
+
+        // Runs in this column
+        float top[2], bottom[2];
+        bool present[2];
+        if (fabsf(x) < cutoutRadiusX) {
+            float cut = cutoutRadiusY * sqrtf(1 - x * x / (cutoutRadiusX * cutoutRadiusX));
+            top[0] = -outer;
+            bottom[0] = std::min(outer, cutoutY - cut);
+            top[1] = std::max(-outer, cutoutY + cut);
+            bottom[1] = outer;
+            present[0] = bottom[0] > top[0];
+            present[1] = bottom[1] > top[1];
+        }
+        else {
+            top[0] = -outer;
+            bottom[0] = outer;
+            present[0] = true;
+            present[1] = false;
+        }
+
+        for (int run = 0; run < 2; run++) {
+            if (!present[run]) {
+                previous[run] = -1;
+                continue;
+            }
+            float middle = (top[run] + bottom[run]) * 0.5f;
+            int v = mesh.add({ x, top[run] - half }, clear);
+            mesh.add({ x, std::min(top[run] + half, middle) }, color);
+            mesh.add({ x, std::max(bottom[run] - half, middle) }, color);
+            mesh.add({ x, bottom[run] + half }, clear);
+            if (previous[run] >= 0) {
+                int p = previous[run];
+                for (int k = 0; k < 3; k++) mesh.quad(p + k, v + k, v + k + 1, p + k + 1);
+            }
+            previous[run] = v;
+        }
+    }
+}
+
+bool Circle::update(const Vec3& facePosition) {
+    SDL_Color c = fillColor;
+    if (!changed({ radius, localPosition.z + facePosition.z,
+                   (float)c.r, (float)c.g, (float)c.b, (float)c.a, localPosition.x, localPosition.y })) return false;
+
+    // Calculate effective radius based on perspective
+    float effectiveRadius = radius * perspectiveScale(localPosition.z + facePosition.z);
+    local.clear();
+    fillEllipse(local, effectiveRadius, effectiveRadius, fillColor);
+    keepPositions();
+    return true;
+}
+
+bool Ellipse::update(const Vec3& facePosition) {
+    SDL_Color c = fillColor;
+    if (!changed({ radiusX, radiusY, cutoutY, cutoutHeight, localPosition.z + facePosition.z,
+                   (float)c.r, (float)c.g, (float)c.b, (float)c.a, localPosition.x, localPosition.y })) return false;
+
+    // Calculate effective radii based on perspective
+    float scale = perspectiveScale(localPosition.z + facePosition.z);
+    float effectiveRadiusX = radiusX * scale;
+    float effectiveRadiusY = radiusY * scale;
+    local.clear();
+    if (cutoutHeight <= 0) {
+        fillEllipse(local, effectiveRadiusX, effectiveRadiusY, fillColor);
+        keepPositions();
+        return true;
+    }
+
+    // Cutout keeps the ellipse's proportions
+    float cutoutRadiusY = cutoutHeight / 2.0f;
+    float cutoutRadiusX = effectiveRadiusX * (cutoutRadiusY / effectiveRadiusY);
+    fillEllipseCutout(local, effectiveRadiusX, effectiveRadiusY, cutoutY, cutoutRadiusX, cutoutRadiusY, fillColor);
+    keepPositions();
+    return true;
+}
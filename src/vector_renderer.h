@@ -3,6 +3,8 @@
 #include <SDL2/SDL.h>
 #include <vector>
 #include <cmath>
+#include <algorithm>
+#include <initializer_list>
 #include "screen.h"
 
 // 3D Vector class for transformations
@@ -18,6 +20,11 @@ struct Vec3 {
         return Vec3(x * scalar, y * scalar, z * scalar);
     }
     
+    bool operator==(const Vec3& other) const {
+        return x == other.x && y == other.y && z == other.z;
+    }
+    bool operator!=(const Vec3& other) const { return !(*this == other); }
+    
     // Apply rotation matrix to vector
     Vec3 rotateX(float angle) const {
         float rad = angle * M_PI / 180.0f;
@@ -57,8 +64,65 @@ struct Vec3 {
 namespace Projection {
     // Project 3D point to 2D screen coordinates with perspective
     SDL_Point project(const Vec3& point, const Vec3& faceRotation);
+
+    // Same, without rounding, for mesh vertices
+    SDL_FPoint projectF(const Vec3& point, const Vec3& faceRotation);
+
+    // Face rotation and perspective, built once per frame rather than once per point.
+    // Projects batches of points given as separate x, y and z arrays, 4 at a time with NEON or SSE.
+    struct Matrix {
+        float m[3][3];  // Rotation, Z * Y * X as project() applies it
+        Vec3 offset;  // Rotated origin, added to every point
+        float centerX, centerY;
+
+        Matrix(const Vec3& faceRotation = Vec3());
+
+        // Same rotation, for points given relative to origin
+        Matrix translated(const Vec3& origin) const;
+
+        SDL_FPoint apply(const Vec3& point) const;
+
+        // Project count points, z may be null for points in the plane z = 0
+        void project(const float* x, const float* y, const float* z, size_t count, float* outX, float* outY) const;
+
+        // Same, truncated to whole pixels like project()
+        void project(const float* x, const float* y, const float* z, size_t count, int* outX, int* outY) const;
+    };
 }
 
+// Triangles, either a shape's in its own plane or a projected frame's,
+// all shapes go to the renderer in one SDL_RenderGeometry call
+struct Mesh {
+    std::vector<SDL_Vertex> vertices;
+    std::vector<int> indices;
+
+    void clear() {
+        vertices.clear();
+        indices.clear();
+    }
+
+    // Add a vertex, returns its index
+    int add(SDL_FPoint position, SDL_Color color, SDL_FPoint texCoord = { 0, 0 }) {
+        vertices.push_back({ position, color, texCoord });
+        return (int)vertices.size() - 1;
+    }
+
+    void triangle(int a, int b, int c) {
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+    }
+
+    // Two triangles, corners in order around the quad
+    void quad(int a, int b, int c, int d) {
+        triangle(a, b, c);
+        triangle(a, c, d);
+    }
+
+    // Untextured, or with texCoords into the texture
+    void submit(SDL_Renderer* renderer, SDL_Texture* texture = NULL) const;
+};
+
 // Base class for all vector shapes
 class VectorShape {
 public:
@@ -73,11 +137,32 @@ public:
                    fillColor({0, 0, 0, 255}), strokeColor({0, 0, 0, 255}), strokeWidth(1.0f) {}
     virtual ~VectorShape() {}
     
-    virtual void render(SDL_Renderer* renderer, const Vec3& facePosition, const Vec3& faceRotation) = 0;
-};
+    // Rebuild the local mesh if the shape changed since the last call, true if it did
+    virtual bool update(const Vec3& facePosition) = 0;
+
+    // Add the local mesh, projected, to the frame's mesh
+    void project(Mesh& frame, const Vec3& facePosition, const Projection::Matrix& faceMatrix);
 
-// Helper function to draw a larger dot
-void drawLargeDot(SDL_Renderer* renderer, int x, int y);
+protected:
+    // True if the parameters differ from the ones the local mesh was built with, remembers them
+    bool changed(std::initializer_list<float> params) {
+        if (built && std::equal(params.begin(), params.end(), builtWith.begin(), builtWith.end())) return false;
+        builtWith.assign(params);
+        built = true;
+        return true;
+    }
+
+    Mesh local;  // Triangles in the shape's plane, around its position
+
+    // Split the local mesh's positions into the arrays the projection reads, after rebuilding it
+    void keepPositions();
+
+private:
+    std::vector<float> localX, localY;
+    std::vector<float> screenX, screenY;
+    std::vector<float> builtWith;
+    bool built = false;
+};
 
 // Circle shape
 class Circle : public VectorShape {
@@ -92,28 +177,7 @@ public:
         this->strokeWidth = strokeWidth;
     }
     
-    void render(SDL_Renderer* renderer, const Vec3& facePosition, const Vec3& faceRotation) override {
-        SDL_SetRenderDrawColor(renderer, fillColor.r, fillColor.g, fillColor.b, fillColor.a);
-        
-        // Calculate effective radius based on perspective
-        float effectiveRadius = radius * (1.0f / (1.0f + (localPosition.z + facePosition.z) * 0.001f));
-        
-        // Draw filled circle by projecting each point in 3D space
-        // Use step size of 2 to reduce number of points
-        for (int y = -effectiveRadius; y <= effectiveRadius; y += 2) {
-            for (int x = -effectiveRadius; x <= effectiveRadius; x += 2) {
-                if (x*x + y*y <= effectiveRadius*effectiveRadius) {
-                    // Create point in local space
-                    Vec3 point(x, y, 0);
-                    // Add shape position and face position
-                    point = point + localPosition + facePosition;
-                    // Project to screen
-                    SDL_Point screenPoint = Projection::project(point, faceRotation);
-                    drawLargeDot(renderer, screenPoint.x, screenPoint.y);
-                }
-            }
-        }
-    }
+    bool update(const Vec3& facePosition) override;
 };
 
 // Ellipse shape
@@ -133,42 +197,7 @@ public:
         this->strokeWidth = strokeWidth;
     }
     
-    void render(SDL_Renderer* renderer, const Vec3& facePosition, const Vec3& faceRotation) override {
-        SDL_SetRenderDrawColor(renderer, fillColor.r, fillColor.g, fillColor.b, fillColor.a);
-        
-        // Calculate effective radii based on perspective
-        float effectiveRadiusX = radiusX * (1.0f / (1.0f + (localPosition.z + facePosition.z) * 0.001f));
-        float effectiveRadiusY = radiusY * (1.0f / (1.0f + (localPosition.z + facePosition.z) * 0.001f));
-        
-        // Draw filled ellipse by projecting each point in 3D space
-        // Use step size of 2 to reduce number of points
-        for (int y = -effectiveRadiusY; y <= effectiveRadiusY; y += 2) {
-            for (int x = -effectiveRadiusX; x <= effectiveRadiusX; x += 2) {
-                // Calculate if point is in the main ellipse
-                float ellipseValue = (x*x)/(float)(effectiveRadiusX*effectiveRadiusX) + (y*y)/(float)(effectiveRadiusY*effectiveRadiusY);
-                
-                // Calculate if point is in the cutout ellipse
-                float cutoutValue = 0.0f;
-                if (cutoutHeight > 0) {
-                    float cutoutRadiusY = cutoutHeight / 2.0f;
-                    float cutoutRadiusX = effectiveRadiusX * (cutoutRadiusY / effectiveRadiusY);
-                    cutoutValue = (x*x)/(float)(cutoutRadiusX*cutoutRadiusX) + 
-                                 ((y-cutoutY)*(y-cutoutY))/(float)(cutoutRadiusY*cutoutRadiusY);
-                }
-                
-                // Draw point if it's in the main ellipse but not in the cutout
-                if (ellipseValue <= 1.0f && (cutoutHeight == 0 || cutoutValue > 1.0f)) {
-                    // Create point in local space
-                    Vec3 point(x, y, 0);
-                    // Add shape position and face position
-                    point = point + localPosition + facePosition;
-                    // Project to screen
-                    SDL_Point screenPoint = Projection::project(point, faceRotation);
-                    drawLargeDot(renderer, screenPoint.x, screenPoint.y);
-                }
-            }
-        }
-    }
+    bool update(const Vec3& facePosition) override;
 };
 
 // Vector face class to manage all face elements
@@ -177,6 +206,12 @@ private:
     std::vector<VectorShape*> shapes;
     Vec3 position;
     Vec3 rotation;
+    Mesh mesh;
+    
+    // What the projected mesh was made from
+    bool projected = false;
+    Vec3 projectedPosition;
+    Vec3 projectedRotation;
     
 public:
     VectorFace() : position(0, 0, 0), rotation(0, 0, 0) {}
@@ -188,17 +223,38 @@ public:
     
     void addShape(VectorShape* shape) {
         shapes.push_back(shape);
+        projected = false;
     }
     
     void setRotation(const Vec3& rot) {
         rotation = rot;
     }
     
-    void render(SDL_Renderer* renderer) {
+    // Rebuild changed shapes and reproject if anything moved, false if the last frame still stands
+    bool update() {
+        bool dirty = !projected || position != projectedPosition || rotation != projectedRotation;
+        for (auto shape : shapes) {
+            if (shape->update(position)) dirty = true;
+        }
+        if (!dirty) return false;
+        mesh.clear();
+        Projection::Matrix matrix(rotation);
         for (auto shape : shapes) {
-            shape->render(renderer, position, rotation);
+            shape->project(mesh, position, matrix);
         }
+        projected = true;
+        projectedPosition = position;
+        projectedRotation = rotation;
+        return true;
+    }
+    
+    void render(SDL_Renderer* renderer) {
+        update();
+        mesh.submit(renderer);
     }
+
+    // Projected triangles, for drawing without SDL
+    const Mesh& frame() const { return mesh; }
 };
 
 // Vector renderer manager
@@ -211,9 +267,18 @@ public:
         face.addShape(shape);
     }
     
+    // True if the face changed since the last call, so idle frames can skip drawing and presenting
+    bool update() {
+        return face.update();
+    }
+    
     void render(SDL_Renderer* renderer) {
         face.render(renderer);
     }
+
+    const Mesh& frame() const {
+        return face.frame();
+    }
     
     void setFaceRotation(const Vec3& rotation) {
         face.setRotation(rotation);